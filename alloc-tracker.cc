@@ -0,0 +1,331 @@
+#include "alloc-tracker.hh"
+
+#ifdef GRAVITY_ALLOC_TRACKING
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace AllocationTracker {
+
+const int MAX_SCOPES = 16;
+const int MAX_CALL_SITES = 1024;
+
+// Every allocation is prefixed with its size, so that delete can keep
+// the live heap size. Keeps the alignment malloc gives us.
+const size_t HEADER_SIZE = 16;
+
+struct Counts {
+  uint64_t count;
+  uint64_t bytes;
+};
+
+struct CallSite {
+  void *address;
+  int scope;
+  Counts counts;
+};
+
+static thread_local uint64_t allocationCount = 0;
+static thread_local int currentScope = 0;
+static thread_local bool mainThread = false;
+
+static atomic<uint64_t> totalCount(0);
+static atomic<int64_t> liveBytes(0);
+static atomic<int64_t> peakLiveBytes(0);
+static atomic<bool> enabled(false);
+
+static mutex scopeLock;
+static const char *scopeNames[MAX_SCOPES] = { "other" };
+static int scopeCount = 1;
+
+// The current frame, the frames since the last summary, and all the
+// frames since the tracker was enabled.
+static Counts frame[MAX_SCOPES];
+static Counts window[MAX_SCOPES];
+static Counts total[MAX_SCOPES];
+static uint64_t windowFrames = 0;
+static uint64_t windowMaxCount = 0;
+static uint64_t totalFrames = 0;
+static Counts totalMax;
+
+static CallSite callSites[MAX_CALL_SITES];
+static uint64_t droppedCallSites = 0;
+
+uint64_t GetCount() {
+  return allocationCount;
+}
+
+uint64_t GetTotalCount() {
+  return totalCount.load(memory_order_relaxed);
+}
+
+int64_t GetLiveBytes() {
+  return liveBytes;
+}
+
+int64_t GetPeakLiveBytes() {
+  return peakLiveBytes;
+}
+
+void SetMainThread() {
+  mainThread = true;
+}
+
+void SetEnabled(bool enable) {
+  if (enable && !enabled) {
+    memset(frame, 0, sizeof(frame));
+    memset(window, 0, sizeof(window));
+    memset(total, 0, sizeof(total));
+    memset(callSites, 0, sizeof(callSites));
+    windowFrames = windowMaxCount = 0;
+    totalFrames = 0;
+    totalMax = Counts();
+    droppedCallSites = 0;
+  }
+
+  enabled = enable;
+}
+
+bool IsEnabled() {
+  return enabled;
+}
+
+int RegisterScope(const char *name) {
+  lock_guard<mutex> guard(scopeLock);
+  for (int i = 0; i < scopeCount; ++i)
+    if (strcmp(scopeNames[i], name) == 0)
+      return i;
+
+  // Out of scopes: attribute to "other".
+  if (scopeCount == MAX_SCOPES)
+    return 0;
+
+  scopeNames[scopeCount] = name;
+  return scopeCount++;
+}
+
+int GetCurrentScope() {
+  return currentScope;
+}
+
+void SetCurrentScope(int scope) {
+  currentScope = scope;
+}
+
+static void Record(size_t size, void *address) {
+  frame[currentScope].count++;
+  frame[currentScope].bytes += size;
+
+  // Open addressing on the call site address. Once the table is full,
+  // new call sites are only counted.
+  size_t hash = (reinterpret_cast<uintptr_t>(address) >> 2) * 2654435761u;
+  for (int i = 0; i < MAX_CALL_SITES; ++i) {
+    CallSite &site = callSites[(hash + i) % MAX_CALL_SITES];
+    if (site.address && (site.address != address || site.scope != currentScope))
+      continue;
+
+    site.address = address;
+    site.scope = currentScope;
+    site.counts.count++;
+    site.counts.bytes += size;
+    return;
+  }
+
+  droppedCallSites++;
+}
+
+/// Returns nullptr if out of memory.
+static void *Allocate(size_t size, void *address) {
+  allocationCount++;
+  totalCount.fetch_add(1, memory_order_relaxed);
+
+  char *p = static_cast<char*>(malloc(size + HEADER_SIZE));
+  if (!p)
+    return nullptr;
+  *reinterpret_cast<size_t*>(p) = size;
+
+  int64_t live = liveBytes += size;
+  int64_t peak = peakLiveBytes;
+  while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live))
+    ;
+
+  if (mainThread && enabled)
+    Record(size, address);
+
+  return p + HEADER_SIZE;
+}
+
+static void Free(void *p) {
+  if (!p)
+    return;
+
+  char *base = static_cast<char*>(p) - HEADER_SIZE;
+  liveBytes -= *reinterpret_cast<size_t*>(base);
+  free(base);
+}
+
+void EndFrame() {
+  if (!enabled)
+    return;
+
+  Counts sum = Counts();
+  for (int i = 0; i < scopeCount; ++i) {
+    window[i].count += frame[i].count;
+    window[i].bytes += frame[i].bytes;
+    total[i].count += frame[i].count;
+    total[i].bytes += frame[i].bytes;
+    sum.count += frame[i].count;
+    sum.bytes += frame[i].bytes;
+    frame[i] = Counts();
+  }
+
+  windowFrames++;
+  windowMaxCount = max(windowMaxCount, sum.count);
+  totalFrames++;
+  totalMax.count = max(totalMax.count, sum.count);
+  totalMax.bytes = max(totalMax.bytes, sum.bytes);
+}
+
+static void WriteBytes(ostream &s, uint64_t bytes) {
+  if (bytes < 10 * 1024)
+    s << bytes << " B";
+  else
+    s << bytes / 1024 << " KiB";
+}
+
+void WriteSummary(ostream &s) {
+  // Don't count what the report itself allocates.
+  bool wasEnabled = enabled;
+  enabled = false;
+
+  if (wasEnabled) {
+    Counts sum = Counts();
+    for (int i = 0; i < scopeCount; ++i) {
+      sum.count += window[i].count;
+      sum.bytes += window[i].bytes;
+    }
+
+    uint64_t frames = max<uint64_t>(windowFrames, 1);
+    s << "alloc/frame: " << sum.count / frames
+      << " max " << windowMaxCount << " (";
+    WriteBytes(s, sum.bytes / frames);
+    s << ")";
+    for (int i = 0; i < scopeCount; ++i)
+      if (window[i].count > 0)
+        s << " " << scopeNames[i] << ": " << window[i].count;
+
+    memset(window, 0, sizeof(window));
+    windowFrames = windowMaxCount = 0;
+    s << " ";
+  }
+
+  s << "live: " << liveBytes / 1024 << "/" << peakLiveBytes / 1024 << " KiB";
+
+  enabled = wasEnabled;
+}
+
+void WriteReport(ostream &s) {
+  bool wasEnabled = enabled;
+  enabled = false;
+
+  s << "Heap allocations over " << totalFrames << " frames:" << endl;
+
+  Counts sum = Counts();
+  for (int i = 0; i < scopeCount; ++i) {
+    sum.count += total[i].count;
+    sum.bytes += total[i].bytes;
+  }
+
+  double frames = max<uint64_t>(totalFrames, 1);
+  s << fixed << setprecision(2)
+    << "  per frame: " << sum.count / frames << " allocations, "
+    << sum.bytes / frames << " bytes"
+    << " (worst: " << totalMax.count << " allocations, "
+    << totalMax.bytes << " bytes)" << endl;
+
+  s << "  by scope:" << endl;
+  for (int i = 0; i < scopeCount; ++i)
+    s << "    " << setw(16) << left << scopeNames[i] << right
+      << setw(10) << total[i].count / frames << " allocations/frame "
+      << setw(12) << total[i].bytes / frames << " bytes/frame" << endl;
+
+  vector<CallSite> sites;
+  for (auto &site : callSites)
+    if (site.address)
+      sites.push_back(site);
+  sort(sites.begin(), sites.end(), [](const CallSite &a, const CallSite &b) {
+      return a.counts.count > b.counts.count;
+    });
+  if (sites.size() > 10)
+    sites.resize(10);
+
+  // The addresses can be resolved with addr2line.
+  s << "  top call sites:" << endl;
+  for (auto &site : sites)
+    s << "    " << site.address << " (" << scopeNames[site.scope] << ") "
+      << site.counts.count << " allocations, "
+      << site.counts.bytes << " bytes" << endl;
+  if (droppedCallSites > 0)
+    s << "    (" << droppedCallSites << " allocations from untracked call sites)" << endl;
+
+  s << "  live heap: " << liveBytes / 1024 << " KiB, peak: "
+    << peakLiveBytes / 1024 << " KiB" << endl;
+  s.unsetf(ios::floatfield);
+
+  enabled = wasEnabled;
+}
+
+} // namespace AllocationTracker
+
+// Replace the global operator new and delete, including the nothrow
+// versions: delete expects the header in front of every block, so
+// nothing may be allocated without it. The return address is the
+// caller of operator new, which is close enough to tell the call sites
+// apart.
+void *operator new(size_t size) {
+  void *p = AllocationTracker::Allocate(size, __builtin_return_address(0));
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  void *p = AllocationTracker::Allocate(size, __builtin_return_address(0));
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size, const nothrow_t&) noexcept {
+  return AllocationTracker::Allocate(size, __builtin_return_address(0));
+}
+
+void *operator new[](size_t size, const nothrow_t&) noexcept {
+  return AllocationTracker::Allocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept {
+  AllocationTracker::Free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  AllocationTracker::Free(p);
+}
+
+void operator delete(void *p, const nothrow_t&) noexcept {
+  AllocationTracker::Free(p);
+}
+
+void operator delete[](void *p, const nothrow_t&) noexcept {
+  AllocationTracker::Free(p);
+}
+
+#endif
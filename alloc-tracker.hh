@@ -0,0 +1,92 @@
+#ifndef _GRAVITY_ALLOC_TRACKER_HH_
+#define _GRAVITY_ALLOC_TRACKER_HH_
+
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+#ifdef GRAVITY_ALLOC_TRACKING
+
+/// Keeps track of the global heap, by replacing operator new and
+/// delete. Only built with GRAVITY_ALLOC_TRACKING (the --alloc-tracking
+/// configure option); other builds keep the standard ones. The number
+/// of allocations (per thread and in total) and the live heap size are
+/// always counted. When enabled, the allocations made on the main
+/// thread are also broken down by scope (see ALLOCATION_SCOPE) and by
+/// call site, per frame.
+///
+/// Nothing in here allocates, since it runs inside operator new.
+namespace AllocationTracker {
+
+/// Return the number of global heap allocations made by the calling
+/// thread so far.
+extern uint64_t GetCount();
+
+/// Return the number of global heap allocations made by all the
+/// threads so far.
+extern uint64_t GetTotalCount();
+
+/// Live and peak heap size, over all threads.
+extern int64_t GetLiveBytes();
+extern int64_t GetPeakLiveBytes();
+
+/// Only the thread calling this has its allocations broken down.
+extern void SetMainThread();
+
+extern void SetEnabled(bool enabled);
+extern bool IsEnabled();
+
+/// Return the index of the scope with the given name, registering it
+/// if necessary. The name must be a string literal.
+extern int RegisterScope(const char *name);
+
+/// Return the index of the scope allocations are attributed to on the
+/// calling thread, and change it.
+extern int GetCurrentScope();
+extern void SetCurrentScope(int scope);
+
+/// Close the current frame.
+extern void EndFrame();
+
+/// Write a one line summary of the frames since the last summary.
+extern void WriteSummary(ostream &s);
+
+/// Write a full report of everything since the tracker was enabled:
+/// allocations and bytes per frame and per scope, the top call sites
+/// and the peak live heap.
+extern void WriteReport(ostream &s);
+
+} // namespace AllocationTracker
+
+/// Attributes the allocations made on this thread to a scope for as
+/// long as it exists.
+class AllocationScope {
+protected:
+  int previous;
+
+public:
+  AllocationScope(int scope) :
+    previous(AllocationTracker::GetCurrentScope())
+  {
+    AllocationTracker::SetCurrentScope(scope);
+  }
+
+  ~AllocationScope() {
+    AllocationTracker::SetCurrentScope(this->previous);
+  }
+};
+
+/// Attribute the allocations made in the rest of the enclosing block
+/// to the named scope.
+#define ALLOCATION_SCOPE(name)                                          \
+  static const int allocationScopeIndex = AllocationTracker::RegisterScope(name); \
+  AllocationScope allocationScope(allocationScopeIndex)
+
+#else
+
+#define ALLOCATION_SCOPE(name)
+
+#endif
+
+#endif /* _GRAVITY_ALLOC_TRACKER_HH_ */
@@ -0,0 +1,118 @@
+#include "autosave.hh"
+#include "platform.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+Autosaver::Autosaver(const string &filename, JobSystem &jobs) :
+  filename(filename),
+  jobs(jobs),
+  hasPending(false),
+  discardPending(false),
+  running(false),
+  writeCount(0),
+  dropCount(0)
+{
+}
+
+Autosaver::~Autosaver() {
+  // Pending work is still done, so the last snapshot isn't lost.
+  unique_lock<mutex> guard(this->lock);
+  this->idle.wait(guard, [this] { return !this->running; });
+}
+
+void Autosaver::Submit(string &data) {
+  {
+    lock_guard<mutex> guard(this->lock);
+    if (this->hasPending)
+      this->dropCount++;
+
+    this->pending.swap(data);
+    this->hasPending = true;
+    this->discardPending = false;
+  }
+  this->Start();
+}
+
+void Autosaver::Discard() {
+  {
+    lock_guard<mutex> guard(this->lock);
+    this->pending.clear();
+    this->hasPending = false;
+    this->discardPending = true;
+  }
+  this->Start();
+}
+
+void Autosaver::Start() {
+  {
+    lock_guard<mutex> guard(this->lock);
+    if (this->running)
+      return;
+    this->running = true;
+  }
+
+  // Not under the lock, since the job may run right away.
+  this->jobs.RunInBackground([this] { this->Run(); });
+}
+
+int Autosaver::GetWriteCount() {
+  lock_guard<mutex> guard(this->lock);
+  return this->writeCount;
+}
+
+int Autosaver::GetDropCount() {
+  lock_guard<mutex> guard(this->lock);
+  return this->dropCount;
+}
+
+void Autosaver::Run() {
+  string data;
+
+  // Keep going until there's nothing left to do, so whatever gets
+  // submitted while writing is picked up by the same job.
+  while (true) {
+    bool discard;
+    {
+      lock_guard<mutex> guard(this->lock);
+      if (!this->hasPending && !this->discardPending) {
+        this->running = false;
+        this->idle.notify_all();
+        return;
+      }
+
+      discard = this->discardPending;
+      data.swap(this->pending);
+      this->hasPending = false;
+      this->discardPending = false;
+    }
+
+    if (discard)
+      remove(this->filename.data());
+    else
+      this->Write(data);
+
+    data.clear();
+  }
+}
+
+void Autosaver::Write(const string &data) {
+  string tmpFilename = this->filename + ".tmp";
+
+  ofstream output(tmpFilename, ofstream::out | ofstream::binary | ofstream::trunc);
+  output.write(data.data(), data.size());
+  output.close();
+
+  if (!output || !RenameFileOver(tmpFilename, this->filename)) {
+    DEBUG_MSG("Could not write autosave file.");
+    remove(tmpFilename.data());
+    return;
+  }
+
+  lock_guard<mutex> guard(this->lock);
+  this->writeCount++;
+}
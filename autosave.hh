@@ -0,0 +1,62 @@
+#ifndef _GRAVITY_AUTOSAVE_HH_
+#define _GRAVITY_AUTOSAVE_HH_
+
+#include "job-system.hh"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/// Writes game snapshots to disk as background jobs. The snapshot (an
+/// already serialized save) is handed over to the job, so the caller
+/// only pays for serializing into memory. Each write goes to a
+/// temporary file which is then renamed over the autosave file, so a
+/// crash in the middle of a write never leaves a broken autosave.
+///
+/// Only the latest snapshot matters: if a new one is submitted while
+/// the previous one is still waiting to be written, the older one is
+/// dropped.
+class Autosaver {
+protected:
+  string filename;
+  JobSystem &jobs;
+
+  mutex lock;
+  condition_variable idle;
+
+  string pending;
+  bool hasPending;
+  bool discardPending;
+
+  // Whether a job is writing (or about to). There's never more than
+  // one, so writes happen in order.
+  bool running;
+
+  int writeCount;
+  int dropCount;
+
+  void Start();
+  void Run();
+  void Write(const string &data);
+
+public:
+  Autosaver(const string &filename, JobSystem &jobs);
+
+  /// Wait until any pending snapshot is written out.
+  ~Autosaver();
+
+  /// Queue a snapshot for writing. The data is moved from.
+  void Submit(string &data);
+
+  /// Remove the autosave file (and drop any pending snapshot), e.g.
+  /// when the game it belongs to is over.
+  void Discard();
+
+  const string &GetFilename() const { return this->filename; }
+  int GetWriteCount();
+  int GetDropCount();
+};
+
+#endif /* _GRAVITY_AUTOSAVE_HH_ */
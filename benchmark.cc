@@ -0,0 +1,447 @@
+#include "benchmark.hh"
+#include "job-system.hh"
+#include "nbody-solver.hh"
+#include "alloc-tracker.hh"
+#include "entity-pool.hh"
+#include "contact-queue.hh"
+#include "physics-shards.hh"
+#include "systems.hh"
+#include "config.hh"
+
+#include <box2d/box2d.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <vector>
+
+using namespace std;
+
+namespace Benchmark {
+
+// Results go here, so the compiler can't drop the work.
+static volatile float sink;
+
+static double GetTime() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Thread counts to try: powers of two up to the hardware concurrency,
+/// and the hardware concurrency itself.
+static vector<int> GetThreadCounts() {
+  int maxThreads = max(1u, thread::hardware_concurrency());
+  vector<int> counts;
+  for (int n = 1; n < maxThreads; n *= 2)
+    counts.push_back(n);
+  counts.push_back(maxThreads);
+  return counts;
+}
+
+static void EndRun() {
+#ifdef GRAVITY_ALLOC_TRACKING
+  AllocationTracker::EndFrame();
+#endif
+}
+
+/// Cost of creating, running and waiting for empty tasks, and of a
+/// parallel_for that does (almost) nothing.
+static void SchedulingOverhead(ostream &s) {
+  const int TASKS = 100000;
+  const int LOOPS = 10000;
+
+  s << "Scheduling overhead:" << endl
+    << setw(10) << "threads" << setw(16) << "ns/task" << setw(20) << "us/parallel_for" << endl;
+
+  for (int threads : GetThreadCounts()) {
+    JobSystem jobs(threads);
+
+    double start = GetTime();
+    TaskGroup group;
+    for (int i = 0; i < TASKS; ++i)
+      jobs.Run(group, [] {});
+    jobs.Wait(group);
+    double taskTime = (GetTime() - start) / TASKS;
+
+    vector<float> data(1024, 1.0);
+    start = GetTime();
+    for (int i = 0; i < LOOPS; ++i)
+      jobs.ParallelFor(data.size(), 64, [&data](size_t begin, size_t end) {
+          for (size_t j = begin; j < end; ++j)
+            data[j] *= 1.0001;
+        });
+    double loopTime = (GetTime() - start) / LOOPS;
+    sink = data[0];
+
+    s << setw(10) << threads
+      << setw(16) << taskTime * 1e9
+      << setw(20) << loopTime * 1e6 << endl;
+    EndRun();
+  }
+}
+
+/// Speed-up of a gravity-like force pass over a large number of bodies
+/// as threads are added.
+static void Scaling(ostream &s) {
+  const int BODIES = 65536;
+  const int SOURCES = 16;
+  const int REPEAT = 20;
+
+  vector<b2Vec2> positions(BODIES);
+  vector<b2Vec2> forces(BODIES);
+  vector<pair<b2Vec2, float>> sources(SOURCES);
+  for (auto &p : positions)
+    p.Set(rand() % 2000 / 10.0 - 100.0, rand() % 2000 / 10.0 - 100.0);
+  for (auto &source : sources)
+    source = make_pair(b2Vec2(rand() % 200 - 100.0, rand() % 200 - 100.0), 500.0f);
+
+  auto kernel = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      b2Vec2 gravity(0.0, 0.0);
+      for (auto &source : sources) {
+        b2Vec2 n = source.first - positions[i];
+        float r2 = n.LengthSquared() + 0.01f;
+        n.Normalize();
+        gravity += source.second / r2 * n;
+      }
+      forces[i] = gravity;
+    }
+  };
+
+  s << "Scaling (" << BODIES << " bodies, " << SOURCES << " sources):" << endl
+    << setw(10) << "threads" << setw(12) << "ms/pass" << setw(12) << "speed-up" << setw(12) << "steals" << endl;
+
+  double baseTime = 0.0;
+  for (int threads : GetThreadCounts()) {
+    JobSystem jobs(threads);
+
+    double start = GetTime();
+    for (int i = 0; i < REPEAT; ++i)
+      jobs.ParallelFor(BODIES, 256, kernel);
+    double time = (GetTime() - start) / REPEAT;
+    if (threads == 1)
+      baseTime = time;
+    sink = forces[0].x;
+
+    s << setw(10) << threads
+      << setw(12) << time * 1e3
+      << setw(12) << baseTime / time
+      << setw(12) << jobs.GetStealCount() << endl;
+    EndRun();
+  }
+}
+
+/// Mutual gravity: pairwise interactions per second, on one thread and
+/// on all of them.
+static void NBody(ostream &s) {
+  const int SIZES[] = { 10, 100, 1000, 10000, 20000, 50000 };
+  const double MIN_TIME = 0.25;
+
+  int maxThreads = max(1u, thread::hardware_concurrency());
+  vector<int> threadCounts = { 1 };
+  if (maxThreads > 1)
+    threadCounts.push_back(maxThreads);
+
+  s << "Mutual gravity:" << endl
+    << setw(10) << "bodies" << setw(10) << "threads"
+    << setw(14) << "ms/solve" << setw(20) << "interactions/s" << endl;
+
+  for (int threads : threadCounts) {
+    JobSystem jobs(threads);
+
+    for (int n : SIZES) {
+      NBodySolver solver;
+      for (int i = 0; i < n; ++i)
+        solver.Add(b2Vec2(rand() % 20000 / 100.0 - 100.0, rand() % 20000 / 100.0 - 100.0),
+                   1.0 + rand() % 100 / 10.0);
+
+      // Repeat small problems until the time is measurable.
+      int solves = 0;
+      double start = GetTime();
+      double time;
+      do {
+        solver.Solve(0.1, 0.5, jobs);
+        solves++;
+        time = GetTime() - start;
+      } while (time < MIN_TIME);
+      sink = solver.GetForce(0).x;
+
+      s << setw(10) << n << setw(10) << threads
+        << setw(14) << time / solves * 1e3
+        << setw(20) << setprecision(0) << solver.GetInteractionCount() * solves / time
+        << setprecision(2) << endl;
+      EndRun();
+    }
+  }
+}
+
+const int PLANETS = 200;
+const int COLLECTIBLES = 100;
+const int ENEMIES = 100;
+
+// Spawned every frame, replacing the oldest ones.
+const int COLLECTIBLE_SPAWNS = 2;
+const int ENEMY_SPAWNS = 2;
+
+const float SUN_GRAVITY = 130000.0;
+const float MAX_DISTANCE = Config::CameraMaxWidth / 2 - 10.0;
+
+struct SimulationOptions {
+  int threads;
+  int shards;
+
+  /// Whether collectibles are static sensors, as made by the factory,
+  /// or solid dynamic bodies, as they used to be.
+  bool sensorCollectibles;
+
+  /// Whether enemy ships move without a body until they near a target.
+  bool ballisticEnemies;
+};
+
+/// Per frame averages, except for the worst case.
+struct SimulationResult {
+  double frameTime;
+  double allocations;
+  uint64_t worstAllocations;
+  double events;
+  double proxies;
+  double pairs;
+  double touching;
+  double islands;
+};
+
+/// The entities spawned of one kind, oldest first, in a ring buffer so
+/// that spawning doesn't allocate.
+struct SpawnRing {
+  vector<EntityHandle> handles;
+  size_t next;
+
+  SpawnRing(size_t capacity) : handles(capacity), next(0) {}
+
+  /// Add a new entity, destroying the oldest one if the ring is full.
+  void Add(EntityPool &entities, Entity *e) {
+    Entity *oldest = entities.Get(this->handles[this->next]);
+    if (oldest) {
+      if (oldest->body)
+        oldest->body->GetWorld()->DestroyBody(oldest->body);
+      entities.Destroy(oldest);
+    }
+
+    this->handles[this->next] = e->handle;
+    this->next = (this->next + 1) % this->handles.size();
+  }
+};
+
+static b2Vec2 RandomPosition() {
+  return b2Vec2(rand() % 2000 / 2000.0 * 2 * MAX_DISTANCE - MAX_DISTANCE,
+                rand() % 2000 / 2000.0 * 2 * MAX_DISTANCE - MAX_DISTANCE);
+}
+
+static Entity *SpawnCollectible(EntityPool &entities, b2World *world, const SimulationOptions &options) {
+  Entity *e = Entity::CreateCollectible(&entities, world, RandomPosition(), CollectibleType::PLUS_SCORE);
+  if (!options.sensorCollectibles) {
+    e->body->SetType(b2_dynamicBody);
+    e->body->GetFixtureList()->SetSensor(false);
+  }
+
+  return e;
+}
+
+/// An enemy ship at the edge of the world, heading for the sun.
+static Entity *SpawnEnemy(EntityPool &entities, b2World *world, const SimulationOptions &options) {
+  float angle = rand() % 3600 / 1800.0 * M_PI;
+  b2Vec2 dir(cos(angle), sin(angle));
+  return Entity::CreateEnemyShip(&entities, world, MAX_DISTANCE * dir, -20.0 * dir,
+                                 angle + M_PI / 2.0, options.ballisticEnemies);
+}
+
+/// Fill a world with a sun and planets orbiting it, using the game's
+/// own factories.
+static void CreateScene(EntityPool &entities, b2World *world) {
+  Entity::CreateSun(&entities, world, b2Vec2(0.0, 0.0), 6.0, 1000.0, SUN_GRAVITY);
+
+  // Planets on (roughly) circular orbits, so that they stay around.
+  for (int i = 0; i < PLANETS; ++i) {
+    float angle = rand() % 3600 / 1800.0 * M_PI;
+    float distance = 15.0 + rand() % 1000 / 1000.0 * (MAX_DISTANCE - 15.0);
+    b2Vec2 dir(cos(angle), sin(angle));
+    Entity *e = Entity::CreatePlanet(&entities, world, distance * dir, 1.0 + rand() % 10 / 10.0, 1.0);
+    float speed = sqrt(SUN_GRAVITY / (e->body->GetMass() * distance));
+    e->body->SetLinearVelocity(speed * b2Vec2(-dir.y, dir.x));
+  }
+}
+
+/// Run a game-like scene without a window, with the same systems as
+/// GameScreen::Advance: gravity, ballistic enemies, the world step
+/// (over the physics shards), the contact queue and the trails.
+/// Collectibles and enemies are spawned every frame.
+static SimulationResult RunSimulation(const SimulationOptions &options) {
+  const int WARMUP_FRAMES = 120;
+  const int FRAMES = 600;
+  const int STEPS_PER_FRAME = max(1, (int) (1.0 / 60.0 / Config::PhysicsTimeStep + 0.5));
+
+  JobSystem jobs(options.threads);
+  JobSystem::SetGlobal(&jobs);
+
+  srand(1);
+  b2World world(b2Vec2(0.0, 0.0));
+  EntityPool entities;
+  ContactQueue contactQueue(256);
+  ContactListener contactListener(&contactQueue, &entities);
+  world.SetContactListener(&contactListener);
+  PhysicsShards shards(world, entities, contactQueue, contactListener, options.shards,
+                       -Config::CameraMaxWidth / 2, Config::CameraMaxWidth / 2);
+  CreateScene(entities, &world);
+
+  SpawnRing collectibles(COLLECTIBLES);
+  SpawnRing enemies(ENEMIES);
+  vector<GravitySourceState> sources;
+  vector<b2AABB> targets;
+  vector<EntityHandle> promoted;
+  float time = 0.0;
+  uint64_t events = 0;
+
+  auto frame = [&]() {
+    for (int i = 0; i < COLLECTIBLE_SPAWNS; ++i)
+      collectibles.Add(entities, SpawnCollectible(entities, &world, options));
+    for (int i = 0; i < ENEMY_SPAWNS; ++i)
+      enemies.Add(entities, SpawnEnemy(entities, &world, options));
+
+    for (int i = 0; i < STEPS_PER_FRAME; ++i) {
+      Systems::ApplyGravity(entities, sources);
+      Systems::AdvanceBallistic(entities, &world, Config::PhysicsTimeStep, targets, promoted);
+      shards.Step(Config::PhysicsTimeStep, 10, 10);
+      Systems::SyncTransforms(entities);
+      time += Config::PhysicsTimeStep;
+
+      // The game logic for the contacts isn't run, so that the scene
+      // stays the same.
+      events += contactQueue.GetSize();
+      contactQueue.Clear();
+
+      Systems::UpdateTrails(entities, time);
+    }
+  };
+
+  for (int i = 0; i < WARMUP_FRAMES; ++i)
+    frame();
+  events = 0;
+
+  SimulationResult result = SimulationResult();
+  uint64_t allocations = 0;
+  double frameTime = 0.0;
+  for (int i = 0; i < FRAMES; ++i) {
+#ifdef GRAVITY_ALLOC_TRACKING
+    uint64_t count = AllocationTracker::GetTotalCount();
+#endif
+    double start = GetTime();
+    frame();
+    frameTime += GetTime() - start;
+#ifdef GRAVITY_ALLOC_TRACKING
+    count = AllocationTracker::GetTotalCount() - count;
+    allocations += count;
+    result.worstAllocations = max(result.worstAllocations, count);
+#endif
+
+    // Counted outside the timed part; counting the islands allocates.
+    result.proxies += shards.GetProxyCount();
+    result.pairs += shards.GetContactCount();
+    result.islands += shards.GetIslandCount();
+    for (int j = 0; j < shards.GetShardCount(); ++j)
+      for (b2Contact *c = shards.GetWorld(j)->GetContactList(); c; c = c->GetNext())
+        if (c->IsTouching())
+          result.touching++;
+  }
+
+  result.frameTime = frameTime / FRAMES;
+  result.allocations = (double) allocations / FRAMES;
+  result.events = (double) events / FRAMES;
+  result.proxies /= FRAMES;
+  result.pairs /= FRAMES;
+  result.touching /= FRAMES;
+  result.islands /= FRAMES;
+
+  shards.Clear();
+  JobSystem::SetGlobal(nullptr);
+  return result;
+}
+
+/// The game-like scene with the current settings on one and all
+/// threads, and on one and several shards, then with the old and new
+/// ways of making collectibles and enemies. Allocations should be zero
+/// once the scene has warmed up. Pairs are the contacts in the
+/// broad-phase pair list, touching ones included.
+static void Simulation(ostream &s) {
+  int maxThreads = max(1u, thread::hardware_concurrency());
+  vector<int> threadCounts = { 1 };
+  if (maxThreads > 1)
+    threadCounts.push_back(maxThreads);
+
+  Entity::presentationEnabled = false;
+
+  s << "Simulation (" << PLANETS << " planets, " << COLLECTIBLES << " collectibles, "
+    << ENEMIES << " enemies, " << COLLECTIBLE_SPAWNS << " + " << ENEMY_SPAWNS << " spawns/frame):" << endl
+    << setw(10) << "threads" << setw(10) << "shards" << setw(12) << "ms/frame"
+    << setw(14) << "alloc/frame" << setw(12) << "worst" << setw(12) << "events" << endl;
+#ifndef GRAVITY_ALLOC_TRACKING
+  s << "(allocations are only counted when built with --alloc-tracking)" << endl;
+#endif
+
+  for (int threads : threadCounts)
+    for (int shardCount : { 1, 4 }) {
+      SimulationOptions options = { threads, shardCount, true, Config::BallisticEnemies };
+      SimulationResult r = RunSimulation(options);
+      s << setw(10) << threads << setw(10) << shardCount
+        << setw(12) << r.frameTime * 1e3
+        << setw(14) << r.allocations
+        << setw(12) << r.worstAllocations
+        << setw(12) << r.events << endl;
+      EndRun();
+    }
+
+  s << endl << "Collision load (" << maxThreads << " threads, 1 shard):" << endl
+    << setw(14) << "collectibles" << setw(12) << "enemies" << setw(12) << "ms/frame"
+    << setw(10) << "proxies" << setw(10) << "pairs" << setw(10) << "touching"
+    << setw(10) << "islands" << endl;
+
+  for (bool sensorCollectibles : { false, true })
+    for (bool ballisticEnemies : { false, true }) {
+      SimulationOptions options = { maxThreads, 1, sensorCollectibles, ballisticEnemies };
+      SimulationResult r = RunSimulation(options);
+      s << setw(14) << (sensorCollectibles ? "sensor" : "dynamic")
+        << setw(12) << (ballisticEnemies ? "ballistic" : "bodies")
+        << setw(12) << r.frameTime * 1e3
+        << setw(10) << r.proxies
+        << setw(10) << r.pairs
+        << setw(10) << r.touching
+        << setw(10) << r.islands << endl;
+      EndRun();
+    }
+
+  Entity::presentationEnabled = true;
+}
+
+int Run(ostream &s) {
+  s << fixed << setprecision(2);
+  s << "Hardware threads: " << thread::hardware_concurrency() << endl << endl;
+
+  SchedulingOverhead(s);
+  s << endl;
+  Scaling(s);
+  s << endl;
+  NBody(s);
+  s << endl;
+  Simulation(s);
+
+#ifdef GRAVITY_ALLOC_TRACKING
+  if (AllocationTracker::IsEnabled()) {
+    s << endl;
+    AllocationTracker::WriteReport(s);
+  }
+#endif
+
+  return 0;
+}
+
+} // namespace Benchmark
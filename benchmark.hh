@@ -0,0 +1,19 @@
+#ifndef _GRAVITY_BENCHMARK_HH_
+#define _GRAVITY_BENCHMARK_HH_
+
+#include <ostream>
+
+using namespace std;
+
+/// Micro-benchmarks, run instead of the game with the --benchmark
+/// command line option. They don't need a window or any resources, so
+/// they can be run headless.
+namespace Benchmark {
+
+/// Run all the benchmarks, writing the results to 's'. Returns the
+/// exit code for the program.
+extern int Run(ostream &s);
+
+} // namespace Benchmark
+
+#endif /* _GRAVITY_BENCHMARK_HH_ */
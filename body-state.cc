@@ -0,0 +1,268 @@
+#include "body-state.hh"
+#include "save-file.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+BodyState::BodyState() :
+  exists(false),
+  type(b2_staticBody),
+  pos(0.0, 0.0),
+  angle(0.0),
+  linearVelocity(0.0, 0.0),
+  angularVelocity(0.0),
+  angularDamping(0.0),
+  awake(true),
+  firstFixture(0),
+  fixtureCount(0)
+{
+}
+
+void BodyState::Capture(const b2Body *body, vector<FixtureState> &fixtures) {
+  this->firstFixture = fixtures.size();
+  this->fixtureCount = 0;
+  this->exists = body != nullptr;
+  if (!body)
+    return;
+
+  this->type = body->GetType();
+  this->pos = body->GetPosition();
+  this->angle = body->GetAngle();
+  this->linearVelocity = body->GetLinearVelocity();
+  this->angularVelocity = body->GetAngularVelocity();
+  this->angularDamping = body->GetAngularDamping();
+  this->awake = body->IsAwake();
+
+  for (auto f = body->GetFixtureList(); f; f = f->GetNext()) {
+    FixtureState fs;
+    fs.friction = f->GetFriction();
+    fs.density = f->GetDensity();
+    fs.restitution = f->GetRestitution();
+    fs.categoryBits = f->GetFilterData().categoryBits;
+    fs.maskBits = f->GetFilterData().maskBits;
+    fs.isSensor = f->IsSensor();
+
+    const b2Shape *shape = f->GetShape();
+    fs.shapeType = shape->GetType();
+    switch (shape->GetType()) {
+    case b2Shape::e_circle: {
+      const b2CircleShape *circle = (const b2CircleShape*) shape;
+      fs.center = circle->m_p;
+      fs.radius = circle->m_radius;
+      break;
+    }
+
+    case b2Shape::e_polygon: {
+      const b2PolygonShape *polygon = (const b2PolygonShape*) shape;
+      fs.vertexCount = polygon->m_count;
+      for (int i = 0; i < polygon->m_count; ++i)
+        fs.vertices[i] = polygon->m_vertices[i];
+      break;
+    }
+
+    default:
+      throw runtime_error("Only circle and polygon shapes are currently supported.");
+    }
+
+    fixtures.push_back(fs);
+    this->fixtureCount++;
+  }
+}
+
+void BodyState::Write(SaveFileWriter &w, const vector<FixtureState> &fixtures) const {
+  w.Write((uint8_t) (this->exists ? 1 : 0));
+  if (!this->exists)
+    return;
+
+  w.Write((int32_t) this->type);
+  w.Write(this->pos);
+  w.Write(this->angle);
+  w.Write(this->linearVelocity);
+  w.Write(this->angularVelocity);
+  w.Write(this->angularDamping);
+  w.Write((int32_t) this->fixtureCount);
+
+  for (uint32_t i = 0; i < this->fixtureCount; ++i) {
+    const FixtureState &fs = fixtures[this->firstFixture + i];
+    w.Write(fs.friction);
+    w.Write(fs.density);
+    w.Write(fs.restitution);
+    w.Write(fs.categoryBits);
+    w.Write(fs.maskBits);
+    w.Write((uint8_t) fs.isSensor);
+
+    w.Write((int32_t) fs.shapeType);
+    if (fs.shapeType == b2Shape::e_circle) {
+      w.Write(fs.center);
+      w.Write(fs.radius);
+    }
+    else {
+      w.Write(fs.vertexCount);
+      w.WriteBlock(fs.vertices, fs.vertexCount * sizeof(b2Vec2));
+    }
+  }
+}
+
+static bool IsValid(const b2Vec2 &v) {
+  return b2IsValid(v.x) && b2IsValid(v.y);
+}
+
+/// Whether b2PolygonShape::Set keeps the given vertices as they are.
+/// It welds vertices that are too close, drops the ones inside the
+/// hull or in the middle of an edge, and asserts if fewer than three
+/// are left or the area is (nearly) zero. So the vertices must be far
+/// apart, and make a strictly convex polygon in counter-clockwise
+/// order, which is what Capture gets from Box2D.
+static bool IsValidPolygon(const b2Vec2 *vertices, int count) {
+  float minDistance = 0.5 * b2_linearSlop;
+  for (int i = 0; i < count; ++i)
+    for (int j = i + 1; j < count; ++j)
+      if (b2DistanceSquared(vertices[i], vertices[j]) < minDistance * minDistance)
+        return false;
+
+  // Every other vertex is strictly to the left of every edge.
+  for (int i = 0; i < count; ++i) {
+    b2Vec2 a = vertices[i];
+    b2Vec2 edge = vertices[(i + 1) % count] - a;
+    for (int j = 0; j < count; ++j)
+      if (j != i && j != (i + 1) % count && b2Cross(edge, vertices[j] - a) <= 0.0)
+        return false;
+  }
+
+  float area = 0.0;
+  for (int i = 1; i + 1 < count; ++i)
+    area += 0.5 * b2Cross(vertices[i] - vertices[0], vertices[i + 1] - vertices[0]);
+
+  return area > b2_epsilon;
+}
+
+void BodyState::Read(SaveFileReader &r, vector<FixtureState> &fixtures) {
+  *this = BodyState();
+  this->firstFixture = fixtures.size();
+
+  uint8_t bodyExists;
+  r.Read(bodyExists);
+  this->exists = bodyExists;
+  if (!bodyExists)
+    return;
+
+  int32_t type;
+  r.Read(type);
+  r.Read(this->pos);
+  r.Read(this->angle);
+  r.Read(this->linearVelocity);
+  r.Read(this->angularVelocity);
+  r.Read(this->angularDamping);
+  if (type != b2_staticBody && type != b2_kinematicBody && type != b2_dynamicBody)
+    throw runtime_error("Invalid body type in save file.");
+  if (!IsValid(this->pos) || !b2IsValid(this->angle) ||
+      !IsValid(this->linearVelocity) || !b2IsValid(this->angularVelocity) ||
+      !b2IsValid(this->angularDamping) || this->angularDamping < 0.0)
+    throw runtime_error("Invalid body in save file.");
+  this->type = (b2BodyType) type;
+
+  int32_t fixtureCount;
+  r.Read(fixtureCount);
+  if (fixtureCount < 0)
+    throw runtime_error("Invalid fixture count in save file.");
+
+  // Each fixture takes some room, so running out of data ends this
+  // even if the count is huge.
+  for (int i = 0; i < fixtureCount; ++i) {
+    FixtureState fs;
+    uint8_t isSensor;
+    r.Read(fs.friction);
+    r.Read(fs.density);
+    r.Read(fs.restitution);
+    r.Read(fs.categoryBits);
+    r.Read(fs.maskBits);
+    r.Read(isSensor);
+    fs.isSensor = isSensor;
+    if (!b2IsValid(fs.friction) || !b2IsValid(fs.density) || !b2IsValid(fs.restitution) ||
+        fs.density < 0.0)
+      throw runtime_error("Invalid fixture in save file.");
+
+    int32_t shapeType;
+    r.Read(shapeType);
+    if (shapeType == b2Shape::e_circle) {
+      r.Read(fs.center);
+      r.Read(fs.radius);
+      if (!IsValid(fs.center) || !b2IsValid(fs.radius) || fs.radius <= 0.0)
+        throw runtime_error("Invalid circle in save file.");
+    }
+    else if (shapeType == b2Shape::e_polygon) {
+      r.Read(fs.vertexCount);
+      if (fs.vertexCount < 3 || fs.vertexCount > b2_maxPolygonVertices)
+        throw runtime_error("Invalid polygon in save file.");
+
+      r.ReadBlock(fs.vertices, fs.vertexCount * sizeof(b2Vec2));
+      for (int j = 0; j < fs.vertexCount; ++j)
+        if (!IsValid(fs.vertices[j]))
+          throw runtime_error("Invalid polygon in save file.");
+      if (!IsValidPolygon(fs.vertices, fs.vertexCount))
+        throw runtime_error("Invalid polygon in save file.");
+    }
+    else
+      throw runtime_error("Invalid shape type in save file.");
+    fs.shapeType = (b2Shape::Type) shapeType;
+
+    fixtures.push_back(fs);
+    this->fixtureCount++;
+  }
+}
+
+b2Body *BodyState::Create(b2World *world, const vector<FixtureState> &fixtures, EntityHandle handle) const {
+  if (!this->exists)
+    return nullptr;
+
+  b2BodyDef bd;
+  bd.type = this->type;
+  bd.position = this->pos;
+  bd.angle = this->angle;
+  bd.linearVelocity = this->linearVelocity;
+  bd.angularVelocity = this->angularVelocity;
+  bd.angularDamping = this->angularDamping;
+  bd.awake = this->awake;
+  bd.userData.pointer = handle.value;
+  b2Body *body = world->CreateBody(&bd);
+
+  for (uint32_t i = 0; i < this->fixtureCount; ++i) {
+    const FixtureState &fs = fixtures[this->firstFixture + i];
+    b2FixtureDef fd;
+    fd.friction = fs.friction;
+    fd.density = fs.density;
+    fd.restitution = fs.restitution;
+    fd.filter.categoryBits = fs.categoryBits;
+    fd.filter.maskBits = fs.maskBits;
+    fd.isSensor = fs.isSensor;
+
+    b2CircleShape circle;
+    b2PolygonShape polygon;
+    if (fs.shapeType == b2Shape::e_circle) {
+      circle.m_p = fs.center;
+      circle.m_radius = fs.radius;
+      fd.shape = &circle;
+    }
+    else {
+      polygon.Set(fs.vertices, fs.vertexCount);
+      fd.shape = &polygon;
+
+      // Read checked that the vertices are their own hull, but Set
+      // starts the hull from the rightmost vertex, which needn't be the
+      // first one saved (SetAsBox starts elsewhere). Go back to the
+      // saved order, so that saving again gives the same vertices.
+      for (int k = 1; k < polygon.m_count; ++k)
+        if (polygon.m_vertices[k] == fs.vertices[0]) {
+          rotate(polygon.m_vertices, polygon.m_vertices + k, polygon.m_vertices + polygon.m_count);
+          rotate(polygon.m_normals, polygon.m_normals + k, polygon.m_normals + polygon.m_count);
+          break;
+        }
+    }
+
+    body->CreateFixture(&fd);
+  }
+
+  return body;
+}
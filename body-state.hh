@@ -0,0 +1,75 @@
+#ifndef _GRAVITY_BODY_STATE_HH_
+#define _GRAVITY_BODY_STATE_HH_
+
+#include "entity.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class SaveFileWriter;
+class SaveFileReader;
+
+/// Everything needed to re-create a fixture. Only circles and polygons
+/// are supported.
+struct FixtureState {
+  float friction;
+  float density;
+  float restitution;
+  uint16 categoryBits;
+  uint16 maskBits;
+  bool isSensor;
+  b2Shape::Type shapeType;
+
+  // circle
+  b2Vec2 center;
+  float radius;
+
+  // polygon
+  int32 vertexCount;
+  b2Vec2 vertices[b2_maxPolygonVertices];
+};
+
+/// A plain copy of a physics body, which outlives the body and can be
+/// turned back into one. The fixtures are kept in a separate array, so
+/// that many bodies can share one and be captured without allocating
+/// once it has grown large enough.
+struct BodyState {
+  BodyState();
+
+  /// False for entities without a body.
+  bool exists;
+
+  b2BodyType type;
+  b2Vec2 pos;
+  float angle;
+  b2Vec2 linearVelocity;
+  float angularVelocity;
+  float angularDamping;
+  bool awake;
+
+  /// Where the body's fixtures are in the fixture array.
+  uint32_t firstFixture;
+  uint32_t fixtureCount;
+
+  /// Copy the given body (which may be null), appending its fixtures
+  /// to 'fixtures'.
+  void Capture(const b2Body *body, vector<FixtureState> &fixtures);
+
+  /// Write the body in the save file format.
+  void Write(SaveFileWriter &w, const vector<FixtureState> &fixtures) const;
+
+  /// Read a body written by Write, appending its fixtures to
+  /// 'fixtures'. Everything is checked, so that the body can be
+  /// created later without surprises; errors throw runtime_error.
+  void Read(SaveFileReader &r, vector<FixtureState> &fixtures);
+
+  /// Create the body in the given world, with the given entity handle
+  /// in its user data. Returns nullptr if there is no body.
+  b2Body *Create(b2World *world, const vector<FixtureState> &fixtures, EntityHandle handle) const;
+};
+
+#endif /* _GRAVITY_BODY_STATE_HH_ */
@@ -0,0 +1,108 @@
+#include "camera-controller.hh"
+#include "config.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/// Move 'current' towards 'target' like a critically damped spring
+/// reaching it in about 'smoothTime' seconds, updating 'velocity'.
+/// Uses an approximation of exp() which is stable for any dt.
+static float SmoothDamp(float current, float target, float &velocity,
+                        float smoothTime, float dt)
+{
+  float omega = 2.0 / smoothTime;
+  float x = omega * dt;
+  float decay = 1.0 / (1.0 + x + 0.48 * x * x + 0.235 * x * x * x);
+  float change = current - target;
+  float temp = (velocity + omega * change) * dt;
+  velocity = (velocity - omega * temp) * decay;
+  return target + (change + temp) * decay;
+}
+
+/// Limit the width of a view with the given aspect ratio to the
+/// configured camera sizes. Like the sizes, the height limits win.
+static float ClampWidth(float width, float ratio) {
+  width = min(max(width, Config::CameraMinWidth), Config::CameraMaxWidth);
+  if (width / ratio > Config::CameraMaxHeight)
+    width = Config::CameraMaxHeight * ratio;
+  if (width / ratio < Config::CameraMinHeight)
+    width = Config::CameraMinHeight * ratio;
+  return width;
+}
+
+CameraController::CameraController() :
+  hasBounds(false),
+  width(0.0),
+  widthVelocity(0.0),
+  snap(true)
+{
+}
+
+void CameraController::Snap() {
+  this->snap = true;
+}
+
+bool CameraController::IsMoving() const {
+  return fabs(this->widthVelocity) > 0.01;
+}
+
+void CameraController::Track(const b2Vec2 &pos, const b2Vec2 &velocity, float radius) {
+  float r = radius + Config::CameraMargin;
+  b2Vec2 ahead = pos + Config::CameraLookahead * velocity;
+
+  b2Vec2 lower(min(pos.x, ahead.x) - r, min(pos.y, ahead.y) - r);
+  b2Vec2 upper(max(pos.x, ahead.x) + r, max(pos.y, ahead.y) + r);
+
+  if (!this->hasBounds) {
+    this->bounds.lowerBound = lower;
+    this->bounds.upperBound = upper;
+    this->hasBounds = true;
+  }
+  else {
+    this->bounds.lowerBound = b2Min(this->bounds.lowerBound, lower);
+    this->bounds.upperBound = b2Max(this->bounds.upperBound, upper);
+  }
+}
+
+void CameraController::Update(float dt, int winw, int winh, Camera &camera) {
+  float ratio = ((float) winw) / winh;
+
+  // The view is centered on the origin, so it has to be as large as
+  // twice the furthest edge of the bounding box in each direction.
+  float width = Config::CameraMinWidth;
+  float height = Config::CameraMinHeight;
+  if (this->hasBounds) {
+    width = 2 * max(fabs(this->bounds.lowerBound.x), fabs(this->bounds.upperBound.x));
+    height = 2 * max(fabs(this->bounds.lowerBound.y), fabs(this->bounds.upperBound.y));
+  }
+
+  if (width / ratio < height)
+    width = height * ratio;
+  width = ClampWidth(width, ratio);
+
+  if (this->snap) {
+    this->width = width;
+    this->widthVelocity = 0.0;
+    this->snap = false;
+  }
+  else if (dt > 0.0) {
+    this->width = SmoothDamp(this->width, width, this->widthVelocity,
+                             Config::CameraSmoothTime, dt);
+  }
+
+  height = this->width / ratio;
+  camera.pos.x = - (this->width / 2.0);
+  camera.pos.y = - (height / 2.0);
+  camera.ppm = winw / this->width;
+
+  this->hasBounds = false;
+}
+
+void CameraController::GetMaxSize(int winw, int winh, float &width, float &height) {
+  float ratio = ((float) winw) / winh;
+
+  width = ClampWidth(Config::CameraMaxWidth, ratio);
+  height = width / ratio;
+}
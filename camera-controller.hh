@@ -0,0 +1,48 @@
+#ifndef _GRAVITY_CAMERA_CONTROLLER_HH_
+#define _GRAVITY_CAMERA_CONTROLLER_HH_
+
+#include "camera.hh"
+
+#include <box2d/box2d.h>
+
+/// Frames the tracked entities with a camera centered on the origin.
+///
+/// Every frame, the entities to keep in view are passed to Track,
+/// which grows a bounding box around them (and around where they will
+/// be shortly, so the camera starts zooming out before they leave the
+/// screen). Update then eases the camera towards the view fitting that
+/// box with a critically damped spring, so the zoom (and the trail
+/// density that depends on it) changes smoothly instead of jumping.
+class CameraController {
+protected:
+  b2AABB bounds;
+  bool hasBounds;
+
+  float width;
+  float widthVelocity;
+  bool snap;
+
+public:
+  CameraController();
+
+  /// Make the next update jump to the target view instead of easing
+  /// into it. Used after the world has been replaced.
+  void Snap();
+
+  /// Return true if the camera is still easing towards its target.
+  bool IsMoving() const;
+
+  /// Keep a circle with the given radius, at the given position and
+  /// moving at the given velocity, in view.
+  void Track(const b2Vec2 &pos, const b2Vec2 &velocity, float radius);
+
+  /// Move the camera towards the view fitting everything tracked since
+  /// the last update, and start over with an empty bounding box.
+  void Update(float dt, int winw, int winh, Camera &camera);
+
+  /// Return the size of the largest view the camera can have in a
+  /// window of the given size.
+  static void GetMaxSize(int winw, int winh, float &width, float &height);
+};
+
+#endif /* _GRAVITY_CAMERA_CONTROLLER_HH_ */
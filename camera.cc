@@ -1,4 +1,5 @@
 #include "camera.hh"
+#include "view-state.hh"
 
 Camera::Camera() :
   pos(0.0, 0.0),
@@ -6,23 +7,18 @@ Camera::Camera() :
 {
 }
 
-void Camera::PointToScreen(SDL_Window *window, b2Vec2 p, int &x, int &y) const {
+void Camera::PointToScreen(b2Vec2 p, int &x, int &y) const {
   x = (p.x - this->pos.x) * this->ppm;
   y = (p.y - this->pos.y) * this->ppm;
-
-  int w, h;
-  SDL_GetWindowSize(window, &w, &h);
-  y = h - y;
+  y = ViewState::GetWindowHeight() - y;
 }
 
 float Camera::LengthToScreen(float length) const {
   return length * this->ppm;
 }
 
-b2Vec2 Camera::PointToWorld(int x, int y, SDL_Window *window) const {
-  int w, h;
-  SDL_GetWindowSize(window, &w, &h);
-  y = h - y;
+b2Vec2 Camera::PointToWorld(int x, int y) const {
+  y = ViewState::GetWindowHeight() - y;
 
   b2Vec2 p(x / ppm, y / ppm);
   p += b2Vec2(this->pos.x, this->pos.y);
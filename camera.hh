@@ -16,14 +16,14 @@ struct Camera {
   /// Convert the given point in world coordinates to screen
   /// coordinate seen in this camera. The `x` and `y` parameters will
   /// hold the converted coordinates upon return.
-  void PointToScreen(SDL_Window *window, b2Vec2 p, int &x, int &y) const;
+  void PointToScreen(b2Vec2 p, int &x, int &y) const;
 
   /// Convert the given length in world units to pixels seen by this
   /// camera.
   float LengthToScreen(float length) const;
 
   /// Convert the given point (x, y) on screen to world coordinates.
-  b2Vec2 PointToWorld(int x, int y, SDL_Window *window) const;
+  b2Vec2 PointToWorld(int x, int y) const;
 
   /// Convert the given length in pixels to world units.
   float LengthToWorld(float length) const;
@@ -0,0 +1,293 @@
+#ifndef _GRAVITY_COMPONENTS_HH_
+#define _GRAVITY_COMPONENTS_HH_
+
+#include "entity.hh"
+#include "mesh.hh"
+
+#include <box2d/box2d.h>
+
+#include <vector>
+
+using namespace std;
+
+/// Position and orientation of an entity, copied from its physics body
+/// after each physics step so that systems can read them from a dense
+/// array.
+struct Transform {
+  Transform() :
+    body(nullptr),
+    pos(0.0, 0.0),
+    angle(0.0)
+  {}
+
+  /// The body the transform is synced from.
+  b2Body *body;
+
+  b2Vec2 pos;
+  float angle;
+};
+
+/// An entity that attracts gravity receivers.
+struct GravitySource {
+  GravitySource() :
+    coeff(0.0)
+  {}
+
+  float coeff;
+};
+
+/// An entity that is attracted by gravity sources.
+struct GravityReceiver {
+  GravityReceiver() :
+    force(0.0, 0.0)
+  {}
+
+  /// The gravitational force applied in the last physics step.
+  b2Vec2 force;
+};
+
+struct TrailPoint {
+  TrailPoint() :
+    time(0.0)
+  {}
+
+  TrailPoint(b2Vec2 pos, float time) :
+    pos(pos),
+    time(time)
+  {}
+
+  b2Vec2 pos;
+  float time;
+};
+
+struct Trail {
+  Trail() :
+    size(0),
+    time(0.0)
+  {
+    this->bounds.lowerBound.SetZero();
+    this->bounds.upperBound.SetZero();
+  }
+
+  int size;
+  float time;
+  vector<TrailPoint> points;
+
+  /// Bounding box of the points, used for culling. Kept up to date by
+  /// Systems::UpdateTrails; call ComputeBounds after changing the
+  /// points any other way.
+  b2AABB bounds;
+
+  void ComputeBounds() {
+    if (this->points.empty()) {
+      this->bounds.lowerBound.SetZero();
+      this->bounds.upperBound.SetZero();
+      return;
+    }
+
+    this->bounds.lowerBound = this->bounds.upperBound = this->points[0].pos;
+    for (auto &p : this->points) {
+      this->bounds.lowerBound = b2Min(this->bounds.lowerBound, p.pos);
+      this->bounds.upperBound = b2Max(this->bounds.upperBound, p.pos);
+    }
+  }
+};
+
+struct Sprite {
+  Sprite() :
+    mesh(nullptr)
+  {}
+
+  Mesh *mesh;
+};
+
+/// What a collectible gives when collected.
+struct CollectiblePayload {
+  CollectiblePayload() :
+    type(CollectibleType::PLUS_SCORE),
+    score(0),
+    time(0),
+    spawnPlanet(false)
+  {}
+
+  CollectibleType type;
+  int score;
+  int time;
+  bool spawnPlanet;
+};
+
+/// What happens to an entity that leaves the world bounds or reaches
+/// its maximum age.
+enum class ExpiryPolicy : uint8_t {
+  /// Silently removed.
+  DESPAWN,
+
+  /// Removed, costing the player a life. Only leaves once neither the
+  /// entity nor its trail can be seen.
+  LOSE_LIFE,
+
+  /// Like DESPAWN, but fades out before reaching its maximum age.
+  FADE_OUT,
+};
+
+struct Lifetime {
+  Lifetime() :
+    policy(ExpiryPolicy::DESPAWN),
+    age(0.0),
+    maxAge(0.0)
+  {}
+
+  ExpiryPolicy policy;
+  float age;
+
+  /// The age at which the entity expires. Zero means never.
+  float maxAge;
+};
+
+/// State of the orbital integrator for a gravity receiver. The
+/// velocity is the integrator's own; the body is given the average
+/// velocity over the step so that Box2D moves it to the integrated
+/// position.
+struct Orbit {
+  Orbit() :
+    velocity(0.0, 0.0),
+    expectedPos(0.0, 0.0)
+  {}
+
+  b2Vec2 velocity;
+
+  /// Where the body should be after the physics step, unless
+  /// something (like a collision) interfered.
+  b2Vec2 expectedPos;
+};
+
+/// An entity moving in a straight line at a constant velocity, without
+/// a physics body. Its transform is advanced directly, which costs
+/// next to nothing compared to a body in the broad-phase and the
+/// solver. The entity gets a body (and loses this component) once it
+/// comes close enough to something it could collide with.
+struct Ballistic {
+  Ballistic() :
+    velocity(0.0, 0.0),
+    radius(0.0)
+  {}
+
+  b2Vec2 velocity;
+
+  /// Radius of a circle around the position containing the shape the
+  /// body will have.
+  float radius;
+};
+
+/// A looping sound tied to an entity.
+struct AudioEmitter {
+  AudioEmitter() :
+    channel(-1)
+  {}
+
+  int channel;
+};
+
+/// Stores components of one type for a number of entities. The
+/// components are kept packed in a dense array (in no particular
+/// order) which systems can iterate over directly. A sparse array,
+/// indexed by entity slot, maps entities to their component.
+///
+/// Pointers to components are only valid until the next call to Add or
+/// Remove.
+template <typename T>
+class ComponentStore {
+protected:
+  vector<T> components;
+  vector<EntityHandle> owners;
+  vector<int> sparse;
+
+  int IndexOf(EntityHandle h) const {
+    uint32_t index = h.GetIndex();
+    if (index >= this->sparse.size())
+      return -1;
+
+    int i = this->sparse[index];
+    if (i < 0 || this->owners[i] != h)
+      return -1;
+
+    return i;
+  }
+
+public:
+  /// Add a component to the given entity. If the entity already has
+  /// one, it is replaced.
+  T *Add(EntityHandle h, const T &c=T()) {
+    uint32_t index = h.GetIndex();
+    if (index >= this->sparse.size())
+      this->sparse.resize(index + 1, -1);
+
+    int i = this->sparse[index];
+    if (i >= 0 && this->owners[i] == h) {
+      this->components[i] = c;
+      return &this->components[i];
+    }
+
+    this->sparse[index] = this->components.size();
+    this->components.push_back(c);
+    this->owners.push_back(h);
+
+    return &this->components.back();
+  }
+
+  /// Remove the component of the given entity, if any. The last
+  /// component is moved into its place.
+  void Remove(EntityHandle h) {
+    int i = this->IndexOf(h);
+    if (i < 0)
+      return;
+
+    int last = this->components.size() - 1;
+    if (i != last) {
+      swap(this->components[i], this->components[last]);
+      this->owners[i] = this->owners[last];
+      this->sparse[this->owners[i].GetIndex()] = i;
+    }
+
+    this->components.pop_back();
+    this->owners.pop_back();
+    this->sparse[h.GetIndex()] = -1;
+  }
+
+  T *Get(EntityHandle h) {
+    int i = this->IndexOf(h);
+    return i < 0 ? nullptr : &this->components[i];
+  }
+
+  const T *Get(EntityHandle h) const {
+    int i = this->IndexOf(h);
+    return i < 0 ? nullptr : &this->components[i];
+  }
+
+  bool Has(EntityHandle h) const {
+    return this->IndexOf(h) >= 0;
+  }
+
+  void Clear() {
+    for (auto h : this->owners)
+      this->sparse[h.GetIndex()] = -1;
+    this->components.clear();
+    this->owners.clear();
+  }
+
+  size_t size() const { return this->components.size(); }
+
+  T &operator[](size_t i) { return this->components[i]; }
+  const T &operator[](size_t i) const { return this->components[i]; }
+  EntityHandle GetOwner(size_t i) const { return this->owners[i]; }
+
+  T *data() { return this->components.data(); }
+  const T *data() const { return this->components.data(); }
+
+  typename vector<T>::iterator begin() { return this->components.begin(); }
+  typename vector<T>::iterator end() { return this->components.end(); }
+  typename vector<T>::const_iterator begin() const { return this->components.begin(); }
+  typename vector<T>::const_iterator end() const { return this->components.end(); }
+};
+
+#endif /* _GRAVITY_COMPONENTS_HH_ */
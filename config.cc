@@ -6,9 +6,41 @@ const int Config::HighScores = 5;
 const float Config::PhysicsTimeStep = 0.005;
 const int Config::ScreenWidth = 640;
 const int Config::ScreenHeight = 480;
-const int Config::TimeStep = 5;
+const int Config::FrameRate = 0;
+const int Config::IdleWakeupTime = 500;
+const int Config::FrameArenaSize = 64 * 1024;
+const int Config::JobThreads = 0;
 const int Config::GameTime = 120;
 const float Config::CameraMinWidth = 150.0;
 const float Config::CameraMinHeight = 75.0;
 const float Config::CameraMaxWidth = 150.0;
 const float Config::CameraMaxHeight = 75.0;
+const float Config::CameraMargin = 2.0;
+const float Config::CameraLookahead = 0.25;
+const float Config::CameraSmoothTime = 0.4;
+const float Config::WorldBoundsMargin = 5.0;
+const float Config::CollectibleLifetime = 20.0;
+const float Config::CollectibleFadeTime = 2.0;
+const float Config::SpawnDistance = 8.0;
+const float Config::CollectibleSpacing = 5.0;
+const float Config::SpawnCellSize = 2.5;
+const int Config::SpawnMaxCells = 4096;
+const unsigned Config::AutosaveInterval = 10;
+const float Config::RewindTime = 5.0;
+const float Config::RewindInterval = 0.05;
+const float Config::PredictionTime = 3.0;
+const float Config::PredictionTimeStep = 0.01;
+const float Config::PredictionTolerance = 0.05;
+const bool Config::OrbitalIntegrator = false;
+const float Config::OrbitalAccuracy = 0.01;
+const int Config::OrbitalMaxSubsteps = 64;
+const bool Config::MutualGravity = false;
+const float Config::GravityConstant = 0.09;
+const float Config::GravitySoftening = 0.5;
+const int Config::PhysicsShards = 1;
+const float Config::ShardGhostMargin = 1.0;
+const bool Config::BallisticEnemies = true;
+const float Config::BallisticMargin = 4.0;
+const float Config::DragFrequency = 10.0;
+const float Config::DragDampingRatio = 0.7;
+const float Config::DragMaxAcceleration = 1000.0;
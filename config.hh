@@ -9,12 +9,44 @@ public:
   static const float PhysicsTimeStep;
   static const int ScreenWidth;
   static const int ScreenHeight;
-  static const int TimeStep;
+  static const int FrameRate;
+  static const int IdleWakeupTime;
+  static const int FrameArenaSize;
+  static const int JobThreads;
   static const int GameTime;
   static const float CameraMinWidth;
   static const float CameraMinHeight;
   static const float CameraMaxWidth;
   static const float CameraMaxHeight;
+  static const float CameraMargin;
+  static const float CameraLookahead;
+  static const float CameraSmoothTime;
+  static const float WorldBoundsMargin;
+  static const float CollectibleLifetime;
+  static const float CollectibleFadeTime;
+  static const float SpawnDistance;
+  static const float CollectibleSpacing;
+  static const float SpawnCellSize;
+  static const int SpawnMaxCells;
+  static const unsigned AutosaveInterval;
+  static const float RewindTime;
+  static const float RewindInterval;
+  static const float PredictionTime;
+  static const float PredictionTimeStep;
+  static const float PredictionTolerance;
+  static const bool OrbitalIntegrator;
+  static const float OrbitalAccuracy;
+  static const int OrbitalMaxSubsteps;
+  static const bool MutualGravity;
+  static const float GravityConstant;
+  static const float GravitySoftening;
+  static const int PhysicsShards;
+  static const float ShardGhostMargin;
+  static const bool BallisticEnemies;
+  static const float BallisticMargin;
+  static const float DragFrequency;
+  static const float DragDampingRatio;
+  static const float DragMaxAcceleration;
 };
 
 #endif /* _GRAVITY_CONFIG_HH_ */
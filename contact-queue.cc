@@ -0,0 +1,132 @@
+#include "contact-queue.hh"
+#include "alloc-tracker.hh"
+
+ContactQueue::ContactQueue(size_t capacity) :
+  capacity(capacity),
+  peakSize(0),
+  pushedCount(0),
+  duplicateCount(0)
+{
+  this->events.reserve(capacity);
+}
+
+void ContactQueue::Push(ContactEventType type, EntityHandle a, EntityHandle b) {
+  // The queue rarely holds more than a handful of events per step, so
+  // a linear search is the fastest way to find duplicates.
+  for (auto &ev : this->events)
+    if (ev.type == type && ev.a == a && ev.b == b) {
+      this->duplicateCount++;
+      return;
+    }
+
+  // Past this point the vector will grow (and allocate). That's fine,
+  // but it shows up in the peak size so the capacity can be adjusted.
+  this->events.push_back({type, a, b});
+  this->pushedCount++;
+
+  if (this->events.size() > this->peakSize)
+    this->peakSize = this->events.size();
+}
+
+void ContactQueue::Clear() {
+  this->events.clear();
+}
+
+void ContactQueue::ResetStats() {
+  this->peakSize = this->events.size();
+  this->pushedCount = 0;
+  this->duplicateCount = 0;
+}
+
+ContactListener::ContactListener(ContactQueue *queue, EntityPool *entities) :
+  queue(queue),
+  entities(entities)
+{}
+
+int ContactListener::FindCarried(EntityHandle a, EntityHandle b) const {
+  // Only the bodies moved during the last handoff have carried pairs,
+  // so there are few of them.
+  for (size_t i = 0; i < this->carried.size(); ++i) {
+    auto &pair = this->carried[i];
+    if ((pair.first == a && pair.second == b) || (pair.first == b && pair.second == a))
+      return i;
+  }
+
+  return -1;
+}
+
+void ContactListener::BeginContact(b2Contact *contact) {
+  ALLOCATION_SCOPE("contacts");
+  Entity *e1 = this->entities->Get(EntityHandle::FromBody(contact->GetFixtureA()->GetBody()));
+  Entity *e2 = this->entities->Get(EntityHandle::FromBody(contact->GetFixtureB()->GetBody()));
+  if (!e1 || !e2)
+    return;
+
+  int carried = this->FindCarried(e1->handle, e2->handle);
+  if (carried >= 0) {
+    this->carried.erase(this->carried.begin() + carried);
+    return;
+  }
+
+  this->Begin(e1, e2);
+}
+
+void ContactListener::Begin(Entity *e1, Entity *e2) {
+  if (e1->type == EntityType::SUN && e2->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::PLANET_SUN, e2->handle, e1->handle);
+  if (e2->type == EntityType::SUN && e1->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::PLANET_SUN, e1->handle, e2->handle);
+
+  if (e1->type == EntityType::COLLECTIBLE && e2->type == EntityType::SUN)
+    this->queue->Push(ContactEventType::COLLECTIBLE_SUN, e1->handle, e2->handle);
+  if (e2->type == EntityType::COLLECTIBLE && e1->type == EntityType::SUN)
+    this->queue->Push(ContactEventType::COLLECTIBLE_SUN, e2->handle, e1->handle);
+
+  if (e1->type == EntityType::COLLECTIBLE && e2->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::COLLECTIBLE_PLANET, e1->handle, e2->handle);
+  if (e2->type == EntityType::COLLECTIBLE && e1->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::COLLECTIBLE_PLANET, e2->handle, e1->handle);
+
+  if (e1->type == EntityType::ENEMY && e2->type == EntityType::SUN)
+    this->queue->Push(ContactEventType::ENEMY_SUN, e1->handle, e2->handle);
+  if (e2->type == EntityType::ENEMY && e1->type == EntityType::SUN)
+    this->queue->Push(ContactEventType::ENEMY_SUN, e2->handle, e1->handle);
+
+  if (e1->type == EntityType::ENEMY && e2->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::ENEMY_PLANET, e1->handle, e2->handle);
+  if (e2->type == EntityType::ENEMY && e1->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::ENEMY_PLANET, e2->handle, e1->handle);
+}
+
+void ContactListener::EndContact(b2Contact *contact) {
+  ALLOCATION_SCOPE("contacts");
+  Entity *e1 = this->entities->Get(EntityHandle::FromBody(contact->GetFixtureA()->GetBody()));
+  Entity *e2 = this->entities->Get(EntityHandle::FromBody(contact->GetFixtureB()->GetBody()));
+  if (!e1 || !e2)
+    return;
+
+  this->End(e1, e2);
+}
+
+void ContactListener::End(Entity *e1, Entity *e2) {
+  if (e1->type == EntityType::SUN && e2->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::PLANET_SUN_END, e2->handle, e1->handle);
+  if (e2->type == EntityType::SUN && e1->type == EntityType::PLANET)
+    this->queue->Push(ContactEventType::PLANET_SUN_END, e1->handle, e2->handle);
+}
+
+void ContactListener::CarryContact(EntityHandle a, EntityHandle b) {
+  if (this->FindCarried(a, b) < 0)
+    this->carried.push_back(make_pair(a, b));
+}
+
+void ContactListener::FinishCarriedContacts() {
+  ALLOCATION_SCOPE("contacts");
+  for (auto &pair : this->carried) {
+    Entity *e1 = this->entities->Get(pair.first);
+    Entity *e2 = this->entities->Get(pair.second);
+    if (e1 && e2)
+      this->End(e1, e2);
+  }
+  this->carried.clear();
+}
@@ -0,0 +1,100 @@
+#ifndef _GRAVITY_CONTACT_QUEUE_HH_
+#define _GRAVITY_CONTACT_QUEUE_HH_
+
+#include "entity.hh"
+#include "entity-pool.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+enum class ContactEventType : uint8_t {
+  PLANET_SUN,
+  PLANET_SUN_END,
+  COLLECTIBLE_SUN,
+  COLLECTIBLE_PLANET,
+  ENEMY_SUN,
+  ENEMY_PLANET,
+};
+
+/// A contact recorded during the physics step. The first entity is
+/// always the one named first in the event type (e.g. the collectible
+/// in COLLECTIBLE_SUN).
+struct ContactEvent {
+  ContactEventType type;
+  EntityHandle a;
+  EntityHandle b;
+};
+
+/// A queue of contact events. Events are pushed by the contact
+/// listener while the world is being stepped and processed in one go
+/// after the step is over, so that no game logic (sounds, labels,
+/// etc.) runs inside the solver.
+class ContactQueue {
+protected:
+  vector<ContactEvent> events;
+  size_t capacity;
+
+  // statistics
+  size_t peakSize;
+  int pushedCount;
+  int duplicateCount;
+
+public:
+  ContactQueue(size_t capacity);
+
+  /// Add an event to the queue. The event is ignored if an event of
+  /// the same type for the same pair has already been queued.
+  void Push(ContactEventType type, EntityHandle a, EntityHandle b);
+  void Clear();
+
+  const vector<ContactEvent> &GetEvents() const { return this->events; }
+  size_t GetSize() const { return this->events.size(); }
+  size_t GetCapacity() const { return this->capacity; }
+
+  size_t GetPeakSize() const { return this->peakSize; }
+  int GetPushedCount() const { return this->pushedCount; }
+  int GetDuplicateCount() const { return this->duplicateCount; }
+  void ResetStats();
+};
+
+/// Records the contacts we're interested in into a contact queue. No
+/// game logic is run here since this is called from inside
+/// b2World::Step.
+///
+/// A body moved to another world (see PhysicsShards) loses its
+/// contacts, and gets new ones on the next step. Pairs that were
+/// touching before the move can be carried over, so that they don't
+/// begin again.
+class ContactListener : public b2ContactListener {
+protected:
+  ContactQueue *queue;
+  EntityPool *entities;
+
+  // Touching pairs carried over from another world, in no particular
+  // order.
+  vector<pair<EntityHandle, EntityHandle>> carried;
+
+  int FindCarried(EntityHandle a, EntityHandle b) const;
+  void Begin(Entity *e1, Entity *e2);
+  void End(Entity *e1, Entity *e2);
+
+public:
+  ContactListener(ContactQueue *queue, EntityPool *entities);
+
+  virtual void BeginContact(b2Contact *contact);
+  virtual void EndContact(b2Contact *contact);
+
+  /// The given entities were touching in another world. Their next
+  /// BeginContact is not reported.
+  void CarryContact(EntityHandle a, EntityHandle b);
+
+  /// Report the end of the carried contacts that didn't begin again
+  /// during the step, and forget about them. Call after each step.
+  void FinishCarriedContacts();
+};
+
+#endif /* _GRAVITY_CONTACT_QUEUE_HH_ */
@@ -0,0 +1,112 @@
+#include "entity-pool.hh"
+#include "entity.hh"
+
+#include <SDL2/SDL_mixer.h>
+
+#include <stdexcept>
+
+EntityPool::EntityPool() :
+  listener(nullptr)
+{
+}
+
+EntityPool::~EntityPool() {
+  this->Clear();
+}
+
+Entity *EntityPool::Create() {
+  uint32_t index;
+  if (!this->freeSlots.empty()) {
+    index = this->freeSlots.back();
+    this->freeSlots.pop_back();
+  }
+  else {
+    index = this->slots.size();
+    if (index > EntityHandle::INDEX_MASK)
+      throw runtime_error("Entity pool exhausted.");
+
+    // A deque never moves its elements when growing at the end, so
+    // pointers to existing entities stay valid.
+    this->slots.emplace_back();
+    this->generations.push_back(1);
+  }
+
+  Entity *e = &this->slots[index];
+  e->handle = EntityHandle(index, this->generations[index]);
+  e->activeIndex = this->active.size();
+  this->active.push_back(e);
+
+  return e;
+}
+
+void EntityPool::Destroy(Entity *e) {
+  uint32_t index = e->handle.GetIndex();
+  if (e->activeIndex < 0 || this->Get(e->handle) != e)
+    return;
+
+  if (this->listener)
+    this->listener->EntityDestroyed(this, e);
+
+  // Stop the sounds the entity is playing.
+  AudioEmitter *audio = this->audioEmitters.Get(e->handle);
+  if (audio && audio->channel != -1) {
+    Mix_HaltChannel(audio->channel);
+
+    // Reset channel volume.
+    Mix_Volume(audio->channel, MIX_MAX_VOLUME);
+  }
+
+  this->transforms.Remove(e->handle);
+  this->gravitySources.Remove(e->handle);
+  this->gravityReceivers.Remove(e->handle);
+  this->trails.Remove(e->handle);
+  this->sprites.Remove(e->handle);
+  this->collectibles.Remove(e->handle);
+  this->audioEmitters.Remove(e->handle);
+  this->orbits.Remove(e->handle);
+  this->lifetimes.Remove(e->handle);
+  this->ballistics.Remove(e->handle);
+
+  // Swap with the last active entity and pop.
+  Entity *last = this->active.back();
+  this->active[e->activeIndex] = last;
+  last->activeIndex = e->activeIndex;
+  this->active.pop_back();
+
+  // Bump the generation so that outstanding handles go stale. Zero is
+  // skipped so that a valid handle is never null.
+  uint32_t generation = (this->generations[index] + 1) & EntityHandle::GENERATION_MASK;
+  if (generation == 0)
+    generation = 1;
+  this->generations[index] = generation;
+
+  e->Reset();
+  this->freeSlots.push_back(index);
+}
+
+void EntityPool::Destroy(EntityHandle handle) {
+  Entity *e = this->Get(handle);
+  if (e)
+    this->Destroy(e);
+}
+
+void EntityPool::NotifyCreated(Entity *e) {
+  if (this->listener)
+    this->listener->EntityCreated(this, e);
+}
+
+void EntityPool::Clear() {
+  while (!this->active.empty())
+    this->Destroy(this->active.back());
+}
+
+Entity *EntityPool::Get(EntityHandle handle) const {
+  uint32_t index = handle.GetIndex();
+  if (handle.IsNull() || index >= this->slots.size())
+    return nullptr;
+
+  if (this->generations[index] != handle.GetGeneration())
+    return nullptr;
+
+  return const_cast<Entity*>(&this->slots[index]);
+}
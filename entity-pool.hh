@@ -0,0 +1,94 @@
+#ifndef _GRAVITY_ENTITY_POOL_HH_
+#define _GRAVITY_ENTITY_POOL_HH_
+
+#include "entity.hh"
+#include "components.hh"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+class EntityPool;
+
+/// Told about the entities of a pool as they come and go.
+class EntityListener {
+public:
+  virtual ~EntityListener() {}
+
+  /// Called once the entity has its type, body and components.
+  virtual void EntityCreated(EntityPool *pool, Entity *e) = 0;
+
+  /// Called before the entity loses its components.
+  virtual void EntityDestroyed(EntityPool *pool, Entity *e) = 0;
+};
+
+/// Owns all the entities of a game. Entities live in stable slots that
+/// are reused after being freed, so creating and destroying entities
+/// does not hit the allocator once the pool has warmed up. Active
+/// entities are also kept in a dense list which can be iterated over
+/// directly, and from which entities are removed in constant time (by
+/// swapping with the last one).
+///
+/// The pool also holds the component stores. Destroying an entity
+/// removes all of its components.
+class EntityPool {
+protected:
+  deque<Entity> slots;
+  vector<uint32_t> generations;
+  vector<uint32_t> freeSlots;
+  vector<Entity*> active;
+  EntityListener *listener;
+
+public:
+  ComponentStore<Transform> transforms;
+  ComponentStore<GravitySource> gravitySources;
+  ComponentStore<GravityReceiver> gravityReceivers;
+  ComponentStore<Trail> trails;
+  ComponentStore<Sprite> sprites;
+  ComponentStore<CollectiblePayload> collectibles;
+  ComponentStore<AudioEmitter> audioEmitters;
+  ComponentStore<Orbit> orbits;
+  ComponentStore<Lifetime> lifetimes;
+  ComponentStore<Ballistic> ballistics;
+
+  EntityPool();
+  ~EntityPool();
+
+  /// Return a fresh entity. The entity is immediately added to the
+  /// list of active entities.
+  Entity *Create();
+
+  /// Release the given entity, its components and its slot. Note that
+  /// the entity's physics body is not destroyed here.
+  void Destroy(Entity *e);
+
+  /// Same as above, but does nothing if the handle is stale.
+  void Destroy(EntityHandle handle);
+
+  /// Tell the listener that the given entity is complete. Create()
+  /// can't know when that is, so this is called by the entity
+  /// factories, and by whatever else creates entities (loading and
+  /// rewinding).
+  void NotifyCreated(Entity *e);
+
+  /// Set the listener told about the entities created and destroyed,
+  /// or nullptr for none.
+  void SetListener(EntityListener *listener) { this->listener = listener; }
+
+  /// Release all active entities.
+  void Clear();
+
+  /// Resolve a handle. Returns nullptr if the entity the handle refers
+  /// to has been destroyed.
+  Entity *Get(EntityHandle handle) const;
+
+  size_t size() const { return this->active.size(); }
+  size_t GetCapacity() const { return this->slots.size(); }
+
+  vector<Entity*>::const_iterator begin() const { return this->active.begin(); }
+  vector<Entity*>::const_iterator end() const { return this->active.end(); }
+};
+
+#endif /* _GRAVITY_ENTITY_POOL_HH_ */
@@ -1,193 +1,181 @@
 #include "entity.hh"
+#include "entity-pool.hh"
 #include "helpers.hh"
+#include "config.hh"
 #include "resource-cache.hh"
 
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
 
 using namespace std;
 
-Entity::Entity() :
-  hasPhysics(false),
-  body(nullptr),
-  hasGravity(false),
-  gravityCoeff(0.0),
-  hasTrail(false),
-  isAffectedByGravity(false),
-  isSun(false),
-  isPlanet(false),
-  isEnemy(false),
-  isCollectible(false),
-  hasScore(false),
-  score(0),
-  hasTime(false),
-  time(0),
-  spawnPlanet(false),
-  isDrawable(false),
-  mesh(nullptr),
-  planetWhooshChannel(-1)
-{
-}
+/// Return a square mesh with the given half size and texture. Meshes
+/// are shared between all entities that look the same, so spawning an
+/// entity doesn't create a new vertex buffer.
+static Mesh *GetSquareMesh(float halfSize, const string &textureName) {
+  static map<tuple<string, float>, Mesh*> cache;
 
-Entity::~Entity() {
-  delete this->mesh;
-  if (this->planetWhooshChannel != -1) {
-    Mix_HaltChannel(this->planetWhooshChannel);
+  auto key = make_tuple(textureName, halfSize);
+  auto it = cache.find(key);
+  if (it != cache.end())
+    return it->second;
 
-    // Reset channel volume.
-    Mix_Volume(this->planetWhooshChannel, MIX_MAX_VOLUME);
-  }
-}
+  float r = halfSize;
+  GLfloat vertexData[] = {
+    // triangle 1
+    /* coord */ -r, -r, /* tex_coord */ 0.0f, 0.0f,
+    /* coord */ -r,  r, /* tex_coord */ 0.0f, 1.0f,
+    /* coord */  r, -r, /* tex_coord */ 1.0f, 0.0f,
 
-void Entity::SaveBody(const b2Body *b, ostream &s) const {
-  int hasBody = b ? 1 : 0;
-  WRITE(hasBody, s);
+    // triangle 2
+    /* coord */ -r,  r, /* tex_coord */ 0.0f, 1.0f,
+    /* coord */  r,  r, /* tex_coord */ 1.0f, 1.0f,
+    /* coord */  r, -r, /* tex_coord */ 1.0f, 0.0f,
+  };
 
-  auto bType = b->GetType();
-  WRITE(bType, s);
+  Mesh *mesh = new Mesh(vertexData, 6, ResourceCache::GetTexture(textureName));
+  cache[key] = mesh;
 
-  auto bPos = b->GetPosition();
-  WRITE(bPos, s);
+  return mesh;
+}
 
-  auto bAngle = b->GetAngle();
-  WRITE(bAngle, s);
+Entity::Entity() :
+  activeIndex(-1),
+  type(EntityType::NONE),
+  body(nullptr)
+{
+}
 
-  auto bLinVel = b->GetLinearVelocity();
-  WRITE(bLinVel, s);
+void Entity::Reset() {
+  this->handle = EntityHandle();
+  this->activeIndex = -1;
+  this->type = EntityType::NONE;
+  this->body = nullptr;
+}
 
-  auto bAngVel = b->GetAngularVelocity();
-  WRITE(bAngVel, s);
+static const char *GetCollectibleTexture(CollectibleType type) {
+  switch (type) {
+  case CollectibleType::PLUS_SCORE: return "plus-score";
+  case CollectibleType::MINUS_SCORE: return "minus-score";
+  case CollectibleType::PLUS_TIME: return "plus-time";
+  case CollectibleType::MINUS_TIME: return "minus-time";
+  case CollectibleType::SPAWN_PLANET: return "plus-planet";
+  }
 
-  int fixtureCount = 0;
-  for (auto f = b->GetFixtureList(); f; f = f->GetNext())
-    fixtureCount++;
+  return nullptr;
+}
 
-  WRITE(fixtureCount, s);
-  for (auto f = b->GetFixtureList(); f; f = f->GetNext()) {
-    auto fFriction = f->GetFriction();
-    WRITE(fFriction, s);
+/// Return the enemy ship mesh. It's the same for all enemy ships, so
+/// it's only created once.
+static Mesh *GetEnemyMesh() {
+  static Mesh *mesh = nullptr;
+  if (!mesh) {
+    GLfloat vertexData[] = {
+      // triangle 1
+      /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
+      /* coord */ -2.453125, 0.1171875, /* tex_coord */ 0.0, 0.5303326810176126,
+      /* coord */ -0.96875, 1.9921875, /* tex_coord */ 0.30303030303030304, 1.0,
+
+      // triangle 2
+      /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
+      /* coord */ -0.96875, 1.9921875, /* tex_coord */ 0.30303030303030304, 1.0,
+      /* coord */ 0.9453125, 1.9921875, /* tex_coord */ 0.69377990430622, 1.0,
+
+      // triangle 3
+      /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
+      /* coord */ 0.9453125, 1.9921875, /* tex_coord */ 0.69377990430622, 1.0,
+      /* coord */ 2.4453125, 0.1171875, /* tex_coord */ 1.0, 0.5303326810176126,
+
+      // triangle 4
+      /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
+      /* coord */ 2.4453125, 0.1171875, /* tex_coord */ 1.0, 0.5303326810176126,
+      /* coord */ 1.8359375, -2.0, /* tex_coord */ 0.8755980861244019, 0.0,
+    };
+
+    mesh = new Mesh(vertexData, 12, ResourceCache::GetTexture("enemy"));
+  }
 
-    auto fDensity = f->GetDensity();
-    WRITE(fDensity, s);
+  return mesh;
+}
 
-    auto fRestitution = f->GetRestitution();
-    WRITE(fRestitution, s);
+bool Entity::presentationEnabled = true;
 
-    b2CircleShape *shape = (b2CircleShape*) f->GetShape();
-    if (shape->GetType() != b2Shape::e_circle)
-      throw runtime_error("Only circle shapes are currently supported.");
-    WRITE(shape->m_p, s);
-    WRITE(shape->m_radius, s);
-  }
-}
+void Entity::AddPresentation(EntityPool *pool, Entity *e) {
+  if (!presentationEnabled)
+    return;
 
-void Entity::SaveTrail(const Trail &t, ostream &s) const {
-  WRITE(t.size, s);
-  WRITE(t.time, s);
+  Sprite sprite;
 
-  size_t pointCount = t.points.size();
-  WRITE(pointCount, s);
-  for (auto it = t.points.begin(); it != t.points.end(); ++it) {
-    WRITE(it->pos, s);
-    WRITE(it->time, s);
-  }
-}
+  switch (e->type) {
+  case EntityType::SUN:
+    sprite.mesh = GetSquareMesh(e->body->GetFixtureList()->GetShape()->m_radius, "sun");
+    break;
 
-b2Body *Entity::LoadBody(istream &s, b2World *world) {
-  int bodyExists;
-  READ(bodyExists, s);
-  if (!bodyExists)
-    return nullptr;
+  case EntityType::PLANET: {
+    sprite.mesh = GetSquareMesh(e->body->GetFixtureList()->GetShape()->m_radius, "planet");
 
-  b2BodyDef bd;
-  int bdtype;
-  READ(bdtype, s);
-  READ(bd.position, s);
-  READ(bd.angle, s);
-  READ(bd.linearVelocity, s);
-  READ(bd.angularVelocity, s);
-  bd.type = (b2BodyType) bdtype;
-  this->body = world->CreateBody(&bd);
-
-  int fixtureCount;
-  READ(fixtureCount, s);
-  for (int i = 0; i < fixtureCount; ++i) {
-    b2FixtureDef fd;
-    READ(fd.friction, s);
-    READ(fd.density, s);
-    READ(fd.restitution, s);
-
-    b2CircleShape shape;
-    READ(shape.m_p, s);
-    READ(shape.m_radius, s);
-    fd.shape = &shape;
-
-    this->body->CreateFixture(&fd);
+    AudioEmitter audio;
+    audio.channel = Mix_PlayChannel(-1, ResourceCache::GetSound("brown"), -1);
+    Mix_Volume(audio.channel, 0);
+    pool->audioEmitters.Add(e->handle, audio);
+    break;
   }
 
-  this->body->GetUserData().pointer = (uintptr_t) this;
+  case EntityType::COLLECTIBLE: {
+    const CollectiblePayload *payload = pool->collectibles.Get(e->handle);
+    if (payload)
+      sprite.mesh = GetSquareMesh(1.5f, GetCollectibleTexture(payload->type));
+    break;
+  }
 
-  return this->body;
-}
+  case EntityType::ENEMY:
+    sprite.mesh = GetEnemyMesh();
+    break;
 
-Trail Entity::LoadTrail(istream &s) {
-  Trail t;
-  READ(t.size, s);
-  READ(t.time, s);
-
-  size_t pointCount;
-  READ(pointCount, s);
-  for (int i = 0; i < pointCount; ++i) {
-    TrailPoint tp;
-    READ(tp.pos, s);
-    READ(tp.time, s);
-    t.points.push_back(tp);
+  default:
+    break;
   }
-  return t;
-}
 
-void Entity::Save(ostream &s) const {
-  WRITE(this->hasPhysics, s);
-  if (this->hasPhysics)
-    this->SaveBody(this->body, s);
-
-  WRITE(this->hasGravity, s);
-  WRITE(this->gravityCoeff, s);
+  if (sprite.mesh)
+    pool->sprites.Add(e->handle, sprite);
+}
 
-  WRITE(this->hasTrail, s);
-  if (this->hasTrail)
-    this->SaveTrail(this->trail, s);
+void Entity::AddLifetime(EntityPool *pool, Entity *e) {
+  Lifetime lifetime;
 
-  WRITE(this->isAffectedByGravity, s);
-  WRITE(this->isSun, s);
-  WRITE(this->isPlanet, s);
-}
+  switch (e->type) {
+  case EntityType::PLANET:
+    lifetime.policy = ExpiryPolicy::LOSE_LIFE;
+    break;
 
-void Entity::Load(istream &s, b2World *world) {
-  READ(this->hasPhysics, s);
-  if (this->hasPhysics)
-    this->body = this->LoadBody(s, world);
+  case EntityType::COLLECTIBLE:
+    lifetime.policy = ExpiryPolicy::FADE_OUT;
+    lifetime.maxAge = Config::CollectibleLifetime;
+    break;
 
-  READ(this->hasGravity, s);
-  READ(this->gravityCoeff, s);
+  case EntityType::ENEMY:
+    lifetime.policy = ExpiryPolicy::DESPAWN;
+    break;
 
-  READ(this->hasTrail, s);
-  if (this->hasTrail)
-    this->trail = this->LoadTrail(s);
+  default:
+    return;
+  }
 
-  READ(this->isAffectedByGravity, s);
-  READ(this->isSun, s);
-  READ(this->isPlanet, s);
+  pool->lifetimes.Add(e->handle, lifetime);
 }
 
-Entity *Entity::CreatePlanet(b2World *world,
+Entity *Entity::CreatePlanet(EntityPool *pool,
+                             b2World *world,
                              b2Vec2 pos,
                              float radius,
                              float density,
                              b2Vec2 v0)
 {
-  Entity *e = new Entity;
-  e->hasPhysics = true;
+  Entity *e = pool->Create();
   b2BodyDef bd;
   bd.type = b2_dynamicBody;
   bd.position = pos;
@@ -204,49 +192,39 @@ Entity *Entity::CreatePlanet(b2World *world,
   fd.friction = 0.5;
   fd.restitution = 0.7;
   fd.density = density;
+  fd.filter.categoryBits = CATEGORY_PLANET;
+  fd.filter.maskBits = MASK_PLANET;
   e->body->CreateFixture(&fd);
 
-  e->hasTrail = true;
-  e->trail.size = 30;
-  e->trail.time = 1.0;
-
-  e->hasGravity = false;
-  e->isAffectedByGravity = true;
-  e->isSun = false;
+  e->type = EntityType::PLANET;
+  e->body->GetUserData().pointer = e->handle.value;
 
-  e->isPlanet = true;
-  e->planetWhooshChannel = Mix_PlayChannel(-1, ResourceCache::GetSound("brown"), -1);
-  Mix_Volume(e->planetWhooshChannel, 0);
+  Transform transform;
+  transform.body = e->body;
+  transform.pos = pos;
+  pool->transforms.Add(e->handle, transform);
 
-  // Create mesh.
-  GLfloat vertexData[] = {
-    // triangle 1
-    /* coord */ -radius, -radius, /* tex_coord */ 0.0f, 0.0f,
-    /* coord */ -radius,  radius, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  radius, -radius, /* tex_coord */ 1.0f, 0.0f,
-
-    // triangle 2
-    /* coord */ -radius,  radius, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  radius,  radius, /* tex_coord */ 1.0f, 1.0f,
-    /* coord */  radius, -radius, /* tex_coord */ 1.0f, 0.0f,
-  };
+  pool->gravityReceivers.Add(e->handle);
 
-  e->mesh = new Mesh(vertexData, 6, ResourceCache::GetTexture("planet"));
-  e->isDrawable = true;
+  Trail *trail = pool->trails.Add(e->handle);
+  trail->size = 30;
+  trail->time = 1.0;
 
-  e->body->GetUserData().pointer = (uintptr_t) e;
+  AddPresentation(pool, e);
+  AddLifetime(pool, e);
+  pool->NotifyCreated(e);
 
   return e;
 }
 
-Entity *Entity::CreateSun(b2World *world,
+Entity *Entity::CreateSun(EntityPool *pool,
+                          b2World *world,
                           b2Vec2 pos,
                           float radius,
                           float density,
                           float gravityCoeff)
 {
-  Entity *e = new Entity;
-  e->hasPhysics = true;
+  Entity *e = pool->Create();
   b2BodyDef bd;
   bd.type = b2_dynamicBody;
   bd.position = pos;
@@ -261,40 +239,36 @@ Entity *Entity::CreateSun(b2World *world,
   fd.friction = 0.5;
   fd.restitution = 0.7;
   fd.density = density;
+  fd.filter.categoryBits = CATEGORY_SUN;
+  fd.filter.maskBits = MASK_SUN;
   e->body->CreateFixture(&fd);
 
-  e->hasGravity = true;
-  e->gravityCoeff = gravityCoeff;
-  e->isAffectedByGravity = false;
-  e->isSun = true;
-  e->isPlanet = false;
+  e->type = EntityType::SUN;
+  e->body->GetUserData().pointer = e->handle.value;
 
-  // Create mesh.
-  GLfloat vertexData[] = {
-    // triangle 1
-    /* coord */ -radius, -radius, /* tex_coord */ 0.0f, 0.0f,
-    /* coord */ -radius,  radius, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  radius, -radius, /* tex_coord */ 1.0f, 0.0f,
-
-    // triangle 2
-    /* coord */ -radius,  radius, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  radius,  radius, /* tex_coord */ 1.0f, 1.0f,
-    /* coord */  radius, -radius, /* tex_coord */ 1.0f, 0.0f,
-  };
+  Transform transform;
+  transform.body = e->body;
+  transform.pos = pos;
+  pool->transforms.Add(e->handle, transform);
 
-  e->mesh = new Mesh(vertexData, 6, ResourceCache::GetTexture("sun"));
-  e->isDrawable = true;
+  GravitySource source;
+  source.coeff = gravityCoeff;
+  pool->gravitySources.Add(e->handle, source);
 
-  e->body->GetUserData().pointer = (uintptr_t) e;
+  AddPresentation(pool, e);
+  pool->NotifyCreated(e);
 
   return e;
 }
 
-Entity *Entity::CreateCollectible(b2World *world, b2Vec2 pos, CollectibleType type) {
-  Entity *e = new Entity;
-  e->hasPhysics = true;
+Entity *Entity::CreateCollectible(EntityPool *pool, b2World *world, b2Vec2 pos, CollectibleType type) {
+  Entity *e = pool->Create();
+
+  // Collectibles never move and only need to know when they are
+  // touched, so they are static sensors: they are never in an island
+  // and never solved, and static pairs aren't even tested.
   b2BodyDef bd;
-  bd.type = b2_dynamicBody;
+  bd.type = b2_staticBody;
   bd.position = pos;
   e->body = world->CreateBody(&bd);
 
@@ -303,121 +277,134 @@ Entity *Entity::CreateCollectible(b2World *world, b2Vec2 pos, CollectibleType ty
 
   b2FixtureDef fd;
   fd.shape = &shape;
+  fd.isSensor = true;
+  fd.filter.categoryBits = CATEGORY_COLLECTIBLE;
+  fd.filter.maskBits = MASK_COLLECTIBLE;
   e->body->CreateFixture(&fd);
 
-  e->isCollectible = true;
+  e->type = EntityType::COLLECTIBLE;
+
+  CollectiblePayload payload;
+  payload.type = type;
 
-  ResourceCache::Texture texture;
   switch (type) {
   case CollectibleType::PLUS_SCORE:
-    e->hasScore = true;
-    e->score = 100;
-    texture = ResourceCache::GetTexture("plus-score");
+    payload.score = 100;
     break;
 
   case CollectibleType::MINUS_SCORE:
-    e->hasScore = true;
-    e->score = -100;
-    texture = ResourceCache::GetTexture("minus-score");
+    payload.score = -100;
     break;
 
   case CollectibleType::PLUS_TIME:
-    e->hasTime = true;
-    e->time = 10;
-    texture = ResourceCache::GetTexture("plus-time");
+    payload.time = 10;
     break;
 
   case CollectibleType::MINUS_TIME:
-    e->hasTime = true;
-    e->time = -10;
-    texture = ResourceCache::GetTexture("minus-time");
+    payload.time = -10;
     break;
 
   case CollectibleType::SPAWN_PLANET:
-    e->spawnPlanet = true;
-    texture = ResourceCache::GetTexture("plus-planet");
+    payload.spawnPlanet = true;
     break;
 
   default:
     cout << "Invalid collectible type" << endl;
-    delete e;
+    world->DestroyBody(e->body);
+    pool->Destroy(e);
     return nullptr;
   }
 
-  // Create mesh.
-  GLfloat vertexData[] = {
-    // triangle 1
-    /* coord */ -1.5f, -1.5f, /* tex_coord */ 0.0f, 0.0f,
-    /* coord */ -1.5f,  1.5f, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  1.5f, -1.5f, /* tex_coord */ 1.0f, 0.0f,
+  e->body->GetUserData().pointer = e->handle.value;
 
-    // triangle 2
-    /* coord */ -1.5f,  1.5f, /* tex_coord */ 0.0f, 1.0f,
-    /* coord */  1.5f,  1.5f, /* tex_coord */ 1.0f, 1.0f,
-    /* coord */  1.5f, -1.5f, /* tex_coord */ 1.0f, 0.0f,
-  };
+  Transform transform;
+  transform.body = e->body;
+  transform.pos = pos;
+  pool->transforms.Add(e->handle, transform);
 
-  e->mesh = new Mesh(vertexData, 6, texture);
-  e->isDrawable = true;
+  pool->collectibles.Add(e->handle, payload);
 
-  e->body->GetUserData().pointer = (uintptr_t) e;
+  AddPresentation(pool, e);
+  AddLifetime(pool, e);
+  pool->NotifyCreated(e);
 
   return e;
 }
 
-Entity *Entity::CreateEnemyShip(b2World *world, b2Vec2 pos, b2Vec2 velocity, float angle) {
-  Entity *e = new Entity;
-  e->hasPhysics = true;
+/// The outline of the enemy ship.
+static const b2Vec2 ENEMY_VERTICES[] = {
+  b2Vec2(-1.84375, -2.0),
+  b2Vec2(-2.453125, 0.1171875),
+  b2Vec2(-0.96875, 1.9921875),
+  b2Vec2(0.9453125, 1.9921875),
+  b2Vec2(2.4453125, 0.1171875),
+  b2Vec2(1.8359375, -2.0),
+};
+
+static b2Body *CreateEnemyBody(b2World *world, b2Vec2 pos, b2Vec2 velocity, float angle) {
   b2BodyDef bd;
   bd.type = b2_dynamicBody;
   bd.position = pos;
   bd.linearVelocity = velocity;
   bd.angle = angle;
-  e->body = world->CreateBody(&bd);
+  b2Body *body = world->CreateBody(&bd);
 
   b2PolygonShape shape;
-  b2Vec2 vertices[6];
-  vertices[0].Set(-1.84375, -2.0);
-  vertices[1].Set(-2.453125, 0.1171875);
-  vertices[2].Set(-0.96875, 1.9921875);
-  vertices[3].Set(0.9453125, 1.9921875);
-  vertices[4].Set(2.4453125, 0.1171875);
-  vertices[5].Set(1.8359375, -2.0);
-  shape.Set(vertices, 5);
+  shape.Set(ENEMY_VERTICES, 5);
 
   b2FixtureDef fd;
   fd.shape = &shape;
-  e->body->CreateFixture(&fd);
+  fd.filter.categoryBits = CATEGORY_ENEMY;
+  fd.filter.maskBits = MASK_ENEMY;
+  body->CreateFixture(&fd);
 
-  e->isEnemy = true;
-
-  // Create mesh.
-  GLfloat vertexData[] = {
-    // triangle 1
-    /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
-    /* coord */ -2.453125, 0.1171875, /* tex_coord */ 0.0, 0.5303326810176126,
-    /* coord */ -0.96875, 1.9921875, /* tex_coord */ 0.30303030303030304, 1.0,
+  return body;
+}
 
-    // triangle 2
-    /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
-    /* coord */ -0.96875, 1.9921875, /* tex_coord */ 0.30303030303030304, 1.0,
-    /* coord */ 0.9453125, 1.9921875, /* tex_coord */ 0.69377990430622, 1.0,
-
-    // triangle 3
-    /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
-    /* coord */ 0.9453125, 1.9921875, /* tex_coord */ 0.69377990430622, 1.0,
-    /* coord */ 2.4453125, 0.1171875, /* tex_coord */ 1.0, 0.5303326810176126,
-
-    // triangle 4
-    /* coord */ -1.84375, -2.0, /* tex_coord */ 0.12440191387559808, 0.0,
-    /* coord */ 2.4453125, 0.1171875, /* tex_coord */ 1.0, 0.5303326810176126,
-    /* coord */ 1.8359375, -2.0, /* tex_coord */ 0.8755980861244019, 0.0,
-  };
+Entity *Entity::CreateEnemyShip(EntityPool *pool,
+                                b2World *world,
+                                b2Vec2 pos,
+                                b2Vec2 velocity,
+                                float angle,
+                                bool ballistic)
+{
+  Entity *e = pool->Create();
+  e->type = EntityType::ENEMY;
+
+  if (ballistic) {
+    Ballistic b;
+    b.velocity = velocity;
+    for (auto &v : ENEMY_VERTICES)
+      b.radius = max(b.radius, v.Length());
+    pool->ballistics.Add(e->handle, b);
+  }
+  else {
+    e->body = CreateEnemyBody(world, pos, velocity, angle);
+    e->body->GetUserData().pointer = e->handle.value;
+  }
 
-  e->mesh = new Mesh(vertexData, 12, ResourceCache::GetTexture("enemy"));
-  e->isDrawable = true;
+  Transform transform;
+  transform.body = e->body;
+  transform.pos = pos;
+  transform.angle = angle;
+  pool->transforms.Add(e->handle, transform);
 
-  e->body->GetUserData().pointer = (uintptr_t) e;
+  AddPresentation(pool, e);
+  AddLifetime(pool, e);
+  pool->NotifyCreated(e);
 
   return e;
 }
+
+void Entity::Promote(EntityPool *pool, Entity *e, b2World *world) {
+  const Ballistic *b = pool->ballistics.Get(e->handle);
+  Transform *t = pool->transforms.Get(e->handle);
+  if (!b || !t || e->body)
+    return;
+
+  e->body = CreateEnemyBody(world, t->pos, b->velocity, t->angle);
+  e->body->GetUserData().pointer = e->handle.value;
+  t->body = e->body;
+
+  pool->ballistics.Remove(e->handle);
+}
@@ -1,40 +1,12 @@
 #ifndef _GRAVITY_ENTITY_HH_
 #define _GRAVITY_ENTITY_HH_
 
-#include "mesh.hh"
-
 #include <box2d/box2d.h>
 
-#include <vector>
-#include <ostream>
+#include <cstdint>
 
 using namespace std;
 
-struct TrailPoint {
-  TrailPoint() :
-    time(0.0)
-  {}
-
-  TrailPoint(b2Vec2 pos, float time) :
-    pos(pos),
-    time(time)
-  {}
-
-  b2Vec2 pos;
-  float time;
-};
-
-struct Trail {
-  Trail() :
-    size(0),
-    time(0.0)
-  {}
-
-  int size;
-  float time;
-  vector<TrailPoint> points;
-};
-
 enum class CollectibleType {
   PLUS_SCORE,
   MINUS_SCORE,
@@ -43,63 +15,123 @@ enum class CollectibleType {
   SPAWN_PLANET,
 };
 
-struct Entity {
-protected:
-  void SaveBody(const b2Body *b, ostream &s) const;
-  void SaveTrail(const Trail &t, ostream &s) const;
-  b2Body *LoadBody(istream &s, b2World *world);
-  Trail LoadTrail(istream &s);
+/// Collision categories used in the fixture filters. Letting Box2D
+/// cull non-colliding pairs using these bits is much cheaper than
+/// looking at the entities in a contact filter callback.
+enum CollisionCategory : uint16 {
+  CATEGORY_SUN = 0x0001,
+  CATEGORY_PLANET = 0x0002,
+  CATEGORY_COLLECTIBLE = 0x0004,
+  CATEGORY_ENEMY = 0x0008,
+};
 
-public:
-  Entity();
-  ~Entity();
+/// Collision masks for each category. Enemies and collectibles don't
+/// collide with each other or with themselves.
+const uint16 MASK_SUN = CATEGORY_SUN | CATEGORY_PLANET | CATEGORY_COLLECTIBLE | CATEGORY_ENEMY;
+const uint16 MASK_PLANET = CATEGORY_SUN | CATEGORY_PLANET | CATEGORY_COLLECTIBLE | CATEGORY_ENEMY;
+const uint16 MASK_COLLECTIBLE = CATEGORY_SUN | CATEGORY_PLANET;
+const uint16 MASK_ENEMY = CATEGORY_SUN | CATEGORY_PLANET;
+
+/// A handle to an entity in an entity pool. The lower bits hold the
+/// slot index and the upper bits a generation counter that is bumped
+/// every time the slot is freed, so a handle to a destroyed entity
+/// never resolves to whatever reuses its slot. The whole thing fits in
+/// 32 bits, so it can be stored in Box2D user data on any platform.
+struct EntityHandle {
+  static const int INDEX_BITS = 20;
+  static const uint32_t INDEX_MASK = (1 << INDEX_BITS) - 1;
+  static const uint32_t GENERATION_MASK = (1 << (32 - INDEX_BITS)) - 1;
+
+  EntityHandle() : value(0) {}
+  explicit EntityHandle(uint32_t value) : value(value) {}
+  EntityHandle(uint32_t index, uint32_t generation) :
+    value((generation << INDEX_BITS) | (index & INDEX_MASK))
+  {}
 
-  bool hasPhysics;
-  b2Body *body;
+  /// Return the handle stored in the user data of the given body.
+  static EntityHandle FromBody(const b2Body *b) {
+    return EntityHandle((uint32_t) b->GetUserData().pointer);
+  }
+
+  uint32_t GetIndex() const { return this->value & INDEX_MASK; }
+  uint32_t GetGeneration() const { return this->value >> INDEX_BITS; }
+  bool IsNull() const { return this->value == 0; }
+
+  bool operator==(const EntityHandle &rhs) const { return this->value == rhs.value; }
+  bool operator!=(const EntityHandle &rhs) const { return this->value != rhs.value; }
+
+  uint32_t value;
+};
+
+class EntityPool;
 
-  bool hasGravity;
-  float gravityCoeff;
+enum class EntityType : uint8_t {
+  NONE,
+  SUN,
+  PLANET,
+  COLLECTIBLE,
+  ENEMY,
+};
 
-  bool hasTrail;
-  Trail trail;
+/// An entity only holds its identity, its type and its physics
+/// body. Everything else is stored in the component stores of the
+/// entity pool.
+struct Entity {
+  Entity();
 
-  bool isAffectedByGravity;
-  bool isSun;
-  bool isEnemy;
+  /// Return all fields to their defaults, so the entity can be
+  /// reused. The physics body is not destroyed.
+  void Reset();
 
-  bool isPlanet;
-  int planetWhooshChannel;
+  EntityHandle handle;
+  int activeIndex;
 
-  bool isCollectible;
-  bool hasScore;
-  int score;
-  bool hasTime;
-  int time;
-  bool spawnPlanet;
+  EntityType type;
+  b2Body *body;
 
-  bool isDrawable;
-  Mesh *mesh;
+  /// Whether AddPresentation does anything. Turned off by the
+  /// benchmarks, which create entities without a window or audio.
+  static bool presentationEnabled;
 
-  void Save(ostream &s) const;
-  void Load(istream &s, b2World *world);
+  /// Add the components that only exist at runtime (the sprite and,
+  /// for planets, the whooshing sound) based on the entity's type and
+  /// other components. Used by the factories and when loading.
+  static void AddPresentation(EntityPool *pool, Entity *e);
 
-  static Entity *CreatePlanet(b2World *world,
+  /// Add the lifetime component with the expiry policy for the
+  /// entity's type. Used by the factories and when loading old saves.
+  static void AddLifetime(EntityPool *pool, Entity *e);
+
+  static Entity *CreatePlanet(EntityPool *pool,
+                              b2World *world,
                               b2Vec2 pos,
                               float radius,
                               float density,
                               b2Vec2 v0=b2Vec2(0, 0));
-  static Entity *CreateSun(b2World *world,
+  static Entity *CreateSun(EntityPool *pool,
+                           b2World *world,
                            b2Vec2 pos,
                            float radius,
                            float density,
                            float gravityCoeff);
-  static Entity *CreateCollectible(b2World *world,
+  static Entity *CreateCollectible(EntityPool *pool,
+                                   b2World *world,
                                    b2Vec2 pos,
                                    CollectibleType type);
-  static Entity *CreateEnemyShip(b2World *world,
+
+  /// Create an enemy ship. A ballistic ship has no body until it is
+  /// promoted (see the Ballistic component).
+  static Entity *CreateEnemyShip(EntityPool *pool,
+                                 b2World *world,
                                  b2Vec2 pos,
                                  b2Vec2 velocity,
-                                 float angle);
+                                 float angle,
+                                 bool ballistic=false);
+
+  /// Give a ballistic entity its body, at its current position and
+  /// velocity, and remove its Ballistic component. Only enemy ships
+  /// can be ballistic.
+  static void Promote(EntityPool *pool, Entity *e, b2World *world);
 };
 
 #endif /* _GRAVITY_ENTITY_HH_ */
@@ -0,0 +1,93 @@
+#include "frame-arena.hh"
+#include "config.hh"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+FrameArena::FrameArena(size_t size) :
+  offset(0),
+  used(0),
+  peak(0)
+{
+  this->AddBlock(size);
+}
+
+FrameArena::~FrameArena() {
+  for (auto &block : this->blocks)
+    delete[] block.data;
+}
+
+void FrameArena::AddBlock(size_t minSize) {
+  // Double the capacity every time, so only a few blocks are ever
+  // needed.
+  size_t size = max(minSize, this->GetCapacity());
+
+  Block block;
+  block.data = new char[size];
+  block.size = size;
+  this->blocks.push_back(block);
+  this->offset = 0;
+}
+
+void *FrameArena::Allocate(size_t size, size_t alignment) {
+  Block &block = this->blocks.back();
+  uintptr_t base = (uintptr_t) block.data;
+  size_t start = ((base + this->offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+
+  if (start + size > block.size) {
+    this->AddBlock(size + alignment);
+    return this->Allocate(size, alignment);
+  }
+
+  this->offset = start + size;
+  this->used += size;
+  return block.data + start;
+}
+
+const char *FrameArena::Format(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  va_list args2;
+  va_copy(args2, args);
+  int length = vsnprintf(nullptr, 0, format, args);
+  va_end(args);
+
+  char *s = static_cast<char*>(this->Allocate(length + 1, 1));
+  vsnprintf(s, length + 1, format, args2);
+  va_end(args2);
+
+  return s;
+}
+
+void FrameArena::Reset() {
+  if (this->used > this->peak)
+    this->peak = this->used;
+
+  // Replace the blocks with a single one with the same total size.
+  if (this->blocks.size() > 1) {
+    size_t capacity = this->GetCapacity();
+    for (auto &block : this->blocks)
+      delete[] block.data;
+    this->blocks.clear();
+    this->AddBlock(capacity);
+  }
+
+  this->offset = 0;
+  this->used = 0;
+}
+
+size_t FrameArena::GetCapacity() const {
+  size_t capacity = 0;
+  for (auto &block : this->blocks)
+    capacity += block.size;
+  return capacity;
+}
+
+FrameArena &FrameArena::Get() {
+  static FrameArena arena(Config::FrameArenaSize);
+  return arena;
+}
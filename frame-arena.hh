@@ -0,0 +1,76 @@
+#ifndef _GRAVITY_FRAME_ARENA_HH_
+#define _GRAVITY_FRAME_ARENA_HH_
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/// A linear allocator for data that only lives until the end of the
+/// frame. Allocating bumps a pointer, and everything is freed at once
+/// with Reset. Nothing is freed individually.
+///
+/// If a frame needs more than the arena holds, extra blocks are
+/// allocated, and on the next reset they are replaced by a single
+/// block large enough for all of them, so after a few frames the arena
+/// stops touching the heap.
+class FrameArena {
+protected:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  vector<Block> blocks;
+  size_t offset;
+  size_t used;
+  size_t peak;
+
+  void AddBlock(size_t minSize);
+
+public:
+  FrameArena(size_t size);
+  ~FrameArena();
+
+  void *Allocate(size_t size, size_t alignment=alignof(max_align_t));
+
+  /// Format a string like printf, in the arena.
+  const char *Format(const char *format, ...);
+
+  /// Free everything allocated since the last reset.
+  void Reset();
+
+  size_t GetUsed() const { return this->used; }
+  size_t GetPeak() const { return this->peak; }
+  size_t GetCapacity() const;
+
+  /// The arena reset by the main loop at the end of every frame. Only
+  /// to be used from the main thread.
+  static FrameArena &Get();
+};
+
+/// Standard allocator that allocates from the frame arena, for
+/// containers that don't outlive the frame.
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  ArenaAllocator() {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T*>(FrameArena::Get().Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+template <typename T>
+using ArenaVector = vector<T, ArenaAllocator<T>>;
+
+#endif /* _GRAVITY_FRAME_ARENA_HH_ */
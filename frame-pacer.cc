@@ -0,0 +1,67 @@
+#include "frame-pacer.hh"
+#include "config.hh"
+#include "platform.hh"
+
+#include <iostream>
+
+using namespace std;
+
+FramePacer::FramePacer(SDL_Window *window) :
+  frequency(SDL_GetPerformanceFrequency()),
+  vsync(false)
+{
+  // Target the refresh rate of the display, unless a frame rate is
+  // configured.
+  int refreshRate = 60;
+  SDL_DisplayMode mode;
+  if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0)
+    refreshRate = mode.refresh_rate;
+  int frameRate = Config::FrameRate > 0 ? Config::FrameRate : refreshRate;
+
+  // VSync can only give us the refresh rate. Prefer adaptive VSync,
+  // which doesn't wait when a frame is late, then normal VSync.
+  if (Config::VSync && frameRate == refreshRate) {
+    if (SDL_GL_SetSwapInterval(-1) == 0 || SDL_GL_SetSwapInterval(1) == 0)
+      this->vsync = true;
+    else
+      DEBUG_MSG("VSync not supported: " << SDL_GetError());
+  }
+
+  if (!this->vsync)
+    SDL_GL_SetSwapInterval(0);
+
+  this->period = this->frequency / frameRate;
+  this->spinTime = this->frequency * 2 / 1000;
+  this->lastTick = SDL_GetPerformanceCounter();
+  this->deadline = this->lastTick + this->period;
+}
+
+void FramePacer::Wait() {
+  if (this->vsync)
+    return;
+
+  uint64_t now = SDL_GetPerformanceCounter();
+
+  // If we're more than a frame late, don't try to catch up.
+  if (now > this->deadline + this->period)
+    this->deadline = now;
+
+  if (now + this->spinTime < this->deadline) {
+    uint64_t sleep = (this->deadline - now - this->spinTime) * 1000 / this->frequency;
+    if (sleep > 0)
+      SDL_Delay(sleep);
+  }
+
+  while (SDL_GetPerformanceCounter() < this->deadline)
+    ;
+
+  this->deadline += this->period;
+}
+
+float FramePacer::Tick() {
+  uint64_t now = SDL_GetPerformanceCounter();
+  float dt = (float) (now - this->lastTick) / this->frequency;
+  this->lastTick = now;
+
+  return dt < 0.25 ? dt : 0.25;
+}
@@ -0,0 +1,41 @@
+#ifndef _GRAVITY_FRAME_PACER_HH_
+#define _GRAVITY_FRAME_PACER_HH_
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+
+/// Paces the main loop and measures the time between frames with the
+/// high-resolution performance counter.
+///
+/// With VSync enabled (and supported), buffer swaps wait for the
+/// display, so the pacer doesn't need to wait at all. Otherwise it
+/// waits for the next frame deadline itself: it sleeps for most of the
+/// remaining time, then spins for the last bit, since sleeps are only
+/// accurate to a millisecond or two.
+class FramePacer {
+protected:
+  uint64_t frequency;
+  uint64_t period;
+  uint64_t spinTime;
+  uint64_t deadline;
+  uint64_t lastTick;
+  bool vsync;
+
+public:
+  /// Must be called after the OpenGL context has been created.
+  FramePacer(SDL_Window *window);
+
+  /// Wait until it's time to start the next frame.
+  void Wait();
+
+  /// Return the time elapsed since the last call, in seconds. Long
+  /// stalls (like dragging the window) are clamped, so the game
+  /// doesn't try to catch up on them.
+  float Tick();
+
+  bool IsVSync() const { return this->vsync; }
+  float GetTargetFrameRate() const { return (float) this->frequency / this->period; }
+};
+
+#endif /* _GRAVITY_FRAME_PACER_HH_ */
@@ -1,13 +1,22 @@
 #include "game-screen.hh"
 #include "entity.hh"
 #include "helpers.hh"
+#include "platform.hh"
 #include "resource-cache.hh"
 #include "config.hh"
+#include "save-file.hh"
+#include "saved-world.hh"
+#include "physics-snapshot.hh"
+#include "view-state.hh"
+#include "frame-arena.hh"
+#include "alloc-tracker.hh"
+#include "job-system.hh"
 
 #include <sstream>
 #include <iomanip>
 #include <functional>
 #include <algorithm>
+#include <stdexcept>
 
 #define M_PI 3.14159265358979323846
 
@@ -23,148 +32,125 @@ b2Vec2 RotatePoint(b2Vec2 point, float theta, b2Vec2 center) {
   return np + center;
 }
 
-ContactListener::ContactListener(GameScreen *screen) :
-  screen(screen),
-  inContact(false)
-{}
-
-void ContactListener::BeginContact(b2Contact *contact) {
-  Entity *e1 = (Entity*) contact->GetFixtureA()->GetBody()->GetUserData().pointer;
-  Entity *e2 = (Entity*) contact->GetFixtureB()->GetBody()->GetUserData().pointer;
-
-  if (e1->isSun && e2->isPlanet)
-    this->PlanetSunContact(e2, e1);
-  if (e2->isSun && e1->isPlanet)
-    this->PlanetSunContact(e1, e2);
-
-  if (e1->isCollectible && e2->isSun)
-    this->CollectibleSunContact(e1, e2);
-  if (e2->isCollectible && e1->isSun)
-    this->CollectibleSunContact(e2, e1);
-
-  if (e1->isCollectible && e2->isPlanet)
-    this->CollectiblePlanetContact(e1, e2);
-  if (e2->isCollectible && e1->isPlanet)
-    this->CollectiblePlanetContact(e2, e1);
-
-  if (e1->isEnemy && e2->isSun)
-    this->EnemySunContact(e1, e2);
-  if (e2->isEnemy && e1->isSun)
-    this->EnemySunContact(e2, e1);
-
-  if (e1->isEnemy && e2->isPlanet)
-    this->EnemyPlanetContact(e1, e2);
-  if (e2->isEnemy && e1->isPlanet)
-    this->EnemyPlanetContact(e2, e1);
-}
-
-void ContactListener::EnemySunContact(Entity *enemy, Entity *sun) {
-  PlaySound("enemy-collision");
-
-  this->screen->SetTimeRemaining(this->screen->timeRemaining - 10);
-  if (this->screen->timeRemaining < 0)
-    this->screen->SetTimeRemaining(0);
-
-  this->screen->toBeRemoved.push_back(enemy);
-}
-
-void ContactListener::EnemyPlanetContact(Entity *enemy, Entity *sun) {
-  PlaySound("enemy-collision");
-
-  this->screen->SetTimeRemaining(this->screen->timeRemaining - 10);
-  if (this->screen->timeRemaining < 0)
-    this->screen->SetTimeRemaining(0);
-
-  this->screen->toBeRemoved.push_back(enemy);
-}
-
-void ContactListener::PlanetSunContact(Entity *planet, Entity *sun) {
-  PlaySound("planet-sun-collision");
-
-  if (!this->inContact)
-    this->screen->SetTimeRemaining(this->screen->timeRemaining - 10);
-  if (this->screen->timeRemaining < 0)
-    this->screen->SetTimeRemaining(0);
-
-  this->inContact = true;
-}
-
-void ContactListener::CollectibleSunContact(Entity *collectible, Entity *sun) {
-  PlaySound("sun-powerup");
-
-  if (collectible->hasScore)
-    this->screen->SetScore(this->screen->score + collectible->score);
+/// Query callback used for picking. Box2D only reports the fixtures
+/// whose (fat) AABBs overlap the query box, so we just need to do the
+/// exact test on those.
+class PointQueryCallback : public b2QueryCallback {
+public:
+  PointQueryCallback(const b2Vec2 &p) :
+    point(p),
+    body(nullptr)
+  {}
+
+  virtual bool ReportFixture(b2Fixture *fixture) {
+    if (fixture->TestPoint(this->point)) {
+      this->body = fixture->GetBody();
+      return false; // Found one; terminate the query.
+    }
 
-  if (collectible->hasTime)
-    this->screen->SetTimeRemaining(this->screen->timeRemaining + collectible->time);
+    return true; // Continue the query.
+  }
 
-  if (collectible->spawnPlanet)
-    this->screen->spawnPlanet = true;
+  b2Vec2 point;
+  b2Body *body;
+};
 
-  this->screen->toBeRemoved.push_back(collectible);
+static bool ContainsPoint(const b2AABB &box, const b2Vec2 &p) {
+  return p.x >= box.lowerBound.x && p.x <= box.upperBound.x &&
+    p.y >= box.lowerBound.y && p.y <= box.upperBound.y;
 }
 
-void ContactListener::CollectiblePlanetContact(Entity *collectible, Entity *planet) {
-  PlaySound("planet-powerup");
+/// Query callback used to find the entities inside the world bounds.
+/// Flags are set by the index of the entity handle.
+class BoundsQueryCallback : public b2QueryCallback {
+public:
+  static const uint8_t IN_BOUNDS = 1;
+  static const uint8_t IN_VIEW = 2;
 
-  if (collectible->hasScore)
-    this->screen->SetScore(this->screen->score + 10 * collectible->score);
+  BoundsQueryCallback(vector<uint8_t> &flags, const b2AABB &view) :
+    flags(flags),
+    view(view)
+  {}
 
-  if (collectible->hasTime)
-    this->screen->SetTimeRemaining(this->screen->timeRemaining + 2 * collectible->time);
+  virtual bool ReportFixture(b2Fixture *fixture) {
+    uint32_t index = EntityHandle::FromBody(fixture->GetBody()).GetIndex();
+    if (index >= this->flags.size())
+      return true;
 
-  if (collectible->spawnPlanet)
-    this->screen->spawnPlanet = true;
+    this->flags[index] |= IN_BOUNDS;
+    if (b2TestOverlap(fixture->GetAABB(0), this->view))
+      this->flags[index] |= IN_VIEW;
 
-  this->screen->toBeRemoved.push_back(collectible);
-}
+    return true;
+  }
 
-void ContactListener::EndContact(b2Contact *contact) {
-  this->inContact = false;
-}
+  vector<uint8_t> &flags;
+  b2AABB view;
+};
 
-bool ContactFilter::ShouldCollide(b2Fixture *fixtureA, b2Fixture *fixtureB) {
-  Entity *e1 = (Entity*) fixtureA->GetBody()->GetUserData().pointer;
-  Entity *e2 = (Entity*) fixtureB->GetBody()->GetUserData().pointer;
+b2Body *GetBodyFromPoint(b2Vec2 p, const PhysicsShards &shards) {
+  // Query the broad-phase with a tiny box around the point instead of
+  // testing every fixture in the world.
+  b2AABB aabb;
+  b2Vec2 d(0.001f, 0.001f);
+  aabb.lowerBound = p - d;
+  aabb.upperBound = p + d;
 
-  if (e1->isEnemy && e2->isEnemy)
-    return false;
-  if (e1->isEnemy && e2->isCollectible)
-    return false;
-  if (e2->isEnemy && e1->isCollectible)
-    return false;
-  if (e2->isCollectible && e1->isCollectible)
-    return false;
+  PointQueryCallback callback(p);
+  for (int i = 0; i < shards.GetShardCount() && !callback.body; ++i)
+    shards.GetWorld(i)->QueryAABB(&callback, aabb);
 
-  return true;
-}
-
-b2Body *GetBodyFromPoint(b2Vec2 p, b2World *world) {
-  for (b2Body *b = world->GetBodyList(); b; b = b->GetNext()) {
-    for (b2Fixture *f = b->GetFixtureList(); f; f = f->GetNext()) {
-      if (f->TestPoint(p))
-        return b;
-    }
-  }
-
-  return nullptr;
+  // Might have hit a ghost, possibly of an entity that is gone.
+  return callback.body ? shards.GetRealBody(callback.body) : nullptr;
 }
 
 GameScreen::GameScreen(SDL_Window *window) :
   Screen(window),
+  spawnPlanet(false),
   world(b2Vec2(0.0, 0.0)),
-  timer(bind(&GameScreen::TimerCallback, this, _1)),
-  contactListener(this),
+  draggingBody(nullptr),
+  dragGround(nullptr),
+  dragJoint(nullptr),
+  timer(this->gameClock, bind(&GameScreen::TimerCallback, this, _1)),
+  contactQueue(256),
+  contactListener(&this->contactQueue, &this->entities),
+  shards(this->world, this->entities, this->contactQueue, this->contactListener,
+         Config::PhysicsShards, -Config::CameraMaxWidth / 2, Config::CameraMaxWidth / 2),
   frameCount(0),
+  drawnCount(0),
+  culledCount(0),
   fps(0),
-  spawnPlanet(false),
+  spawnPlacer(Config::SpawnCellSize, Config::SpawnMaxCells),
+  predictor(Config::PredictionTime, Config::PredictionTimeStep, 40),
+  predictionRequested(false),
+  predictionGravity(PredictionGravity::FIXED),
+  predictionBodyCount(0),
+  orbitalIntegrator(Config::OrbitalIntegrator),
+  mutualGravity(Config::MutualGravity),
+  ballisticEnemies(Config::BallisticEnemies),
+  promotedCount(0),
+  rewindHead(0),
+  rewindCount(0),
+  rewindStepCounter(0),
+  rewinding(false),
+  rewindAccumulator(0.0),
   background(window, ResourceCache::GetTexture("background")),
   discardLeftButtonUp(false)
 {
   this->timer.Set(1.0, true);
 
+  this->rewindHistory.resize(Config::RewindTime / Config::RewindInterval);
+
+#ifdef GRAVITY_ALLOC_TRACKING
+  this->allocationCount = AllocationTracker::GetTotalCount();
+#endif
+
+  // Cleared after every step, so it keeps its capacity; this is just
+  // so that it doesn't have to grow during the game.
+  this->toBeRemoved.reserve(64);
+
   this->world.SetContactListener(&this->contactListener);
-  this->world.SetContactFilter(&this->contactFilter);
+  this->entities.SetListener(this);
 
   this->scoreLabel = new NumberWidget(this,
                                       0,
@@ -184,6 +170,11 @@ GameScreen::GameScreen(SDL_Window *window) :
                                    0.02, 0.0, 0.1,
                                    TextAnchor::LEFT, TextAnchor::BOTTOM,
                                    {255, 255, 255, 128});
+  this->statsLabel = new LabelWidget(this,
+                                     "-",
+                                     0.02, 0.1, 0.035,
+                                     TextAnchor::LEFT, TextAnchor::BOTTOM,
+                                     {255, 255, 255, 128});
 #endif
   this->continueLabel = new ImageWidget(this,
                                         ResourceCache::GetTexture("continue"),
@@ -222,6 +213,7 @@ GameScreen::GameScreen(SDL_Window *window) :
   this->widgets.push_back(this->timeLabel);
 #ifndef RELEASE_BUILD
   this->widgets.push_back(this->fpsLabel);
+  this->widgets.push_back(this->statsLabel);
 #endif
   this->widgets.push_back(this->continueLabel);
   this->widgets.push_back(this->pauseSign);
@@ -250,34 +242,132 @@ GameScreen::GameScreen(SDL_Window *window) :
 }
 
 GameScreen::~GameScreen() {
-  // Remove existing entities.
-  for (auto e : this->entities) {
-    if (e->hasPhysics)
-      this->world.DestroyBody(e->body);
-    delete e;
-  }
-  this->entities.clear();
+  // Remove existing entities, and their ghosts in the other shards.
+  this->shards.Clear();
+  for (auto e : this->entities)
+    if (e->body)
+      e->body->GetWorld()->DestroyBody(e->body);
+  this->entities.Clear();
+  this->entities.SetListener(nullptr);
 
   delete this->trailPointMesh;
 }
 
+void GameScreen::ProcessContactEvents() {
+  ALLOCATION_SCOPE("contacts");
+  for (auto &ev : this->contactQueue.GetEvents()) {
+    if (ev.type == ContactEventType::PLANET_SUN_END) {
+      this->planetSunContact = false;
+      continue;
+    }
+
+    // Skip contacts involving entities destroyed since the event was
+    // recorded.
+    Entity *a = this->entities.Get(ev.a);
+    Entity *b = this->entities.Get(ev.b);
+    if (!a || !b)
+      continue;
+
+    // A collectible or an enemy ship might have touched more than one
+    // body in the same step. Make sure it's consumed only once.
+    if (ev.type != ContactEventType::PLANET_SUN &&
+        find(this->toBeRemoved.begin(), this->toBeRemoved.end(), ev.a) != this->toBeRemoved.end())
+      continue;
+
+    switch (ev.type) {
+    case ContactEventType::PLANET_SUN:
+      this->PlanetSunContact(a, b);
+      break;
+    case ContactEventType::COLLECTIBLE_SUN:
+      this->CollectibleSunContact(a, b);
+      break;
+    case ContactEventType::COLLECTIBLE_PLANET:
+      this->CollectiblePlanetContact(a, b);
+      break;
+    case ContactEventType::ENEMY_SUN:
+      this->EnemySunContact(a, b);
+      break;
+    case ContactEventType::ENEMY_PLANET:
+      this->EnemyPlanetContact(a, b);
+      break;
+    default:
+      break;
+    }
+  }
+
+  this->contactQueue.Clear();
+}
+
+void GameScreen::EnemySunContact(Entity *enemy, Entity *sun) {
+  PlaySound("enemy-collision");
+
+  this->SetTimeRemaining(this->timeRemaining - 10);
+  this->toBeRemoved.push_back(enemy->handle);
+}
+
+void GameScreen::EnemyPlanetContact(Entity *enemy, Entity *planet) {
+  PlaySound("enemy-collision");
+
+  this->SetTimeRemaining(this->timeRemaining - 10);
+  this->toBeRemoved.push_back(enemy->handle);
+}
+
+void GameScreen::PlanetSunContact(Entity *planet, Entity *sun) {
+  PlaySound("planet-sun-collision");
+
+  if (!this->planetSunContact)
+    this->SetTimeRemaining(this->timeRemaining - 10);
+
+  this->planetSunContact = true;
+}
+
+void GameScreen::CollectibleSunContact(Entity *collectible, Entity *sun) {
+  PlaySound("sun-powerup");
+
+  const CollectiblePayload *payload = this->entities.collectibles.Get(collectible->handle);
+  if (payload) {
+    this->SetScore(this->score + payload->score);
+    this->SetTimeRemaining(this->timeRemaining + payload->time);
+
+    if (payload->spawnPlanet)
+      this->spawnPlanet = true;
+  }
+
+  this->toBeRemoved.push_back(collectible->handle);
+}
+
+void GameScreen::CollectiblePlanetContact(Entity *collectible, Entity *planet) {
+  PlaySound("planet-powerup");
+
+  const CollectiblePayload *payload = this->entities.collectibles.Get(collectible->handle);
+  if (payload) {
+    this->SetScore(this->score + 10 * payload->score);
+    this->SetTimeRemaining(this->timeRemaining + 2 * payload->time);
+
+    if (payload->spawnPlanet)
+      this->spawnPlanet = true;
+  }
+
+  this->toBeRemoved.push_back(collectible->handle);
+}
+
 void GameScreen::DiscardPlanet(Entity *planet) {
   int nplanets = 0;
   for (auto e : this->entities)
-    if (e->isPlanet)
+    if (e->type == EntityType::PLANET)
       nplanets++;
 
   if (nplanets == 1)
     this->spawnPlanet = true;
 
-  this->toBeRemoved.push_back(planet);
+  this->toBeRemoved.push_back(planet->handle);
   this->DecreaseLives();
 }
 
 void GameScreen::DecreaseLives() {
   int nplanets = 0;
   for (auto e : this->entities)
-    if (e->isPlanet)
+    if (e->type == EntityType::PLANET)
       nplanets++;
 
   if (nplanets > 1)
@@ -306,27 +396,74 @@ void GameScreen::DecreaseLives() {
 }
 
 void GameScreen::TogglePause() {
+  this->StopRewind();
+
   this->paused = !this->paused;
 #ifndef RELEASE_BUILD
   this->fpsLabel->SetVisible(!this->paused);
+  this->statsLabel->SetVisible(!this->paused);
 #endif
   this->continueLabel->SetVisible(this->paused);
   this->pauseSign->SetVisible(this->paused);
   this->endGameButton->SetVisible(this->paused);
   this->muteButton->SetVisible(this->paused);
 
-  for (auto e : this->entities)
-    if (e->isPlanet)
-      if (this->paused)
-        Mix_Pause(e->planetWhooshChannel);
-      else
-        Mix_Resume(e->planetWhooshChannel);
+  for (auto &audio : this->entities.audioEmitters)
+    if (this->paused)
+      Mix_Pause(audio.channel);
+    else
+      Mix_Resume(audio.channel);
 
   if (this->paused) {
-    this->draggingBody = nullptr;
+    this->StopDragging();
+    this->hoverEntity = EntityHandle();
   }
 
-  Timer::TogglePauseAll();
+  this->gameClock.SetPaused(this->paused);
+}
+
+void GameScreen::StartDragging(b2Body *body, b2Vec2 p) {
+  this->StopDragging();
+
+  // Pull the body towards the mouse with a mouse joint rather than
+  // moving it there, so that the solver sees its velocity and pushes
+  // whatever it runs into instead of having to undo the overlap. The
+  // joint needs a second body, in the same world.
+  b2BodyDef bd;
+  this->dragGround = body->GetWorld()->CreateBody(&bd);
+
+  b2MouseJointDef jd;
+  jd.bodyA = this->dragGround;
+  jd.bodyB = body;
+  jd.target = p;
+  jd.maxForce = Config::DragMaxAcceleration * body->GetMass();
+  b2LinearStiffness(jd.stiffness, jd.damping, Config::DragFrequency, Config::DragDampingRatio,
+                    this->dragGround, body);
+  this->dragJoint = (b2MouseJoint*) body->GetWorld()->CreateJoint(&jd);
+
+  this->draggingBody = body;
+  this->CancelPrediction();
+}
+
+void GameScreen::StopDragging() {
+  if (!this->draggingBody)
+    return;
+
+  // Destroying the ground body destroys the joint. The body stays
+  // where it was dropped.
+  this->dragGround->GetWorld()->DestroyBody(this->dragGround);
+  this->draggingBody->SetLinearVelocity(b2Vec2(0.0, 0.0));
+  this->draggingBody->SetAngularVelocity(0.0);
+
+  this->draggingBody = nullptr;
+  this->dragGround = nullptr;
+  this->dragJoint = nullptr;
+  this->CancelPrediction();
+}
+
+void GameScreen::Pause() {
+  if (!this->paused)
+    this->TogglePause();
 }
 
 void GameScreen::SetScore(int score) {
@@ -343,55 +480,87 @@ void GameScreen::SetTimeRemaining(int time) {
 
   int minutes = this->timeRemaining / 60;
   int seconds = this->timeRemaining % 60;
-  stringstream ss;
-  ss << setw(2) << setfill('0') << minutes
-     << setw(0) << ":"
-     << setw(2) << setfill('0') << seconds;
-  this->timeLabel->SetText(ss.str());
+  this->timeLabel->SetText(FrameArena::Get().Format("%02d:%02d", minutes, seconds));
 
   // Check for game over.
   if (this->timeRemaining == 0) {
     this->gameOverLabel->SetVisible(true);
 
-    for (auto e : this->entities)
-      if (e->isPlanet)
-        Mix_Pause(e->planetWhooshChannel);
+    for (auto &audio : this->entities.audioEmitters)
+      Mix_Pause(audio.channel);
 
     return;
   }
 }
 
-b2Vec2 GameScreen::GetRandomPosition() {
-  const float MIN_DISTANCE = 8;
-
-  int wpixels, hpixels;
-  SDL_GetWindowSize(this->window, &wpixels, &hpixels);
+// Layers of the spawn placer.
+const int SPAWN_LAYER_BODIES = 0;
+const int SPAWN_LAYER_COLLECTIBLES = 1;
 
-  // Get window dimensions in meters.
-  float width = wpixels / this->camera.ppm;
-  float height = hpixels / this->camera.ppm;
+void GameScreen::EntityCreated(EntityPool *pool, Entity *e) {
+  if ((e->type == EntityType::SUN || e->type == EntityType::PLANET) && e->body) {
+    float r = e->body->GetFixtureList()->GetShape()->m_radius;
+    this->spawnPlacer.Add(e->handle, e->body->GetPosition(), r + Config::SpawnDistance, SPAWN_LAYER_BODIES);
+  }
+  else if (e->type == EntityType::COLLECTIBLE) {
+    const Transform *t = this->entities.transforms.Get(e->handle);
+    if (t)
+      this->spawnPlacer.Add(e->handle, t->pos, Config::CollectibleSpacing, SPAWN_LAYER_COLLECTIBLES);
+  }
+}
 
-  b2Vec2 pos;
-  while (true) {
-    // Choose a random position for the collectible.
-    pos.x = this->camera.pos.x + (float) rand() / RAND_MAX * width;
-    pos.y = this->camera.pos.y + (float) rand() / RAND_MAX * height;
+void GameScreen::EntityDestroyed(EntityPool *pool, Entity *e) {
+  this->spawnPlacer.Remove(e->handle);
+}
 
-    // Retry if the chosen position is to close to a sun or a planet.
-    for (auto e : this->entities)
-      if (e->isSun || e->isPlanet) {
-        // Get sun/planet radius.
-        float r = e->body->GetFixtureList()->GetShape()->m_radius;
-
-        // If distance from the surface (indicated by the '+r') is
-        // less than minimum distance, retry.
-        if ((e->body->GetPosition() - pos).Length() + r < MIN_DISTANCE);
-          continue;
-      }
+void GameScreen::UpdateSpawnObstacles() {
+  // The grid covers the largest view the camera can have.
+  float width, height;
+  CameraController::GetMaxSize(ViewState::GetWindowWidth(),
+                               ViewState::GetWindowHeight(),
+                               width,
+                               height);
+  b2AABB area;
+  area.lowerBound.Set(-width / 2.0, -height / 2.0);
+  area.upperBound.Set(width / 2.0, height / 2.0);
+
+  const b2AABB &current = this->spawnPlacer.GetArea();
+  if (current.lowerBound != area.lowerBound || current.upperBound != area.upperBound)
+    this->spawnPlacer.SetArea(area);
+
+  // Only the sun and the planets move. Those that haven't moved much
+  // are left alone.
+  auto &sources = this->entities.gravitySources;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const Transform *t = this->entities.transforms.Get(sources.GetOwner(i));
+    if (t && t->body)
+      this->spawnPlacer.Move(sources.GetOwner(i), t->body->GetPosition());
+  }
 
-    break;
+  auto &receivers = this->entities.gravityReceivers;
+  for (size_t i = 0; i < receivers.size(); ++i) {
+    const Transform *t = this->entities.transforms.Get(receivers.GetOwner(i));
+    if (t && t->body)
+      this->spawnPlacer.Move(receivers.GetOwner(i), t->body->GetPosition());
   }
+}
+
+b2Vec2 GameScreen::GetRandomPosition(bool awayFromCollectibles) {
+  // Sample from the visible area, away from the surface of suns and
+  // planets.
+  b2AABB view;
+  view.lowerBound = this->camera.pos;
+  view.upperBound = this->camera.pos +
+    b2Vec2(ViewState::GetWindowWidth() / this->camera.ppm,
+           ViewState::GetWindowHeight() / this->camera.ppm);
 
+  unsigned layers = 1 << SPAWN_LAYER_BODIES;
+  if (awayFromCollectibles)
+    layers |= 1 << SPAWN_LAYER_COLLECTIBLES;
+
+  // If there's no room anywhere, the position is just random.
+  b2Vec2 pos;
+  this->spawnPlacer.Sample(view, layers, pos);
   return pos;
 }
 
@@ -415,12 +584,12 @@ void GameScreen::SpawnPlanet() {
   v0.Normalize(); // normalize it
   v0 *= 25; // and set the initial speed.
 
-  Entity *planet = Entity::CreatePlanet(&this->world,
-                                        pos,
-                                        2.0,
-                                        1.0,
-                                        v0);
-  this->entities.push_back(planet);
+  Entity::CreatePlanet(&this->entities,
+                       &this->world,
+                       pos,
+                       2.0,
+                       1.0,
+                       v0);
 }
 
 void GameScreen::SwitchScreen(const map<string, string> &lastState) {
@@ -443,14 +612,12 @@ void GameScreen::HandleEvent(const SDL_Event &e) {
   case SDL_MOUSEBUTTONDOWN:
     if (e.button.button == SDL_BUTTON_LEFT) {
       SDL_GetMouseState(&x, &y);
-      b2Vec2 p = this->camera.PointToWorld(x, y, this->window);
-      b2Body *b = GetBodyFromPoint(p, &this->world);
+      b2Vec2 p = this->camera.PointToWorld(x, y);
+      b2Body *b = GetBodyFromPoint(p, this->shards);
       if (b) {
-        Entity *e = (Entity*) b->GetUserData().pointer;
-        if (e->isSun && !this->paused) {
-          this->draggingBody = b;
-          this->draggingOffset = p - b->GetPosition();
-        }
+        Entity *e = this->entities.Get(EntityHandle::FromBody(b));
+        if (e && e->type == EntityType::SUN && !this->paused)
+          this->StartDragging(b, p);
       }
 
       this->mouseDown = true;
@@ -460,16 +627,16 @@ void GameScreen::HandleEvent(const SDL_Event &e) {
     break;
 
   case SDL_MOUSEMOTION:
-    if (this->draggingBody) {
-      SDL_GetMouseState(&x, &y);
-      b2Vec2 p = this->camera.PointToWorld(x, y, this->window);
-      this->draggingBody->SetTransform(p - this->draggingOffset, 0.0);
-    }
+    SDL_GetMouseState(&x, &y);
+    if (this->draggingBody)
+      this->dragJoint->SetTarget(this->camera.PointToWorld(x, y));
+    else
+      this->UpdateHover(x, y);
     break;
 
   case SDL_MOUSEBUTTONUP:
     if (e.button.button == SDL_BUTTON_LEFT) {
-      this->draggingBody = nullptr;
+      this->StopDragging();
 
       SDL_GetMouseState(&x, &y);
       if (mouseDown && abs(mouseDownX - x) <= 2 && abs(mouseDownY - y) <= 2) { // It's a click.
@@ -490,17 +657,66 @@ void GameScreen::HandleEvent(const SDL_Event &e) {
     case SDLK_n:
       this->stepOnce = true;
       break;
+    case SDLK_r:
+      if (!e.key.repeat)
+        this->StartRewind();
+      break;
+#ifndef RELEASE_BUILD
+    case SDLK_F9:
+      this->CheckSaveRoundTrip();
+      break;
+    case SDLK_F6:
+      this->SetOrbitalIntegrator(!this->orbitalIntegrator);
+      DEBUG_MSG("Orbital integrator " << (this->orbitalIntegrator ? "on" : "off") << ".");
+      break;
+
+    case SDLK_F5:
+      this->SetMutualGravity(!this->mutualGravity);
+      DEBUG_MSG("Mutual gravity " << (this->mutualGravity ? "on" : "off") << ".");
+      break;
+
+    case SDLK_F4:
+      this->SetBallisticEnemies(!this->ballisticEnemies);
+      DEBUG_MSG("Ballistic enemies " << (this->ballisticEnemies ? "on" : "off") << ".");
+      break;
+
+    case SDLK_F3:
+      // Load the world up, to see how the pair, contact and island
+      // counts hold up.
+      for (int i = 0; i < 50; ++i) {
+        this->AddRandomCollectible();
+        this->AddRandomEnemy();
+      }
+      break;
+#endif
     }
     break;
 
-  case SDL_WINDOWEVENT:
-    if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-      this->FixCamera();
-    }
+  case SDL_KEYUP:
+    if (e.key.keysym.sym == SDLK_r)
+      this->StopRewind();
     break;
   } // switch (e.type)
 }
 
+void GameScreen::UpdateHover(int x, int y) {
+  EntityHandle hover;
+
+  if (!this->paused) {
+    b2Vec2 p = this->camera.PointToWorld(x, y);
+    b2Body *b = GetBodyFromPoint(p, this->shards);
+    if (b) {
+      Entity *e = this->entities.Get(EntityHandle::FromBody(b));
+
+      // Only draggable entities are highlighted.
+      if (e && e->type == EntityType::SUN)
+        hover = e->handle;
+    }
+  }
+
+  this->hoverEntity = hover;
+}
+
 void GameScreen::HandleWidgetEvent(int event_type, Widget *widget) {
   switch (event_type) {
   case BUTTON_CLICK:
@@ -539,7 +755,8 @@ void GameScreen::Reset() {
   this->camera.pos.Set(-50.0, -50.0);
   this->camera.ppm = 10.0;
 
-  this->draggingBody = nullptr;
+  this->StopDragging();
+  this->hoverEntity = EntityHandle();
   this->stepOnce = false;
   this->physicsTimeAccumulator = 0.0;
   this->scoreAccumulator = 0;
@@ -547,48 +764,42 @@ void GameScreen::Reset() {
   this->livesLabel->SetTexture(ResourceCache::GetTexture("lives3"));
   this->spawnPlanet = false;
 
-  // Remove existing entities.
-  for (auto e : this->entities) {
-    if (e->hasPhysics)
-      this->world.DestroyBody(e->body);
-    delete e;
-  }
-  this->entities.clear();
+  // Remove existing entities, and their ghosts in the other shards.
+  this->shards.Clear();
+  for (auto e : this->entities)
+    if (e->body)
+      e->body->GetWorld()->DestroyBody(e->body);
+  this->entities.Clear();
   this->toBeRemoved.clear();
+  this->contactQueue.Clear();
+  this->planetSunContact = false;
+  this->rewinding = false;
+  this->ClearRewindHistory();
 
-  this->sun = Entity::CreateSun(&this->world,
+  this->sun = Entity::CreateSun(&this->entities,
+                                &this->world,
                                 b2Vec2(0.0, 0.0),
                                 6.0,
                                 1000.0,
                                 130000.0);
-  this->entities.push_back(this->sun);
-
-  this->entities.push_back(Entity::CreatePlanet(&this->world,
-                                                b2Vec2(20.0, 20.0),
-                                                2.0,
-                                                1.0));
-
-  Timer::PauseAll();
-  this->FixCamera();
-
-  int winw, winh;
-  SDL_GetWindowSize(window, &winw, &winh);
 
-  // Update OpenGL viewport.
-  glViewport(0, 0, winw, winh);
+  Entity::CreatePlanet(&this->entities,
+                       &this->world,
+                       b2Vec2(20.0, 20.0),
+                       2.0,
+                       1.0);
+  this->UpdateSpawnObstacles();
 
-  // Update window size in shader.
-  auto program = ResourceCache::texturedPolygonProgram;
-  glUseProgram(program);
-  GLuint resolutionUniform = glGetUniformLocation(program, "resolution");
-  glUniform2f(resolutionUniform, winw, winh);
-  glUseProgram(0);
+  this->gameClock.Pause();
+  this->cameraController.Snap();
+  this->UpdateCamera(0.0);
 
   for (auto w : this->widgets)
     w->Reset();
 
 #ifndef RELEASE_BUILD
   this->fpsLabel->SetVisible(!this->paused);
+  this->statsLabel->SetVisible(!this->paused);
 #endif
   this->continueLabel->SetVisible(this->paused);
   this->pauseSign->SetVisible(this->paused);
@@ -598,71 +809,142 @@ void GameScreen::Reset() {
 }
 
 void GameScreen::Save(ostream &s) const {
-  SaveMap(this->state, s);
-
-  WRITE(this->time, s);
-  WRITE(this->score, s);
-  WRITE(this->timeRemaining, s);
-  WRITE(this->paused, s);
-  WRITE(this->camera.pos.x, s);
-  WRITE(this->camera.pos.y, s);
-  WRITE(this->camera.ppm, s);
-  WRITE(this->physicsTimeAccumulator, s);
-  WRITE(this->scoreAccumulator, s);
-  WRITE(this->lives, s);
-  WRITE(this->spawnPlanet, s);
-
-  size_t size = this->entities.size();
-  WRITE(size, s);
-  for (auto e : this->entities)
-    e->Save(s);
+  SaveFileWriter w(s);
+
+  w.BeginChunk("GAME");
+  w.WriteMap(this->state);
+  w.Write(this->time);
+  w.Write((int32_t) this->score);
+  w.Write((int32_t) this->timeRemaining);
+  w.Write((uint8_t) this->paused);
+  w.Write(this->camera.pos);
+  w.Write(this->camera.ppm);
+  w.Write(this->physicsTimeAccumulator);
+  w.Write(this->scoreAccumulator);
+  w.Write((int32_t) this->lives);
+  w.Write((uint8_t) this->spawnPlanet);
+  w.Write((uint8_t) this->planetSunContact);
+  w.EndChunk();
+
+  SavedWorld::Write(w, this->entities);
 }
 
 void GameScreen::Load(istream &s) {
-  LoadMap(this->state, s);
-
-  READ(this->time, s);
-  READ(this->score, s);
-  this->SetScore(this->score);
-  READ(this->timeRemaining, s);
-  this->SetTimeRemaining(this->timeRemaining);
-  READ(this->paused, s);
-  READ(this->camera.pos.x, s);
-  READ(this->camera.pos.y, s);
-  READ(this->camera.ppm, s);
-  READ(this->physicsTimeAccumulator, s);
-  READ(this->scoreAccumulator, s);
-  READ(this->lives, s);
-  READ(this->spawnPlanet, s);
-
-  this->entities.clear();
-  this->world = b2World(b2Vec2(0.0, 0.0));
-  Entity *e;
-  size_t entityCount;
-  READ(entityCount, s);
-  for (int i = 0; i < entityCount; ++i) {
-    e = new Entity;
-    e->Load(s, &this->world);
-    this->entities.push_back(e);
-
-    if (e->isSun)
+  // Read and check the whole file before touching the current game.
+  SaveFileReader r(s);
+
+  map<string, string> state;
+  float time, physicsTimeAccumulator, scoreAccumulator;
+  Camera camera = this->camera;
+  int32_t score, timeRemaining, lives;
+  uint8_t paused, spawnPlanet, planetSunContact;
+  r.OpenChunk("GAME");
+  r.ReadMap(state);
+  r.Read(time);
+  r.Read(score);
+  r.Read(timeRemaining);
+  r.Read(paused);
+  r.Read(camera.pos);
+  r.Read(camera.ppm);
+  r.Read(physicsTimeAccumulator);
+  r.Read(scoreAccumulator);
+  r.Read(lives);
+  r.Read(spawnPlanet);
+  r.Read(planetSunContact);
+
+  if (!b2IsValid(time) || !b2IsValid(camera.pos.x) || !b2IsValid(camera.pos.y) ||
+      !b2IsValid(camera.ppm) || camera.ppm <= 0.0 ||
+      !b2IsValid(physicsTimeAccumulator) || !b2IsValid(scoreAccumulator))
+    throw runtime_error("Invalid game state in save file.");
+
+  SavedWorld world;
+  world.Read(r);
+
+  // Nothing can fail from here on.
+  this->state = state;
+  this->time = time;
+  this->camera = camera;
+  this->physicsTimeAccumulator = physicsTimeAccumulator;
+  this->scoreAccumulator = scoreAccumulator;
+  this->SetScore(score);
+  this->SetTimeRemaining(timeRemaining);
+  this->paused = paused;
+  this->lives = lives;
+  this->spawnPlanet = spawnPlanet;
+  this->planetSunContact = planetSunContact;
+
+  // Remove existing entities, and their ghosts in the other shards.
+  this->StopDragging();
+  this->shards.Clear();
+  for (auto e : this->entities)
+    if (e->body)
+      e->body->GetWorld()->DestroyBody(e->body);
+  this->entities.Clear();
+  this->toBeRemoved.clear();
+  this->contactQueue.Clear();
+  this->hoverEntity = EntityHandle();
+  this->rewinding = false;
+  this->ClearRewindHistory();
+  this->cameraController.Snap();
+
+  world.Create(this->entities, &this->world);
+  this->UpdateSpawnObstacles();
+
+  this->sun = nullptr;
+  for (auto e : this->entities)
+    if (e->type == EntityType::SUN)
       this->sun = e;
-  }
+
+  // Sprites and sounds are not saved; recreate them.
+  for (auto e : this->entities)
+    Entity::AddPresentation(&this->entities, e);
 
   if (this->paused)
-    Timer::PauseAll();
+    for (auto &audio : this->entities.audioEmitters)
+      Mix_Pause(audio.channel);
+
+#ifndef RELEASE_BUILD
+  this->fpsLabel->SetVisible(!this->paused);
+  this->statsLabel->SetVisible(!this->paused);
+#endif
+  this->continueLabel->SetVisible(this->paused);
+  this->pauseSign->SetVisible(this->paused);
+  this->endGameButton->SetVisible(this->paused);
+  this->muteButton->SetVisible(this->paused);
+
+  this->gameClock.SetPaused(this->paused);
+}
+
+#ifndef RELEASE_BUILD
+void GameScreen::CheckSaveRoundTrip() {
+  stringstream first, second;
+  this->Save(first);
+  this->Load(first);
+  this->Save(second);
+
+  if (first.str() == second.str())
+    DEBUG_MSG("Save round-trip OK (" << first.str().size() << " bytes, "
+              << this->entities.size() << " entities).")
   else
-    Timer::UnpauseAll();
+    DEBUG_MSG("Save round-trip FAILED: saves differ ("
+              << first.str().size() << " vs " << second.str().size() << " bytes).")
 }
+#endif
 
 void GameScreen::Advance(float dt) {
-  Timer::CheckAll();
+  // Fires the timers, unless the game is paused.
+  this->gameClock.Advance(dt);
 
   if (this->gameOverLabel->GetVisible())
     return;
 
-  for (auto w : this->widgets)
-    w->Advance(dt);
+  {
+    ALLOCATION_SCOPE("widgets");
+    for (auto w : this->widgets)
+      w->Advance(dt);
+  }
+
+  this->UpdateCamera(dt);
 
   if (this->state["name"] == "game-over")
     return;
@@ -671,33 +953,55 @@ void GameScreen::Advance(float dt) {
     return;
 
   // Set planet "whooshing" volume.
-  for (auto e : this->entities)
-    if (e->isPlanet) {
-      float MIN_DISTANCE = 30.0f;
-      float MIN_SPEED = 20.0f;
-      float MAX_SPEED = 45.0f;
-
-      int vol = 0;
-      float speed = (e->body->GetLinearVelocity() - this->sun->body->GetLinearVelocity()).Length();
-      if (speed < MIN_SPEED)
-        vol = 0;
-      else if (speed > MAX_SPEED)
-        vol = MIX_MAX_VOLUME;
-      else
-        vol = MIX_MAX_VOLUME * (speed - MIN_SPEED) / (MAX_SPEED - MIN_SPEED);
-
-      float distance = (e->body->GetPosition() - this->sun->body->GetPosition()).Length();
-      if (distance > MIN_DISTANCE)
-        vol = 0;
-      else
-        vol = vol * ((MIN_DISTANCE - distance) / MIN_DISTANCE);
+  auto &emitters = this->entities.audioEmitters;
+  for (size_t i = 0; i < emitters.size(); ++i) {
+    Entity *e = this->entities.Get(emitters.GetOwner(i));
+    const AudioEmitter &audio = emitters[i];
+    if (!e || !e->body)
+      continue;
+
+    float MIN_DISTANCE = 30.0f;
+    float MIN_SPEED = 20.0f;
+    float MAX_SPEED = 45.0f;
+
+    int vol = 0;
+    float speed = (e->body->GetLinearVelocity() - this->sun->body->GetLinearVelocity()).Length();
+    if (speed < MIN_SPEED)
+      vol = 0;
+    else if (speed > MAX_SPEED)
+      vol = MIX_MAX_VOLUME;
+    else
+      vol = MIX_MAX_VOLUME * (speed - MIN_SPEED) / (MAX_SPEED - MIN_SPEED);
+
+    float distance = (e->body->GetPosition() - this->sun->body->GetPosition()).Length();
+    if (distance > MIN_DISTANCE)
+      vol = 0;
+    else
+      vol = vol * ((MIN_DISTANCE - distance) / MIN_DISTANCE);
+
+    if (!mute)
+      Mix_Volume(audio.channel, vol);
+    else
+      Mix_Volume(audio.channel, 0);
+  }
 
-      if (!mute)
-        Mix_Volume(e->planetWhooshChannel, vol);
-      else
-        Mix_Volume(e->planetWhooshChannel, 0);
+  // When rewinding, restore snapshots at the same rate they were
+  // recorded instead of advancing the world.
+  if (this->rewinding) {
+    this->rewindAccumulator += dt;
+    while (this->rewindAccumulator >= Config::RewindInterval) {
+      this->rewindAccumulator -= Config::RewindInterval;
+      if (!this->RewindOnce()) {
+        this->StopRewind();
+        break;
+      }
     }
 
+    this->UpdateSpawnObstacles();
+    this->stepOnce = false;
+    return;
+  }
+
   // Spawn new planet if needed.
   if (this->spawnPlanet) {
     this->SpawnPlanet();
@@ -705,11 +1009,12 @@ void GameScreen::Advance(float dt) {
   }
 
   // Advance physics.
+  float startTime = this->time;
   this->physicsTimeAccumulator += dt;
   while (this->physicsTimeAccumulator >= Config::PhysicsTimeStep) {
     // Update score.
     for (auto e : this->entities)
-      if (e->isPlanet) {
+      if (e->type == EntityType::PLANET) {
         float v = e->body->GetLinearVelocityFromWorldPoint(e->body->GetPosition()).Length();
         float d = (e->body->GetPosition() - this->sun->body->GetPosition()).Length();
         float diff = v / d;
@@ -722,235 +1027,575 @@ void GameScreen::Advance(float dt) {
         }
       }
 
-    // Apply forces.
-    b2Vec2 gravity;
-    for (auto e : this->entities) {
-      if (e->isAffectedByGravity) {
-        gravity.Set(0.0, 0.0);
-        for (auto s : this->entities) {
-          if (s->hasGravity) {
-            b2Vec2 n = s->body->GetPosition() - e->body->GetPosition();
-            float r2 = n.LengthSquared();
-            n.Normalize();
-            gravity += s->gravityCoeff / r2 * n;
-          }
-        }
-
-        e->body->ApplyForce(gravity, e->body->GetWorldCenter(), true);
-      }
-    }
-
-    this->world.Step(Config::PhysicsTimeStep, 10, 10);
+    // Apply forces, or move the planets along their orbits ourselves
+    // and leave only the collisions to Box2D.
+    if (this->mutualGravity)
+      this->ApplyMutualGravity();
+    else if (this->orbitalIntegrator)
+      this->IntegrateOrbits(Config::PhysicsTimeStep);
+    else
+      Systems::ApplyGravity(this->entities, this->sourceScratch);
+
+    this->promotedCount += Systems::AdvanceBallistic(this->entities,
+                                                     &this->world,
+                                                     Config::PhysicsTimeStep,
+                                                     this->targetScratch,
+                                                     this->promoteScratch);
+    this->shards.Step(Config::PhysicsTimeStep, 10, 10);
+    Systems::SyncTransforms(this->entities);
     this->time += Config::PhysicsTimeStep;
 
-    this->FixCamera();
+    // Run the game logic for the contacts recorded during the step.
+    this->ProcessContactEvents();
 
-    // Remove out of bounds planets
-    int winw, winh;
-    SDL_GetWindowSize(this->window, &winw, &winh);
-    float width = winw / this->camera.ppm;
-    float height = winh / this->camera.ppm;
-    float minx = this->camera.pos.x;
-    float maxx = this->camera.pos.x + width;
-    float miny = this->camera.pos.y;
-    float maxy = this->camera.pos.y + height;
+    this->RemoveMarkedEntities();
 
-    for (auto e : this->entities)
-      if (e->isPlanet) {
-        b2Vec2 pos = e->body->GetPosition();
-        float r = e->body->GetFixtureList()->GetShape()->m_radius;
-
-        //if (pos.x + r <= maxx && pos.x - r && minx && pos.y + r <= maxy && pos.y - r >= miny)
-        //  continue;
-
-        if ((pos.x + r >= minx && pos.x + r <= maxx && pos.y + r >= miny && pos.y + r <= maxy) ||
-            (pos.x - r >= minx && pos.x - r <= maxx && pos.y + r >= miny && pos.y + r <= maxy) ||
-            (pos.x - r >= minx && pos.x - r <= maxx && pos.y - r >= miny && pos.y - r <= maxy) ||
-            (pos.x + r >= minx && pos.x + r <= maxx && pos.y - r >= miny && pos.y - r <= maxy))
-          continue;
-
-        bool trailPointVisible = false;
-        for (auto &tp : e->trail.points) {
-          if ((tp.pos.x + r >= minx && tp.pos.x + r <= maxx && tp.pos.y + r >= miny && tp.pos.y + r <= maxy) ||
-              (tp.pos.x - r >= minx && tp.pos.x - r <= maxx && tp.pos.y + r >= miny && tp.pos.y + r <= maxy) ||
-              (tp.pos.x - r >= minx && tp.pos.x - r <= maxx && tp.pos.y - r >= miny && tp.pos.y - r <= maxy) ||
-              (tp.pos.x + r >= minx && tp.pos.x + r <= maxx && tp.pos.y - r >= miny && tp.pos.y - r <= maxy))
-            trailPointVisible = true;
-          break;
-        }
-        if (trailPointVisible || e->trail.points.size() == 0)
-          continue;
+    // Update the trails.
+    Systems::UpdateTrails(this->entities, this->time);
 
-        this->DiscardPlanet(e);
-      }
+    this->physicsTimeAccumulator -= Config::PhysicsTimeStep;
 
-    // Remove and properly destroy entities marked to be removed.
-    for (auto e : this->toBeRemoved) {
-      if (e->hasPhysics)
-        this->world.DestroyBody(e->body);
-      delete e;
-      this->entities.erase(find(this->entities.begin(),
-                                this->entities.end(),
-                                e));
+    if (++this->rewindStepCounter >= Config::RewindInterval / Config::PhysicsTimeStep) {
+      this->RecordRewindSnapshot();
+      this->rewindStepCounter = 0;
     }
+  }
 
-    // Update the trails.
-    UpdateTrails();
-
-    this->toBeRemoved.clear();
-    this->physicsTimeAccumulator -= Config::PhysicsTimeStep;
+  // Remove whatever has left the world or expired, and move the
+  // spawn obstacles along, once per frame.
+  if (this->time > startTime) {
+    this->UpdateLifetimes(this->time - startTime);
+    this->RemoveMarkedEntities();
+    this->UpdateSpawnObstacles();
   }
 
+  // Predict where the planets are going while the sun is being
+  // dragged. This only copies a few positions, and only when the sun
+  // has moved; the work is done in the background.
+  if (this->draggingBody)
+    this->RequestPrediction();
+
   this->stepOnce = false;
 }
 
+bool GameScreen::IsDirty() const {
+  // While paused, only events (or the camera settling after a resize)
+  // change anything.
+  return this->dirty || !this->paused || this->rewinding || this->cameraController.IsMoving();
+}
+
 void GameScreen::Render(Renderer *renderer) {
   renderer->SetCamera(this->camera);
 
   this->background.Draw();
   //this->DrawGrid(renderer);
 
-  for (auto e : this->entities)
-    if (e->hasTrail)
-      this->DrawTrail(renderer, e);
+  // Only draw what overlaps the view.
+  b2AABB view;
+  view.lowerBound = this->camera.pos;
+  view.upperBound = this->camera.pos +
+    b2Vec2(ViewState::GetWindowWidth() / this->camera.ppm,
+           ViewState::GetWindowHeight() / this->camera.ppm);
+  this->drawnCount = 0;
+  this->culledCount = 0;
+
+  auto &trails = this->entities.trails;
+  for (size_t i = 0; i < trails.size(); ++i) {
+    const Transform *t = this->entities.transforms.Get(trails.GetOwner(i));
+    if (!t || !t->body)
+      continue;
+
+    float radius = t->body->GetFixtureList()->GetShape()->m_radius;
+    if (this->IsVisible(view, trails[i].bounds, radius))
+      this->DrawTrail(renderer, trails[i], radius);
+  }
 
-  for (auto e : this->entities)
-    if (e->isDrawable)
-      e->mesh->Draw(e->body->GetPosition(), e->body->GetAngle());
+  // Draw the predicted paths using the latest results, if any.
+  if (this->draggingBody) {
+    this->predictor.GetResults(this->predictedPaths);
+    for (auto &path : this->predictedPaths)
+      if (path.trail.points.size() > 1 && this->IsVisible(view, path.trail.bounds, path.radius))
+        this->DrawTrail(renderer, path.trail, path.radius);
+  }
+
+  // Test the sprites against the view in parallel, then draw the
+  // visible ones in order.
+  auto &sprites = this->entities.sprites;
+  this->visibleScratch.resize(sprites.size());
+  JobSystem::Get().ParallelFor(sprites.size(), 128, [this, &sprites, &view](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const Transform *t = this->entities.transforms.Get(sprites.GetOwner(i));
+        bool visible = t && sprites[i].mesh;
+
+        // The fixture AABBs are kept up to date by the broad-phase.
+        if (visible && t->body) {
+          b2AABB bounds;
+          bounds.lowerBound = bounds.upperBound = t->pos;
+          for (b2Fixture *f = t->body->GetFixtureList(); f; f = f->GetNext())
+            bounds.Combine(f->GetAABB(0));
+          visible = this->IsVisible(view, bounds, 0.0);
+        }
+        else if (visible) {
+          const Ballistic *b = this->entities.ballistics.Get(sprites.GetOwner(i));
+          if (b) {
+            b2AABB bounds;
+            bounds.lowerBound = bounds.upperBound = t->pos;
+            visible = this->IsVisible(view, bounds, b->radius);
+          }
+        }
+
+        this->visibleScratch[i] = visible;
+      }
+    });
+
+  for (size_t i = 0; i < sprites.size(); ++i) {
+    if (!this->visibleScratch[i])
+      continue;
+
+    EntityHandle h = sprites.GetOwner(i);
+    const Transform *t = this->entities.transforms.Get(h);
+    Mesh *mesh = sprites[i].mesh;
+
+    // Fade out entities about to expire.
+    float alpha = 1.0;
+    const Lifetime *lifetime = this->entities.lifetimes.Get(h);
+    if (lifetime && lifetime->policy == ExpiryPolicy::FADE_OUT && lifetime->maxAge > 0.0)
+      alpha = min(1.0f, max(0.0f, (lifetime->maxAge - lifetime->age) / Config::CollectibleFadeTime));
+
+    if (h == this->hoverEntity || (this->draggingBody && this->draggingBody == t->body)) {
+      mesh->SetColor(1.0, 0.85, 0.85, alpha);
+      mesh->Draw(t->pos, t->angle);
+      mesh->SetColor(1.0, 1.0, 1.0, 1.0);
+    }
+    else if (alpha < 1.0) {
+      mesh->SetColor(1.0, 1.0, 1.0, alpha);
+      mesh->Draw(t->pos, t->angle);
+      mesh->SetColor(1.0, 1.0, 1.0, 1.0);
+    }
+    else
+      mesh->Draw(t->pos, t->angle);
+  }
 
   // Count this frame.
   if (!this->paused)
     this->frameCount++;
 
-  for (auto w : this->widgets)
-    w->Render(renderer);
+  {
+    ALLOCATION_SCOPE("widgets");
+    for (auto w : this->widgets)
+      w->Render(renderer);
+  }
 
   renderer->PresentScreen();
 }
 
-void GameScreen::FixCamera() {
+void GameScreen::UpdateCamera(float dt) {
   for (auto e : this->entities)
-    if (e->isPlanet)
-      this->FixCamera(e);
+    if (e->type == EntityType::PLANET)
+      this->cameraController.Track(e->body->GetPosition(),
+                                   e->body->GetLinearVelocity(),
+                                   e->body->GetFixtureList()->GetShape()->m_radius);
+
+  this->cameraController.Update(dt,
+                                ViewState::GetWindowWidth(),
+                                ViewState::GetWindowHeight(),
+                                this->camera);
 }
 
-void GameScreen::FixCamera(Entity *e) {
-  int winw, winh;
-  SDL_GetWindowSize(this->window, &winw, &winh);
-  float ratio = ((float) winw) / winh;
+GameCounters GameScreen::GetCounters() const {
+  GameCounters counters;
+  counters.time = this->time;
+  counters.score = this->score;
+  counters.timeRemaining = this->timeRemaining;
+  counters.scoreAccumulator = this->scoreAccumulator;
+  counters.lives = this->lives;
+  counters.spawnPlanet = this->spawnPlanet;
+  counters.planetSunContact = this->planetSunContact;
+  return counters;
+}
 
-  float width, height;
+void GameScreen::SetCounters(const GameCounters &counters) {
+  this->time = counters.time;
+  this->SetScore(counters.score);
+  this->SetTimeRemaining(counters.timeRemaining);
+  this->scoreAccumulator = counters.scoreAccumulator;
+  if (this->lives != counters.lives) {
+    this->lives = counters.lives;
+    this->livesLabel->SetTexture(ResourceCache::GetTexture("lives" + to_string(this->lives)));
+  }
+  this->spawnPlanet = counters.spawnPlanet;
+  this->planetSunContact = counters.planetSunContact;
+}
 
-  b2Vec2 upper(this->camera.pos.x + winw / this->camera.ppm,
-               this->camera.pos.y + winh / this->camera.ppm);
-  b2Vec2 lower(this->camera.pos.x, this->camera.pos.y);
+void GameScreen::RecordRewindSnapshot() {
+  size_t capacity = this->rewindHistory.size();
+  this->rewindHistory[this->rewindHead].Capture(this->entities, this->GetCounters());
+  this->rewindHead = (this->rewindHead + 1) % capacity;
+  if (this->rewindCount < capacity)
+    this->rewindCount++;
+}
 
-  auto r = e->body->GetFixtureList()->GetShape()->m_radius;
+bool GameScreen::RewindOnce() {
+  if (this->rewindCount == 0)
+    return false;
 
-  auto pos = e->body->GetPosition();
+  size_t capacity = this->rewindHistory.size();
+  size_t i = (this->rewindHead + capacity - 1) % capacity;
+  this->rewindCreated.clear();
+  this->rewindHistory[i].Restore(this->entities, &this->world, this->rewindCreated);
 
-  float maxx, maxy, minx, miny;
+  // Entities destroyed since the snapshot come back without their
+  // sprites and sounds.
+  for (auto e : this->rewindCreated) {
+    Entity::AddPresentation(&this->entities, e);
+    if (e->type == EntityType::SUN)
+      this->sun = e;
+  }
 
-  if (pos.x + r + 2 > upper.x ||
-      pos.y + r + 2 > upper.y ||
-      pos.x - r - 2 < lower.x ||
-      pos.y - r - 2 < lower.y)
-  {
-    maxx = max(pos.x + r + 2, upper.x);
-    maxy = max(pos.y + r + 2, upper.y);
-    minx = min(pos.x - r - 2, lower.x);
-    miny = min(pos.y - r - 2, lower.y);
+  this->rewindHead = i;
+  this->rewindCount--;
+  this->SetCounters(this->rewindHistory[i].counters);
+
+  // Forget about anything that happened in the future.
+  this->toBeRemoved.clear();
+  this->contactQueue.Clear();
+  this->planetSunContact = this->rewindHistory[i].counters.planetSunContact;
+  if (!this->entities.Get(this->hoverEntity))
+    this->hoverEntity = EntityHandle();
+
+  return true;
+}
+
+void GameScreen::StartRewind() {
+  if (this->paused || this->rewinding)
+    return;
+
+  this->rewinding = true;
+  this->rewindAccumulator = 0.0;
+  this->StopDragging();
+  this->gameClock.Pause();
+}
+
+void GameScreen::StopRewind() {
+  if (!this->rewinding)
+    return;
+
+  this->rewinding = false;
+  this->physicsTimeAccumulator = 0.0;
+  this->rewindStepCounter = 0;
+  this->gameClock.Resume();
+}
+
+void GameScreen::ClearRewindHistory() {
+  this->rewindHead = 0;
+  this->rewindCount = 0;
+  this->rewindStepCounter = 0;
+}
+
+void GameScreen::RemoveMarkedEntities() {
+  // Remove and properly destroy entities marked to be removed. An
+  // entity might have been marked more than once, in which case the
+  // handle has gone stale by the second time.
+  for (auto h : this->toBeRemoved) {
+    Entity *e = this->entities.Get(h);
+    if (!e)
+      continue;
+
+    if (e->body)
+      e->body->GetWorld()->DestroyBody(e->body);
+    this->entities.Destroy(e);
   }
-  else {
-    maxx = min(pos.x + r + 2, upper.x);
-    maxy = min(pos.y + r + 2, upper.y);
-    minx = max(pos.x - r - 2, lower.x);
-    miny = max(pos.y - r - 2, lower.y);
+  this->toBeRemoved.clear();
+
+  // Destroying the bodies might have queued a few "end contact"
+  // events. The removed entities won't be touched.
+  this->ProcessContactEvents();
+}
+
+void GameScreen::UpdateLifetimes(float elapsed) {
+  auto &lifetimes = this->entities.lifetimes;
+  if (lifetimes.size() == 0)
+    return;
+
+  // The world bounds are the largest view the camera can have (since
+  // the camera grows to show anything inside it) plus a margin, so that
+  // enemies coming in from outside the view are not removed.
+  float width, height;
+  CameraController::GetMaxSize(ViewState::GetWindowWidth(),
+                               ViewState::GetWindowHeight(),
+                               width,
+                               height);
+  b2AABB view;
+  view.lowerBound.Set(-width / 2.0, -height / 2.0);
+  view.upperBound.Set(width / 2.0, height / 2.0);
+
+  b2Vec2 margin(Config::WorldBoundsMargin, Config::WorldBoundsMargin);
+  b2AABB bounds;
+  bounds.lowerBound = view.lowerBound - margin;
+  bounds.upperBound = view.upperBound + margin;
+
+  // Find everything inside the bounds with a single broad-phase query.
+  this->boundsScratch.assign(this->entities.GetCapacity(), 0);
+  BoundsQueryCallback callback(this->boundsScratch, view);
+  this->shards.QueryAABB(&callback, bounds);
+
+  for (size_t i = 0; i < lifetimes.size(); ++i) {
+    Lifetime &lifetime = lifetimes[i];
+    EntityHandle h = lifetimes.GetOwner(i);
+    Entity *e = this->entities.Get(h);
+    if (!e)
+      continue;
+
+    lifetime.age += elapsed;
+
+    uint8_t flags = this->boundsScratch[h.GetIndex()];
+    if (!e->body) {
+      // Not in the broad-phase; test the position instead.
+      const Transform *t = this->entities.transforms.Get(h);
+      if (t && ContainsPoint(bounds, t->pos))
+        flags |= BoundsQueryCallback::IN_BOUNDS;
+      if (t && ContainsPoint(view, t->pos))
+        flags |= BoundsQueryCallback::IN_VIEW;
+    }
+
+    bool expired = lifetime.maxAge > 0.0 && lifetime.age >= lifetime.maxAge;
+    if (lifetime.policy == ExpiryPolicy::LOSE_LIFE) {
+      if (!expired && !(flags & BoundsQueryCallback::IN_VIEW) && !this->IsTrailInView(h, view))
+        expired = true;
+    }
+    else if (!(flags & BoundsQueryCallback::IN_BOUNDS))
+      expired = true;
+
+    if (!expired)
+      continue;
+
+    if (lifetime.policy == ExpiryPolicy::LOSE_LIFE)
+      this->DiscardPlanet(e);
+    else
+      this->toBeRemoved.push_back(h);
   }
+}
 
-  auto halfx = max(fabs(maxx), fabs(minx));
-  auto halfy = max(fabs(maxy), fabs(miny));
+bool GameScreen::IsTrailInView(EntityHandle h, const b2AABB &view) const {
+  const Trail *trail = this->entities.trails.Get(h);
+  const Entity *e = this->entities.Get(h);
+  if (!trail || trail->points.size() == 0 || !e || !e->body)
+    return false;
 
-  auto width1 = 2 * halfx;
-  auto height1 = width1 / ratio;
+  float r = e->body->GetFixtureList()->GetShape()->m_radius;
+  b2Vec2 margin(r, r);
+  b2AABB area;
+  area.lowerBound = view.lowerBound - margin;
+  area.upperBound = view.upperBound + margin;
 
-  auto height2 = 2 * halfy;
-  auto width2 = height2 * ratio;
+  // Most of the time the whole trail is either in or out of view.
+  if (!b2TestOverlap(area, trail->bounds))
+    return false;
 
-  if (width1 > width2) {
-    width = width1;
-    height = height1;
+  for (auto &tp : trail->points)
+    if (ContainsPoint(area, tp.pos))
+      return true;
+
+  return false;
+}
+
+void GameScreen::IntegrateOrbits(float dt) {
+  ALLOCATION_SCOPE("gravity");
+  Systems::GatherGravitySources(this->entities, this->sourceScratch);
+
+  auto &receivers = this->entities.gravityReceivers;
+  for (size_t i = 0; i < receivers.size(); ++i) {
+    EntityHandle h = receivers.GetOwner(i);
+    const Transform *t = this->entities.transforms.Get(h);
+    if (!t || !t->body || t->body->GetType() != b2_dynamicBody)
+      continue;
+
+    b2Body *b = t->body;
+    b2Vec2 x = b->GetPosition();
+    float invMass = 1.0 / b->GetMass();
+
+    // If the body isn't where we left it, a collision (or a rewind)
+    // has moved it. Take over its velocity in that case.
+    Orbit *orbit = this->entities.orbits.Get(h);
+    if (!orbit) {
+      orbit = this->entities.orbits.Add(h);
+      orbit->velocity = b->GetLinearVelocity();
+    }
+    else if ((x - orbit->expectedPos).LengthSquared() > 1e-6)
+      orbit->velocity = b->GetLinearVelocity();
+
+    b2Vec2 v = orbit->velocity;
+    b2Vec2 a = Systems::IntegrateOrbit(this->sourceScratch, invMass, dt, x, v);
+
+    // Box2D will move the body by dt times its velocity, unless it
+    // collides with something.
+    b->SetLinearVelocity((1.0f / dt) * (x - b->GetPosition()));
+    orbit->velocity = v;
+    orbit->expectedPos = x;
+    receivers[i].force = b->GetMass() * a;
   }
-  else {
-    width = width2;
-    height = height2;
+}
+
+void GameScreen::ApplyMutualGravity() {
+  ALLOCATION_SCOPE("gravity");
+
+  // Every massive body attracts every other: the sources as well as
+  // the receivers.
+  this->nbodySolver.Clear();
+  this->nbodyScratch.clear();
+  auto &sources = this->entities.gravitySources;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const Transform *t = this->entities.transforms.Get(sources.GetOwner(i));
+    if (t && t->body && t->body->GetType() == b2_dynamicBody)
+      this->nbodyScratch.push_back(sources.GetOwner(i));
   }
 
-  if (width > Config::CameraMaxWidth) {
-    width = Config::CameraMaxWidth;
-    height = width / ratio;
+  auto &receivers = this->entities.gravityReceivers;
+  for (size_t i = 0; i < receivers.size(); ++i) {
+    const Transform *t = this->entities.transforms.Get(receivers.GetOwner(i));
+    if (t && t->body && t->body->GetType() == b2_dynamicBody)
+      this->nbodyScratch.push_back(receivers.GetOwner(i));
   }
-  if (width < Config::CameraMinWidth) {
-    width = Config::CameraMinWidth;
-    height = width / ratio;
+
+  for (auto h : this->nbodyScratch) {
+    b2Body *b = this->entities.transforms.Get(h)->body;
+    this->nbodySolver.Add(b->GetWorldCenter(), b->GetMass());
   }
-  if (height > Config::CameraMaxHeight) {
-    height = Config::CameraMaxHeight;
-    width = height * ratio;
+
+  this->nbodySolver.Solve(Config::GravityConstant, Config::GravitySoftening, JobSystem::Get());
+
+  for (size_t i = 0; i < this->nbodyScratch.size(); ++i) {
+    EntityHandle h = this->nbodyScratch[i];
+    b2Body *b = this->entities.transforms.Get(h)->body;
+    b2Vec2 force = this->nbodySolver.GetForce(i);
+    b->ApplyForce(force, b->GetWorldCenter(), true);
+
+    GravityReceiver *receiver = this->entities.gravityReceivers.Get(h);
+    if (receiver)
+      receiver->force = force;
   }
-  if (height < Config::CameraMinHeight) {
-    height = Config::CameraMinHeight;
-    width = height * ratio;
+}
+
+void GameScreen::SetMutualGravity(bool enabled) {
+  // The orbital integrator only knows about fixed sources.
+  if (enabled && this->orbitalIntegrator)
+    this->SetOrbitalIntegrator(false);
+
+  this->mutualGravity = enabled;
+}
+
+void GameScreen::SetOrbitalIntegrator(bool enabled) {
+  this->orbitalIntegrator = enabled;
+  if (enabled)
+    this->mutualGravity = false;
+
+  // Give the bodies back their real velocity.
+  if (!enabled) {
+    auto &orbits = this->entities.orbits;
+    for (size_t i = 0; i < orbits.size(); ++i) {
+      const Transform *t = this->entities.transforms.Get(orbits.GetOwner(i));
+      if (t && t->body)
+        t->body->SetLinearVelocity(orbits[i].velocity);
+    }
   }
 
-  this->camera.pos.x = - (width / 2.0);
-  this->camera.pos.y = - (height / 2.0);
+  this->entities.orbits.Clear();
+}
 
-  this->camera.ppm = winw / width;
+PredictionGravity GameScreen::GetPredictionGravity() const {
+  if (this->mutualGravity)
+    return PredictionGravity::MUTUAL;
+  if (this->orbitalIntegrator)
+    return PredictionGravity::ORBITAL;
+  return PredictionGravity::FIXED;
+}
 
-  auto program = ResourceCache::texturedPolygonProgram;
+void GameScreen::RequestPrediction() {
+  PredictionGravity gravity = this->GetPredictionGravity();
+  b2Vec2 pos = this->draggingBody->GetPosition();
+  b2Vec2 velocity = this->draggingBody->GetLinearVelocity();
+  size_t bodyCount = this->entities.gravitySources.size() + this->entities.gravityReceivers.size();
+
+  // The last prediction still holds if the dragged body is about where
+  // (and going about as fast as) it was then: the others are following
+  // their predicted paths.
+  float tolerance2 = Config::PredictionTolerance * Config::PredictionTolerance;
+  if (this->predictionRequested &&
+      gravity == this->predictionGravity &&
+      bodyCount == this->predictionBodyCount &&
+      (pos - this->predictionPos).LengthSquared() <= tolerance2 &&
+      (velocity - this->predictionVelocity).LengthSquared() <= tolerance2)
+    return;
 
-  glUseProgram(program);
+  this->predictionRequested = true;
+  this->predictionGravity = gravity;
+  this->predictionPos = pos;
+  this->predictionVelocity = velocity;
+  this->predictionBodyCount = bodyCount;
+
+  // With mutual gravity the sources are bodies like the others, as in
+  // ApplyMutualGravity. Otherwise they stay where they are.
+  this->predictionScratch.clear();
+  if (gravity == PredictionGravity::MUTUAL)
+    this->sourceScratch.clear();
+  else
+    Systems::GatherGravitySources(this->entities, this->sourceScratch);
+
+  auto add = [this, gravity](EntityHandle h) {
+    const Transform *t = this->entities.transforms.Get(h);
+    if (!t || !t->body || t->body->GetType() != b2_dynamicBody)
+      return;
+
+    PredictionBody b;
+    b.handle = h;
+    b.pos = t->body->GetPosition();
+    b.velocity = t->body->GetLinearVelocity();
+    b.mass = t->body->GetMass();
+    b.radius = t->body->GetFixtureList()->GetShape()->m_radius;
+    b.held = t->body == this->draggingBody;
+
+    // The orbital integrator keeps the real velocity.
+    const Orbit *orbit = this->entities.orbits.Get(h);
+    if (gravity == PredictionGravity::ORBITAL && orbit)
+      b.velocity = orbit->velocity;
+
+    this->predictionScratch.push_back(b);
+  };
 
-  GLuint cameraPosUniform = glGetUniformLocation(program, "camera_pos");
-  GLuint ppmUniform = glGetUniformLocation(program, "ppm");
+  if (gravity == PredictionGravity::MUTUAL) {
+    auto &sources = this->entities.gravitySources;
+    for (size_t i = 0; i < sources.size(); ++i)
+      add(sources.GetOwner(i));
+  }
 
-  glUniform2f(cameraPosUniform, this->camera.pos.x, this->camera.pos.y);
-  glUniform1f(ppmUniform, this->camera.ppm);
+  auto &receivers = this->entities.gravityReceivers;
+  for (size_t i = 0; i < receivers.size(); ++i)
+    add(receivers.GetOwner(i));
 
-  glUseProgram(0);
+  this->predictor.Request(gravity, this->sourceScratch, this->predictionScratch);
 }
 
-void GameScreen::UpdateTrails() {
-  for (auto e : this->entities)
-    if (e->hasTrail) {
-      // Remove all the points not in the desired time window.
-      e->trail.points.erase(remove_if(e->trail.points.begin(), e->trail.points.end(),
-                                      [=](const TrailPoint &p) -> bool {
-                                        return p.time < this->time - e->trail.time;
-                                      }),
-                            e->trail.points.end());
-
-      // Add current position to the trail.
-      e->trail.points.push_back(TrailPoint(e->body->GetPosition(), this->time));
-    }
+void GameScreen::CancelPrediction() {
+  this->predictor.Cancel();
+  this->predictedPaths.clear();
+  this->predictionRequested = false;
+}
+
+void GameScreen::SetBallisticEnemies(bool enabled) {
+  this->ballisticEnemies = enabled;
+
+  // Give the existing ones their bodies back, so the two modes can be
+  // compared.
+  if (!enabled)
+    for (auto e : this->entities)
+      if (this->entities.ballistics.Has(e->handle))
+        Entity::Promote(&this->entities, e, &this->world);
 }
 
 void GameScreen::AddRandomCollectible() {
   // Choose a random position, but make sure it is not too close to
   // another collectible.
-  b2Vec2 pos;
-  bool retry;
-  do {
-    retry = false;
-    pos = this->GetRandomPosition();
-    for (auto e : this->entities)
-      if (e->isCollectible) {
-        float distanceSq = (e->body->GetPosition() - pos).LengthSquared();
-        if (distanceSq < 25.0)
-          retry = true;
-      }
-  } while (retry);
+  b2Vec2 pos = this->GetRandomPosition(true);
 
   CollectibleType types[] = {CollectibleType::PLUS_SCORE,
                              CollectibleType::MINUS_SCORE,
@@ -958,14 +1603,15 @@ void GameScreen::AddRandomCollectible() {
                              CollectibleType::MINUS_TIME,
                              CollectibleType::SPAWN_PLANET};
   CollectibleType type = types[rand() % (sizeof(types) / sizeof(types[0]))];
-  this->entities.push_back(Entity::CreateCollectible(&this->world,
-                                                     pos,
-                                                     type));
+  Entity::CreateCollectible(&this->entities,
+                            &this->world,
+                            pos,
+                            type);
 }
 
 void GameScreen::AddRandomEnemy() {
-  int winw, winh;
-  SDL_GetWindowSize(this->window, &winw, &winh);
+  int winw = ViewState::GetWindowWidth();
+  int winh = ViewState::GetWindowHeight();
 
   float dx = frand() * 2.0;
   float dy = frand() * 2.0;
@@ -996,10 +1642,12 @@ void GameScreen::AddRandomEnemy() {
   v *= 20.0;
 
   float angle = atan2(v.y, v.x) - M_PI / 2.0;
-  this->entities.push_back(Entity::CreateEnemyShip(&this->world,
-                                                   pos,
-                                                   v,
-                                                   angle));
+  Entity::CreateEnemyShip(&this->entities,
+                          &this->world,
+                          pos,
+                          v,
+                          angle,
+                          this->ballisticEnemies);
 }
 
 void GameScreen::TimerCallback(float elapsed) {
@@ -1009,18 +1657,85 @@ void GameScreen::TimerCallback(float elapsed) {
     return;
   }
 
-  // Remove out of bounds enemy ships.
-  for (auto e : this->entities)
-    if (e->isEnemy)
-      if (e->body->GetPosition().LengthSquared() > pow(Config::CameraMaxWidth / 2.0, 2) + pow(Config::CameraMaxHeight / 2.0, 2) + 25.0)
-        this->toBeRemoved.push_back(e);
-
   // Update FPS counter.
   this->fps = this->frameCount;
 #ifndef RELEASE_BUILD
     stringstream ss;
     ss << "FPS: " << this->fps;
     this->fpsLabel->SetText(ss.str());
+
+    // Report broad-phase and contact statistics so that the effect of
+    // the collision filters can be verified.
+    int touching = 0;
+    int sensing = 0;
+    for (int i = 0; i < this->shards.GetShardCount(); ++i)
+      for (b2Contact *c = this->shards.GetWorld(i)->GetContactList(); c; c = c->GetNext())
+        if (c->IsTouching()) {
+          if (c->GetFixtureA()->IsSensor() || c->GetFixtureB()->IsSensor())
+            sensing++;
+          else
+            touching++;
+        }
+
+    ss.str("");
+    ss << "entities: " << this->entities.size()
+       << " bodies: " << this->shards.GetBodyCount()
+       << " proxies: " << this->shards.GetProxyCount()
+       << " contacts: " << this->shards.GetContactCount()
+       << " touching: " << touching
+       << " sensing: " << sensing
+       << " islands: " << this->shards.GetIslandCount()
+       << " events: " << this->contactQueue.GetPushedCount()
+       << " dup: " << this->contactQueue.GetDuplicateCount()
+       << " queue: " << this->contactQueue.GetPeakSize()
+       << "/" << this->contactQueue.GetCapacity()
+       << " drawn: " << this->drawnCount
+       << " culled: " << this->culledCount;
+    if (this->shards.GetShardCount() > 1)
+      ss << " shards: " << this->shards.GetShardCount()
+         << " ghosts: " << this->shards.GetGhostCount()
+         << " handoffs: " << this->shards.GetHandoffCount();
+    ss << " ballistic: " << this->entities.ballistics.size()
+       << " promoted: " << this->promotedCount;
+
+    // Total energy of the planets, to check how well the integrator
+    // conserves it. The potential of a force of coeff / r^2 is
+    // -coeff / r.
+    Systems::GatherGravitySources(this->entities, this->sourceScratch);
+    float energy = 0.0;
+    for (size_t i = 0; i < this->entities.gravityReceivers.size(); ++i) {
+      EntityHandle h = this->entities.gravityReceivers.GetOwner(i);
+      const Transform *t = this->entities.transforms.Get(h);
+      if (!t || !t->body)
+        continue;
+
+      const Orbit *orbit = this->entities.orbits.Get(h);
+      b2Vec2 v = orbit ? orbit->velocity : t->body->GetLinearVelocity();
+      energy += 0.5 * t->body->GetMass() * v.LengthSquared();
+      for (auto &s : this->sourceScratch)
+        energy -= s.second / (s.first - t->body->GetPosition()).Length();
+    }
+    ss << " energy: " << energy
+       << (this->mutualGravity ? " (mutual)" : this->orbitalIntegrator ? " (leapfrog)" : " (euler)");
+
+    size_t rewindMemory = 0;
+    for (auto &snapshot : this->rewindHistory)
+      rewindMemory += snapshot.GetMemoryUsage();
+    ss << " rewind: " << this->rewindCount << "/" << this->rewindHistory.size()
+       << " (" << rewindMemory / 1024 << " KiB)";
+
+#ifdef GRAVITY_ALLOC_TRACKING
+    // Heap allocations made on all threads since the last time.
+    ss << " heap: " << AllocationTracker::GetTotalCount() - this->allocationCount << "/s ";
+    AllocationTracker::WriteSummary(ss);
+    this->allocationCount = AllocationTracker::GetTotalCount();
+#endif
+    ss << " arena: " << FrameArena::Get().GetPeak() / 1024
+       << "/" << FrameArena::Get().GetCapacity() / 1024 << " KiB";
+    this->statsLabel->SetText(ss.str());
+    this->contactQueue.ResetStats();
+    this->shards.ResetStats();
+    this->promotedCount = 0;
 #endif
   this->frameCount = 0;
 
@@ -1061,20 +1776,37 @@ void GameScreen::DrawGrid(Renderer *renderer) const {
   renderer->DrawLine(b2Vec2(this->camera.pos.x, y), b2Vec2(upperx, y), 32, 32, 32, 255);*/
 }
 
-void GameScreen::DrawTrail(Renderer *renderer, const Entity *e) const {
-  vector<TrailPoint> points;
+bool GameScreen::IsVisible(const b2AABB &view, const b2AABB &bounds, float margin) {
+  b2AABB b;
+  b.lowerBound = bounds.lowerBound - b2Vec2(margin, margin);
+  b.upperBound = bounds.upperBound + b2Vec2(margin, margin);
+  if (b2TestOverlap(view, b)) {
+    this->drawnCount++;
+    return true;
+  }
 
-  if (!e->hasTrail)
-    return;
+  this->culledCount++;
+  return false;
+}
 
-  if (e->trail.size < e->trail.points.size()) {
-    // Choose 'e->trail.size' points in the 'e->trail.time' time-window.
+void GameScreen::DrawTrail(Renderer *renderer, const Trail &trail, float radius) const {
+  ALLOCATION_SCOPE("trails");
+
+  // The chosen points only live until the end of the frame.
+  ArenaVector<TrailPoint> chosen;
+  const TrailPoint *points = trail.points.data();
+  size_t npoints = trail.points.size();
+  size_t size = max(trail.size, 0);
+
+  if (size < npoints) {
+    chosen.reserve(size);
+    // Choose 'trail.size' points in the 'trail.time' time-window.
 
     // From the rest choose enough, as evenly timed as possible.
-    auto step = e->trail.time / e->trail.size;
-    auto time = e->trail.points.back().time;
-    auto it = e->trail.points.rbegin();
-    while (points.size() < e->trail.size) {
+    auto step = trail.time / size;
+    auto time = trail.points.back().time;
+    auto it = trail.points.rbegin();
+    while (chosen.size() < size) {
       time -= step;
 
       // Go forward among previous locations until we reach one after
@@ -1082,7 +1814,7 @@ void GameScreen::DrawTrail(Renderer *renderer, const Entity *e) const {
       // possible.
       float leastDiff = FLT_MAX;
       TrailPoint closestPoint;
-      for (; it != e->trail.points.rend(); ++it) {
+      for (; it != trail.points.rend(); ++it) {
         if (fabs(it->time - time) < leastDiff) {
           leastDiff = fabs(it->time - time);
           closestPoint = *it;
@@ -1092,7 +1824,7 @@ void GameScreen::DrawTrail(Renderer *renderer, const Entity *e) const {
           break;
       }
 
-      points.push_back(closestPoint);
+      chosen.push_back(closestPoint);
 
       // Continue from this point.
       time = closestPoint.time;
@@ -1100,12 +1832,12 @@ void GameScreen::DrawTrail(Renderer *renderer, const Entity *e) const {
 
     // We have chosen the trail points from the last to the first, so
     // reverse them.
-    std::reverse(points.begin(), points.end());
+    std::reverse(chosen.begin(), chosen.end());
+    points = chosen.data();
+    npoints = chosen.size();
   }
-  else
-    points = e->trail.points;
 
-  float r = e->body->GetFixtureList()->GetShape()->m_radius;
+  float r = radius;
   auto startr = r / 10.0;
   auto endr = r / 2.0;
   r = startr;
@@ -1115,15 +1847,15 @@ void GameScreen::DrawTrail(Renderer *renderer, const Entity *e) const {
   float a = starta;
 
   float dr, da;
-  if (points.size() > 0) {
-    dr = (endr - startr) / points.size();
-    da = (enda - starta) / points.size();
+  if (npoints > 0) {
+    dr = (endr - startr) / npoints;
+    da = (enda - starta) / npoints;
   }
 
-  for (auto &p : points) {
-    float scale_factor = r / e->body->GetFixtureList()->GetShape()->m_radius;
+  for (size_t i = 0; i < npoints; ++i) {
+    float scale_factor = r / radius;
     this->trailPointMesh->SetColor(1.0, 1.0, 1.0, a);
-    this->trailPointMesh->Draw(p.pos, 0.0f, scale_factor);
+    this->trailPointMesh->Draw(points[i].pos, 0.0f, scale_factor);
     r += dr;
     a += da;
   }
@@ -3,8 +3,17 @@
 
 #include "screen.hh"
 #include "camera.hh"
+#include "camera-controller.hh"
 #include "timer.hh"
 #include "entity.hh"
+#include "entity-pool.hh"
+#include "contact-queue.hh"
+#include "physics-shards.hh"
+#include "physics-snapshot.hh"
+#include "trajectory-predictor.hh"
+#include "spawn-placer.hh"
+#include "nbody-solver.hh"
+#include "systems.hh"
 #include "label-widget.hh"
 #include "number-widget.hh"
 #include "image-button-widget.hh"
@@ -12,32 +21,9 @@
 
 #include <box2d/box2d.h>
 
-class GameScreen;
+#include <atomic>
 
-class ContactListener : public b2ContactListener {
-protected:
-  GameScreen *screen;
-  bool inContact;
-
-public:
-  ContactListener(GameScreen *screen);
-
-  virtual void BeginContact(b2Contact *contact);
-  virtual void EndContact(b2Contact *contact);
-
-  void EnemySunContact(Entity *enemy, Entity *sun);
-  void EnemyPlanetContact(Entity *enemy, Entity *sun);
-  void PlanetSunContact(Entity *planet, Entity *sun);
-  void CollectibleSunContact(Entity *collectible, Entity *sun);
-  void CollectiblePlanetContact(Entity *collectible, Entity *planet);
-};
-
-class ContactFilter : public b2ContactFilter {
-public:
-  bool ShouldCollide(b2Fixture *fixtureA, b2Fixture *fixtureB);
-};
-
-class GameScreen : public Screen {
+class GameScreen : public Screen, public EntityListener {
 protected:
   // state variables
   float time;
@@ -45,25 +31,65 @@ protected:
   int timeRemaining;
   bool paused;
   Camera camera;
+  CameraController cameraController;
   float physicsTimeAccumulator;
   float scoreAccumulator;
   int lives;
   bool spawnPlanet;
-  vector<Entity*> entities;
+  EntityPool entities;
 
   // non-state variables
   b2World world;
   b2Body *draggingBody;
-  b2Vec2 draggingOffset;
+  b2Body *dragGround;
+  b2MouseJoint *dragJoint;
+  EntityHandle hoverEntity;
   bool stepOnce;
+  Clock gameClock;
   Timer timer;
+  ContactQueue contactQueue;
   ContactListener contactListener;
-  ContactFilter contactFilter;
+  PhysicsShards shards;
+  bool planetSunContact;
   Entity *sun;
   int frameCount;
+  atomic<int> drawnCount;
+  atomic<int> culledCount;
   int fps;
-  vector<Entity*> toBeRemoved;
+  vector<EntityHandle> toBeRemoved;
+  vector<uint8_t> boundsScratch;
+  vector<uint8_t> visibleScratch;
+  SpawnPlacer spawnPlacer;
+  vector<GravitySourceState> sourceScratch;
+  vector<PredictionBody> predictionScratch;
+  TrajectoryPredictor predictor;
+
+  // What the last prediction was requested for.
+  bool predictionRequested;
+  PredictionGravity predictionGravity;
+  b2Vec2 predictionPos;
+  b2Vec2 predictionVelocity;
+  size_t predictionBodyCount;
+  bool orbitalIntegrator;
+  bool mutualGravity;
+  bool ballisticEnemies;
+  vector<b2AABB> targetScratch;
+  vector<EntityHandle> promoteScratch;
+  int promotedCount;
+  NBodySolver nbodySolver;
+  vector<EntityHandle> nbodyScratch;
+  vector<PredictedPath> predictedPaths;
   Mesh *trailPointMesh;
+
+  // Rewind history. A ring buffer of snapshots, one every
+  // Config::RewindInterval seconds of game time.
+  vector<PhysicsSnapshot> rewindHistory;
+  size_t rewindHead;
+  size_t rewindCount;
+  int rewindStepCounter;
+  bool rewinding;
+  float rewindAccumulator;
+  vector<Entity*> rewindCreated;
   Background background;
   bool mouseDown;
   int mouseDownX;
@@ -74,6 +100,10 @@ protected:
   LabelWidget *timeLabel;
 #ifndef RELEASE_BUILD
   LabelWidget *fpsLabel;
+  LabelWidget *statsLabel;
+#endif
+#ifdef GRAVITY_ALLOC_TRACKING
+  uint64_t allocationCount;
 #endif
   ImageWidget *continueLabel;
   ImageWidget *pauseSign;
@@ -83,24 +113,57 @@ protected:
   ImageWidget *livesLabel;
 
   // methods
-  void FixCamera();
-  void FixCamera(Entity *e);
+  void UpdateCamera(float dt);
   void TimerCallback(float elapsed);
-  void UpdateTrails();
+  void UpdateLifetimes(float elapsed);
+  bool IsTrailInView(EntityHandle h, const b2AABB &view) const;
+  void RemoveMarkedEntities();
+  void IntegrateOrbits(float dt);
+  void SetOrbitalIntegrator(bool enabled);
+  void ApplyMutualGravity();
+  void SetMutualGravity(bool enabled);
+  PredictionGravity GetPredictionGravity() const;
+  void RequestPrediction();
+  void CancelPrediction();
+  void SetBallisticEnemies(bool enabled);
   void AddRandomCollectible();
   void AddRandomEnemy();
   void SetScore(int score);
   void SetTimeRemaining(int time);
-  b2Vec2 GetRandomPosition();
+  void UpdateSpawnObstacles();
+  b2Vec2 GetRandomPosition(bool awayFromCollectibles=false);
   void SpawnPlanet();
   void TogglePause();
   void DecreaseLives();
   void DiscardPlanet(Entity *planet);
+  void UpdateHover(int x, int y);
+  void StartDragging(b2Body *body, b2Vec2 p);
+  void StopDragging();
+
+  GameCounters GetCounters() const;
+  void SetCounters(const GameCounters &counters);
+  void RecordRewindSnapshot();
+  bool RewindOnce();
+  void StartRewind();
+  void StopRewind();
+  void ClearRewindHistory();
+
+  void ProcessContactEvents();
+  void EnemySunContact(Entity *enemy, Entity *sun);
+  void EnemyPlanetContact(Entity *enemy, Entity *planet);
+  void PlanetSunContact(Entity *planet, Entity *sun);
+  void CollectibleSunContact(Entity *collectible, Entity *sun);
+  void CollectiblePlanetContact(Entity *collectible, Entity *planet);
 
-  void DrawGrid(Renderer *renderer) const;
-  void DrawTrail(Renderer *renderer, const Entity *entity) const;
+#ifndef RELEASE_BUILD
+  /// Save the game to memory, load it back and save it again, and
+  /// report whether both saves are identical.
+  void CheckSaveRoundTrip();
+#endif
 
-  friend class ContactListener;
+  void DrawGrid(Renderer *renderer) const;
+  void DrawTrail(Renderer *renderer, const Trail &trail, float radius) const;
+  bool IsVisible(const b2AABB &view, const b2AABB &bounds, float margin);
 
 public:
   GameScreen(SDL_Window *window);
@@ -110,12 +173,21 @@ public:
   void HandleWidgetEvent(int event_type, Widget *widget);
   virtual void HandleEvent(const SDL_Event &e);
 
+  /// Keep the spawn obstacles in step with the entities.
+  virtual void EntityCreated(EntityPool *pool, Entity *e);
+  virtual void EntityDestroyed(EntityPool *pool, Entity *e);
+
   virtual void Reset();
+
+  /// Pause the game if it's not already paused.
+  void Pause();
+
   virtual void Save(ostream &s) const;
   virtual void Load(istream &s);
 
   virtual void Advance(float dt);
   virtual void Render(Renderer *renderer);
+  virtual bool IsDirty() const;
 };
 
 #endif /* _GRAVITY_GAME_SCREEN_HH_ */
@@ -1,5 +1,6 @@
 #include "helpers.hh"
 #include "resource-cache.hh"
+#include "view-state.hh"
 
 #include <box2d/box2d.h>
 
@@ -58,9 +59,9 @@ void LoadMap(map<string, string> &m, istream &s) {
   }
 }
 
-void GetTextWidthP(string text, float hp, SDL_Window *window, float &wp) {
-  int winw, winh;
-  SDL_GetWindowSize(window, &winw, &winh);
+void GetTextWidthP(string text, float hp, float &wp) {
+  int winw = ViewState::GetWindowWidth();
+  int winh = ViewState::GetWindowHeight();
 
   int height_pixels = hp * winh;
   TTF_Font *font = ResourceCache::GetFont(height_pixels);
@@ -91,12 +92,11 @@ string ReadFile(const string &filename) {
 }
 
 void GetRelativeCoords(int x, int y,
-                       SDL_Window *window,
                        TextAnchor xanchor, TextAnchor yanchor,
                        float &xp, float &yp)
 {
-  int winw, winh;
-  SDL_GetWindowSize(window, &winw, &winh);
+  int winw = ViewState::GetWindowWidth();
+  int winh = ViewState::GetWindowHeight();
 
   if (xanchor == TextAnchor::LEFT)
     xp = (float) x / winw;
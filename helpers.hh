@@ -27,15 +27,14 @@ extern void LoadString(string &str, istream &s);
 extern void SaveMap(const map<string, string> &m, ostream &s);
 extern void LoadMap(map<string, string> &m, istream &s);
 
-extern void GetTextWidthP(string text, float hp, SDL_Window *window, float &wp);
+extern void GetTextWidthP(string text, float hp, float &wp);
 
 extern string ReadFile(const string &filename);
 
 /// Converts the window coordinate (x, y) to relative coordinates (xp,
 /// yp), i.e. xp and yp in range [0.0, 1.0], for a widget with the
-/// given width and height in the given window.
+/// given anchors. Uses the window size cached in ViewState.
 extern void GetRelativeCoords(int x, int y,
-                              SDL_Window *window,
                               TextAnchor xanchor, TextAnchor yanchor,
                               float &xp, float &yp);
 
@@ -44,7 +44,7 @@ void ImageButtonWidget::HandleEvent(const SDL_Event &e) {
 
   case SDL_MOUSEMOTION:
     SDL_GetMouseState(&mousex, &mousey);
-    GetRelativeCoords(mousex, mousey, this->screen->window, this->xanchor, this->yanchor, xp, yp);
+    GetRelativeCoords(mousex, mousey, this->xanchor, this->yanchor, xp, yp);
 
     bool xInRange = false;
     bool yInRange = false;
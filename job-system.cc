@@ -0,0 +1,263 @@
+#include "job-system.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// The job system the current thread is a worker of, if any, and the
+// index of its queue.
+static thread_local JobSystem *currentSystem = nullptr;
+static thread_local int currentIndex = 0;
+
+JobSystem *JobSystem::global = nullptr;
+
+bool JobSystem::TaskQueue::Push(Task *task) {
+  lock_guard<mutex> guard(this->lock);
+  if (this->size == CAPACITY)
+    return false;
+
+  this->tasks[(this->head + this->size) % CAPACITY] = task;
+  this->size++;
+  return true;
+}
+
+Task *JobSystem::TaskQueue::PopBack() {
+  lock_guard<mutex> guard(this->lock);
+  if (this->size == 0)
+    return nullptr;
+
+  this->size--;
+  return this->tasks[(this->head + this->size) % CAPACITY];
+}
+
+Task *JobSystem::TaskQueue::PopFront() {
+  lock_guard<mutex> guard(this->lock);
+  if (this->size == 0)
+    return nullptr;
+
+  Task *task = this->tasks[this->head];
+  this->head = (this->head + 1) % CAPACITY;
+  this->size--;
+  return task;
+}
+
+JobSystem::JobSystem(int threadCount) :
+  threadCount(threadCount),
+  queuedCount(0),
+  quit(false),
+  stealCount(0)
+{
+  if (this->threadCount <= 0)
+    this->threadCount = max(1u, thread::hardware_concurrency());
+
+  this->queues = new TaskQueue[this->threadCount];
+  for (int i = 1; i < this->threadCount; ++i)
+    this->workers.push_back(thread(&JobSystem::WorkerMain, this, i));
+}
+
+JobSystem::~JobSystem() {
+  {
+    lock_guard<mutex> guard(this->sleepLock);
+    this->quit = true;
+  }
+  this->wakeup.notify_all();
+  for (auto &worker : this->workers)
+    worker.join();
+
+  // Without workers, nothing runs queued tasks unless waited for.
+  while (Task *task = this->FindTask(0, true))
+    this->Execute(task);
+
+  delete[] this->queues;
+  for (auto task : this->allTasks)
+    delete task;
+
+  if (global == this)
+    global = nullptr;
+}
+
+JobSystem &JobSystem::Get() {
+  if (!global)
+    throw runtime_error("No job system.");
+
+  return *global;
+}
+
+void JobSystem::SetGlobal(JobSystem *jobs) {
+  global = jobs;
+}
+
+int JobSystem::GetQueueIndex() const {
+  return currentSystem == this ? currentIndex : 0;
+}
+
+Task *JobSystem::CreateTask(function<void()> fn, TaskGroup *group) {
+  Task *task;
+  {
+    lock_guard<mutex> guard(this->poolLock);
+    if (this->freeTasks.empty()) {
+      task = new Task;
+      this->allTasks.push_back(task);
+      this->freeTasks.reserve(this->allTasks.size());
+    }
+    else {
+      task = this->freeTasks.back();
+      this->freeTasks.pop_back();
+    }
+  }
+
+  task->fn = move(fn);
+  task->group = group;
+  task->dependencies = 1;
+  task->continuationCount = 0;
+  if (group)
+    group->pending++;
+
+  return task;
+}
+
+void JobSystem::AddContinuation(Task *before, Task *after) {
+  if (before->continuationCount == Task::MAX_CONTINUATIONS)
+    throw runtime_error("Too many continuations for a task.");
+
+  before->continuations[before->continuationCount++] = after;
+  after->dependencies++;
+}
+
+void JobSystem::Submit(Task *task) {
+  if (--task->dependencies == 0)
+    this->Enqueue(task, this->queues[this->GetQueueIndex()]);
+}
+
+void JobSystem::Run(TaskGroup &group, function<void()> fn) {
+  this->Submit(this->CreateTask(move(fn), &group));
+}
+
+void JobSystem::RunInBackground(function<void()> fn) {
+  Task *task = this->CreateTask(move(fn));
+  task->dependencies = 0;
+
+  // Nobody would run it otherwise.
+  if (this->workers.empty())
+    this->Execute(task);
+  else
+    this->Enqueue(task, this->backgroundQueue);
+}
+
+void JobSystem::Enqueue(Task *task, TaskQueue &queue) {
+  // Counted first, so a worker that sees an empty count really has
+  // nothing to do.
+  this->queuedCount++;
+  if (!queue.Push(task)) {
+    this->queuedCount--;
+    this->Execute(task);
+    return;
+  }
+
+  {
+    lock_guard<mutex> guard(this->sleepLock);
+  }
+  this->wakeup.notify_one();
+}
+
+Task *JobSystem::FindTask(int index, bool background) {
+  Task *task = this->queues[index].PopBack();
+
+  for (int i = 1; !task && i < this->threadCount; ++i) {
+    task = this->queues[(index + i) % this->threadCount].PopFront();
+    if (task)
+      this->stealCount++;
+  }
+
+  if (!task && background)
+    task = this->backgroundQueue.PopFront();
+
+  if (task)
+    this->queuedCount--;
+
+  return task;
+}
+
+void JobSystem::Execute(Task *task) {
+  task->fn();
+
+  for (int i = 0; i < task->continuationCount; ++i)
+    this->Submit(task->continuations[i]);
+
+  // Recycle the task before marking it done, so whatever it captured
+  // is gone by the time the waiting thread goes on.
+  TaskGroup *group = task->group;
+  task->fn = nullptr;
+  {
+    lock_guard<mutex> guard(this->poolLock);
+    this->freeTasks.push_back(task);
+  }
+
+  if (group)
+    group->pending--;
+}
+
+void JobSystem::Wait(TaskGroup &group) {
+  int index = this->GetQueueIndex();
+  while (!group.IsDone()) {
+    Task *task = this->FindTask(index, false);
+    if (task)
+      this->Execute(task);
+    else
+      this_thread::yield();
+  }
+}
+
+void JobSystem::WorkerMain(int index) {
+  currentSystem = this;
+  currentIndex = index;
+
+  while (true) {
+    Task *task = this->FindTask(index, true);
+    if (task) {
+      this->Execute(task);
+      continue;
+    }
+
+    unique_lock<mutex> guard(this->sleepLock);
+    this->wakeup.wait(guard, [this] { return this->quit || this->queuedCount > 0; });
+
+    // Queued tasks are still run when quitting.
+    if (this->quit && this->queuedCount == 0)
+      return;
+  }
+}
+
+void JobSystem::RunChunks(ParallelLoop &loop) {
+  size_t begin;
+  while ((begin = loop.next.fetch_add(loop.grain)) < loop.count)
+    loop.body(loop.context, begin, min(begin + loop.grain, loop.count));
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, void (*body)(void*, size_t, size_t), void *context) {
+  grain = max<size_t>(grain, 1);
+  size_t chunks = (count + grain - 1) / grain;
+  if (chunks <= 1 || this->threadCount == 1) {
+    if (count > 0)
+      body(context, 0, count);
+    return;
+  }
+
+  ParallelLoop loop;
+  loop.body = body;
+  loop.context = context;
+  loop.count = count;
+  loop.grain = grain;
+  loop.next = 0;
+
+  // The helpers all take ranges from the same counter, so it doesn't
+  // matter which of them (or this thread) gets to run first.
+  TaskGroup group;
+  size_t helpers = min<size_t>(chunks - 1, this->threadCount - 1);
+  for (size_t i = 0; i < helpers; ++i)
+    this->Run(group, [this, &loop] { this->RunChunks(loop); });
+
+  this->RunChunks(loop);
+  this->Wait(group);
+}
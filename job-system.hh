@@ -0,0 +1,157 @@
+#ifndef _GRAVITY_JOB_SYSTEM_HH_
+#define _GRAVITY_JOB_SYSTEM_HH_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/// Counts the unfinished tasks of a batch, so they can be waited for.
+class TaskGroup {
+protected:
+  atomic<int> pending;
+
+  friend class JobSystem;
+
+public:
+  TaskGroup() : pending(0) {}
+
+  bool IsDone() const { return this->pending == 0; }
+};
+
+/// A unit of work. Tasks are created by the job system and recycled
+/// once they have run.
+struct Task {
+  static const int MAX_CONTINUATIONS = 8;
+
+  function<void()> fn;
+  TaskGroup *group;
+
+  // Unfinished tasks this one waits for, plus one until submitted.
+  atomic<int> dependencies;
+
+  Task *continuations[MAX_CONTINUATIONS];
+  int continuationCount;
+};
+
+/// A pool of worker threads that run tasks. Each thread has its own
+/// queue: a thread takes the newest task from its own queue and, when
+/// that is empty, steals the oldest task from another thread's queue.
+/// Threads that aren't workers (like the main thread) share one queue.
+///
+/// A thread waiting for a group of tasks helps run tasks instead of
+/// blocking, so waiting from the main thread is cheap. Background
+/// tasks (like file I/O) go to a separate queue that only the workers
+/// take from, so they never hold up a waiting thread.
+class JobSystem {
+protected:
+  struct TaskQueue {
+    static const size_t CAPACITY = 256;
+
+    mutex lock;
+    Task *tasks[CAPACITY];
+    size_t head;
+    size_t size;
+
+    TaskQueue() : head(0), size(0) {}
+
+    bool Push(Task *task);
+    Task *PopBack();
+    Task *PopFront();
+  };
+
+  struct ParallelLoop {
+    void (*body)(void*, size_t, size_t);
+    void *context;
+    size_t count;
+    size_t grain;
+    atomic<size_t> next;
+  };
+
+  int threadCount;
+  vector<thread> workers;
+
+  // One queue per worker, plus one (the first) for the other threads.
+  TaskQueue *queues;
+  TaskQueue backgroundQueue;
+  atomic<int> queuedCount;
+
+  mutex sleepLock;
+  condition_variable wakeup;
+  bool quit;
+
+  mutex poolLock;
+  vector<Task*> freeTasks;
+  vector<Task*> allTasks;
+
+  atomic<uint64_t> stealCount;
+
+  static JobSystem *global;
+
+  void WorkerMain(int index);
+  int GetQueueIndex() const;
+  void Enqueue(Task *task, TaskQueue &queue);
+  Task *FindTask(int index, bool background);
+  void Execute(Task *task);
+  void RunChunks(ParallelLoop &loop);
+
+public:
+  /// Create a job system with the given number of threads, including
+  /// the calling thread. Zero means one per hardware thread.
+  JobSystem(int threadCount = 0);
+
+  /// Finish all the queued tasks and stop the workers.
+  ~JobSystem();
+
+  /// The job system used by the game.
+  static JobSystem &Get();
+  static void SetGlobal(JobSystem *jobs);
+
+  int GetThreadCount() const { return this->threadCount; }
+  uint64_t GetStealCount() const { return this->stealCount; }
+
+  /// Return the index of the calling thread, from 0 to the thread
+  /// count minus one. Threads that aren't workers all get 0.
+  int GetThreadIndex() const { return this->GetQueueIndex(); }
+
+  /// Create a task that runs 'fn'. It is counted in 'group' (if any)
+  /// right away, but only runs once submitted and once all the tasks
+  /// it continues have finished.
+  Task *CreateTask(function<void()> fn, TaskGroup *group = nullptr);
+
+  /// Make 'after' run when 'before' has finished. Must be called
+  /// before either task is submitted.
+  void AddContinuation(Task *before, Task *after);
+
+  void Submit(Task *task);
+
+  /// Create a task and submit it right away.
+  void Run(TaskGroup &group, function<void()> fn);
+
+  /// Run a task that may take a while (like writing a file) on one of
+  /// the workers.
+  void RunInBackground(function<void()> fn);
+
+  /// Run tasks until all the tasks in the group have finished.
+  void Wait(TaskGroup &group);
+
+  /// Call body(begin, end) on ranges of at most 'grain' indices
+  /// covering [0, count), spread over the threads. Returns when all
+  /// the ranges are done. Small loops run on the calling thread.
+  void ParallelFor(size_t count, size_t grain, void (*body)(void*, size_t, size_t), void *context);
+
+  template <typename F>
+  void ParallelFor(size_t count, size_t grain, const F &body) {
+    this->ParallelFor(count, grain, [](void *context, size_t begin, size_t end) {
+        (*static_cast<const F*>(context))(begin, end);
+      }, (void*) &body);
+  }
+};
+
+#endif /* _GRAVITY_JOB_SYSTEM_HH_ */
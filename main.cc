@@ -7,6 +7,14 @@
 #include "resource-cache.hh"
 #include "config.hh"
 #include "platform.hh"
+#include "autosave.hh"
+#include "view-state.hh"
+#include "frame-pacer.hh"
+#include "frame-arena.hh"
+#include "alloc-tracker.hh"
+#include "job-system.hh"
+#include "benchmark.hh"
+#include "save-test.hh"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -15,12 +23,18 @@
 #include <unistd.h>
 #include <time.h>
 
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
 using namespace std;
 
+#ifdef GRAVITY_ALLOC_TRACKING
+// Report the frames that allocate from the heap in the steady state.
+static bool checkAllocations = false;
+#endif
+
 void HandleEvents(SDL_Event &e, SDL_Window *window, bool &quit) {
   uint32_t flags;
   int winw, winh;
@@ -38,6 +52,21 @@ void HandleEvents(SDL_Event &e, SDL_Window *window, bool &quit) {
       SDL_PushEvent(&quitEvent);
       break;
 
+#ifdef GRAVITY_ALLOC_TRACKING
+    case SDLK_F7:
+      checkAllocations = !checkAllocations;
+      DEBUG_MSG("Allocation check " << (checkAllocations ? "on" : "off") << ".");
+      break;
+
+    case SDLK_F8:
+      // Print what was tracked so far when turning it off.
+      if (AllocationTracker::IsEnabled())
+        AllocationTracker::WriteReport(cout);
+      AllocationTracker::SetEnabled(!AllocationTracker::IsEnabled());
+      DEBUG_MSG("Allocation tracking " << (AllocationTracker::IsEnabled() ? "on" : "off") << ".");
+      break;
+#endif
+
     case SDLK_f:
       flags = SDL_GetWindowFlags(window);
       if (flags & SDL_WINDOW_FULLSCREEN_DESKTOP)
@@ -75,26 +104,10 @@ void HandleEvents(SDL_Event &e, SDL_Window *window, bool &quit) {
     break;
 
   case SDL_WINDOWEVENT:
-    if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-      int winw, winh;
-      SDL_GetWindowSize(window, &winw, &winh);
-
-      // Update OpenGL viewport.
-      glViewport(0, 0, winw, winh);
-
-      // Update window size in shader.
-      auto program = ResourceCache::texturedPolygonProgram;
-      glUseProgram(program);
-      GLuint resolutionUniform = glGetUniformLocation(program, "resolution");
-      glUniform2f(resolutionUniform, winw, winh);
-      glUseProgram(0);
-
-      program = ResourceCache::hudTexturedPolygonProgram;
-      glUseProgram(program);
-      resolutionUniform = glGetUniformLocation(program, "resolution");
-      glUniform2f(resolutionUniform, winw, winh);
-      glUseProgram(0);
-    }
+    // Update the viewport and the window size in the shaders. The
+    // upload happens before the next frame is rendered.
+    if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+      ViewState::SetWindowSize(e.window.data1, e.window.data2);
     break;
   } // switch (e.type)
 }
@@ -103,9 +116,28 @@ int main_body(int argc, char *argv[]) {
   bool quit = false;
   SDL_Window *window = nullptr;
 
+#ifdef GRAVITY_ALLOC_TRACKING
+  // Track allocations from the start if asked to, to get a report of
+  // the whole run on exit.
+  AllocationTracker::SetMainThread();
+  if (getenv("GRAVITY_TRACK_ALLOCATIONS"))
+    AllocationTracker::SetEnabled(true);
+#endif
+
+  if (argc > 1 && string(argv[1]) == "--benchmark")
+    return Benchmark::Run(cout);
+
+  if (argc > 1 && string(argv[1]) == "--test-save")
+    return SaveTest::Run(cout);
+
   if (argc > 1)
     ResourceCache::RESOURCES_PATH = argv[1];
 
+  // Threads for the game to share. Created first, so it's the last
+  // thing to go.
+  JobSystem jobs(Config::JobThreads);
+  JobSystem::SetGlobal(&jobs);
+
   // Seed the pseudo-random number generator with time.
   srand(time(0));
 
@@ -115,13 +147,27 @@ int main_body(int argc, char *argv[]) {
     return 1;
   }
 
-  // Create window.
+  // Create window. Require a hardware accelerated context if
+  // configured to, but fall back to whatever is available.
+  uint32_t windowFlags = SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+  if (Config::HardwareAcceleration)
+    SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
   window = SDL_CreateWindow("gravity",
                             SDL_WINDOWPOS_UNDEFINED,
                             SDL_WINDOWPOS_UNDEFINED,
                             Config::ScreenWidth,
                             Config::ScreenHeight,
-                            SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+                            windowFlags);
+  if (window == nullptr && Config::HardwareAcceleration) {
+    DEBUG_MSG("Could not create an accelerated window: " << SDL_GetError());
+    SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, -1);
+    window = SDL_CreateWindow("gravity",
+                              SDL_WINDOWPOS_UNDEFINED,
+                              SDL_WINDOWPOS_UNDEFINED,
+                              Config::ScreenWidth,
+                              Config::ScreenHeight,
+                              windowFlags);
+  }
   if (window == nullptr) {
     SHOW_MSG("Window could not be created. SDL_Error: " << SDL_GetError());
     return 2;
@@ -133,20 +179,8 @@ int main_body(int argc, char *argv[]) {
   Screen *splashScreen = new SplashScreen(window);
   SDL_ShowWindow(window);
 
-  // Set resolution uniforms in shader programs that need it.
-  int winw, winh;
-  SDL_GetWindowSize(window, &winw, &winh);
-  auto program = ResourceCache::texturedPolygonProgram;
-  glUseProgram(program);
-  GLuint resolutionUniform = glGetUniformLocation(program, "resolution");
-  glUniform2f(resolutionUniform, winw, winh);
-  glUseProgram(0);
-
-  program = ResourceCache::hudTexturedPolygonProgram;
-  glUseProgram(program);
-  resolutionUniform = glGetUniformLocation(program, "resolution");
-  glUniform2f(resolutionUniform, winw, winh);
-  glUseProgram(0);
+  // Set up the uniform buffer shared by the shader programs.
+  ViewState::Init(window);
 
   // On some systems (like on StumpWM), a size change might happen
   // right after the window is shown. This takes care of that.
@@ -182,29 +216,102 @@ int main_body(int argc, char *argv[]) {
     cout << "No save file." << endl;
   input.close();
 
+  // Resume the game that was being played when the game was last
+  // closed, if any.
+  Autosaver autosaver(GetUserHomeDirectory() + "/.gravity.autosave", jobs);
+  bool resumeGame = false;
+  ifstream autosaveInput(autosaver.GetFilename(), ifstream::in | ifstream::binary);
+  if (autosaveInput) {
+    try {
+      gameScreen->Load(autosaveInput);
+      ((GameScreen*) gameScreen)->Pause();
+      resumeGame = true;
+    }
+    catch (runtime_error &e) {
+      DEBUG_MSG("Could not load autosave: " << e.what());
+      gameScreen->Reset();
+    }
+  }
+  autosaveInput.close();
+
   Screen *currentScreen = splashScreen;
 
-  uint32_t lastTime = SDL_GetTicks();
+  FramePacer pacer(window);
+  uint32_t lastAutosaveTime = SDL_GetTicks();
 
   while (!quit) {
+    // If nothing is going on, sleep until there's an event. Wake up
+    // now and then anyway, in case something is waiting on time.
     SDL_Event e;
+    bool hadEvents = false;
+    if (!currentScreen->IsDirty() && SDL_WaitEventTimeout(&e, Config::IdleWakeupTime)) {
+      currentScreen->Invalidate();
+      currentScreen->HandleEvent(e);
+      HandleEvents(e, window, quit);
+      hadEvents = true;
+    }
+
     while (SDL_PollEvent(&e)) {
+      currentScreen->Invalidate();
       currentScreen->HandleEvent(e);
       HandleEvents(e, window, quit);
+      hadEvents = true;
     } // while (SDL_PollEvent(&e))
 
-    int dt = SDL_GetTicks() - lastTime;
-    SDL_Delay(Config::TimeStep > dt ? Config::TimeStep - dt : 0);
-    dt = SDL_GetTicks() - lastTime;
-    lastTime = SDL_GetTicks();
-    currentScreen->Advance(dt / 1000.0);
+    if (!currentScreen->IsDirty()) {
+      // The idle time is not passed to the screen.
+      pacer.Tick();
+      continue;
+    }
+
+    pacer.Wait();
+#ifdef GRAVITY_ALLOC_TRACKING
+    uint64_t allocations = AllocationTracker::GetTotalCount();
+#endif
+    currentScreen->ClearDirty();
+    currentScreen->Advance(pacer.Tick());
+    ViewState::Upload();
     currentScreen->Render(renderer);
 
+    // Everything allocated from the frame arena is gone now.
+    FrameArena::Get().Reset();
+
+#ifdef GRAVITY_ALLOC_TRACKING
+    // Without any input, a frame should be able to run without going
+    // to the heap, on any thread (the job system's workers included).
+    allocations = AllocationTracker::GetTotalCount() - allocations;
+    if (checkAllocations && !hadEvents && allocations > 0)
+      DEBUG_MSG("Frame made " << allocations << " heap allocations.");
+    AllocationTracker::EndFrame();
+#endif
+
+    // Take a snapshot of the game now and then. Only serializing to
+    // memory happens here; the file is written in the background.
+    if (currentScreen == gameScreen &&
+        currentScreen->state["name"] == "playing" &&
+        SDL_GetTicks() - lastAutosaveTime >= Config::AutosaveInterval * 1000)
+    {
+      ostringstream snapshot;
+      gameScreen->Save(snapshot);
+      string data = snapshot.str();
+      autosaver.Submit(data);
+      lastAutosaveTime = SDL_GetTicks();
+    }
+
+    Screen *lastScreen = currentScreen;
     if (currentScreen->state["name"] == "splash-over") {
-      mainMenuScreen->SwitchScreen(currentScreen->state);
-      currentScreen = mainMenuScreen;
+      if (resumeGame) {
+        gameScreen->SwitchScreen(currentScreen->state);
+        currentScreen = gameScreen;
+        resumeGame = false;
+      }
+      else {
+        mainMenuScreen->SwitchScreen(currentScreen->state);
+        currentScreen = mainMenuScreen;
+      }
     }
     else if (currentScreen->state["name"] == "game-over") {
+      autosaver.Discard();
       highScoresScreen->SwitchScreen(currentScreen->state);
       currentScreen = highScoresScreen;
     }
@@ -235,8 +342,24 @@ int main_body(int argc, char *argv[]) {
       mainMenuScreen->SwitchScreen(currentScreen->state);
       currentScreen = mainMenuScreen;
     }
+
+    if (currentScreen != lastScreen)
+      currentScreen->Invalidate();
   } // while (!quit)
 
+#ifdef GRAVITY_ALLOC_TRACKING
+  if (AllocationTracker::IsEnabled())
+    AllocationTracker::WriteReport(cout);
+#endif
+
+  // Save the game being played, so it can be resumed next time.
+  if (currentScreen == gameScreen && gameScreen->state["name"] == "playing") {
+    ostringstream snapshot;
+    gameScreen->Save(snapshot);
+    string data = snapshot.str();
+    autosaver.Submit(data);
+  }
+
   ofstream output(savefile, ofstream::out | ofstream::binary);
   if (output) {
     highScoresScreen->Save(output);
@@ -251,6 +374,7 @@ int main_body(int argc, char *argv[]) {
   delete highScoresScreen;
   delete gameScreen;
 
+  ViewState::Finalize();
   delete renderer;
 
   // Destroy the window.
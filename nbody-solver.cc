@@ -0,0 +1,124 @@
+#include "nbody-solver.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+NBodySolver::NBodySolver() :
+  g(0.0),
+  softening2(0.0)
+{
+}
+
+void NBodySolver::Clear() {
+  this->x.clear();
+  this->y.clear();
+  this->mass.clear();
+}
+
+void NBodySolver::Add(const b2Vec2 &pos, float mass) {
+  this->x.push_back(pos.x);
+  this->y.push_back(pos.y);
+  this->mass.push_back(mass);
+}
+
+uint64_t NBodySolver::GetInteractionCount() const {
+  uint64_t n = this->size();
+  return n * (n - min<uint64_t>(n, 1)) / 2;
+}
+
+void NBodySolver::Solve(float g, float softening, JobSystem &jobs) {
+  size_t n = this->size();
+  this->g = g;
+  this->softening2 = softening * softening;
+
+  // Every pair of tiles, each only once.
+  size_t tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+  this->tilePairs.clear();
+  for (size_t i = 0; i < tiles; ++i)
+    for (size_t j = i; j < tiles; ++j)
+      this->tilePairs.push_back(make_pair(i, j));
+
+  int threads = jobs.GetThreadCount();
+  this->accumulators.resize(threads);
+  this->accumulatorUsed.assign(threads, 0);
+
+  jobs.ParallelFor(this->tilePairs.size(), 1, [this, &jobs](size_t begin, size_t end) {
+      this->SolveTiles(begin, end, jobs.GetThreadIndex());
+    });
+
+  // Add up the forces of all the threads.
+  this->fx.resize(n);
+  this->fy.resize(n);
+  jobs.ParallelFor(n, 1024, [this, n, threads](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        this->fx[i] = 0.0;
+        this->fy[i] = 0.0;
+      }
+
+      for (int t = 0; t < threads; ++t) {
+        if (!this->accumulatorUsed[t])
+          continue;
+
+        const float *ax = this->accumulators[t].data();
+        const float *ay = ax + n;
+        for (size_t i = begin; i < end; ++i) {
+          this->fx[i] += ax[i];
+          this->fy[i] += ay[i];
+        }
+      }
+    });
+}
+
+void NBodySolver::SolveTiles(size_t first, size_t last, int thread) {
+  size_t n = this->size();
+
+  // Only touched by this thread, so no locking needed.
+  vector<float> &accumulator = this->accumulators[thread];
+  if (!this->accumulatorUsed[thread]) {
+    accumulator.assign(2 * n, 0.0);
+    this->accumulatorUsed[thread] = 1;
+  }
+
+  float *ax = accumulator.data();
+  float *ay = ax + n;
+  const float *x = this->x.data();
+  const float *y = this->y.data();
+  const float *mass = this->mass.data();
+  float g = this->g;
+  float softening2 = this->softening2;
+
+  for (size_t p = first; p < last; ++p) {
+    size_t tileI = this->tilePairs[p].first;
+    size_t tileJ = this->tilePairs[p].second;
+    size_t i0 = tileI * TILE_SIZE;
+    size_t i1 = min(i0 + TILE_SIZE, n);
+    size_t j0 = tileJ * TILE_SIZE;
+    size_t j1 = min(j0 + TILE_SIZE, n);
+
+    for (size_t i = i0; i < i1; ++i) {
+      float xi = x[i];
+      float yi = y[i];
+      float gmi = g * mass[i];
+      float fxi = 0.0;
+      float fyi = 0.0;
+
+      // Within a tile, only the pairs with j > i.
+      for (size_t j = tileI == tileJ ? i + 1 : j0; j < j1; ++j) {
+        float dx = x[j] - xi;
+        float dy = y[j] - yi;
+        float invR = 1.0f / sqrtf(dx * dx + dy * dy + softening2);
+        float f = gmi * mass[j] * invR * invR * invR;
+
+        fxi += f * dx;
+        fyi += f * dy;
+        ax[j] -= f * dx;
+        ay[j] -= f * dy;
+      }
+
+      ax[i] += fxi;
+      ay[i] += fyi;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef _GRAVITY_NBODY_SOLVER_HH_
+#define _GRAVITY_NBODY_SOLVER_HH_
+
+#include "job-system.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/// Computes the gravitational forces between every pair of a set of
+/// bodies (the force of j on i is g * mi * mj / r^2, softened so that
+/// it stays finite when bodies overlap).
+///
+/// The bodies are split into tiles small enough to stay in the cache,
+/// and each pair of tiles is handled by one task. Every interaction is
+/// computed once and applied to both bodies (Newton's third law), so
+/// only half the pairs are visited. Tasks add up their forces in an
+/// array per thread, so no two threads write to the same place; the
+/// arrays are summed at the end.
+class NBodySolver {
+protected:
+  static const size_t TILE_SIZE = 256;
+
+  // Structure of arrays, so the inner loop reads only what it needs.
+  vector<float> x;
+  vector<float> y;
+  vector<float> mass;
+
+  vector<float> fx;
+  vector<float> fy;
+
+  // One force array per thread, the x components followed by the y
+  // components. Only the ones in use are cleared and summed.
+  vector<vector<float>> accumulators;
+  vector<uint8_t> accumulatorUsed;
+
+  vector<pair<uint32_t, uint32_t>> tilePairs;
+
+  float g;
+  float softening2;
+
+  void SolveTiles(size_t first, size_t last, int thread);
+
+public:
+  NBodySolver();
+
+  void Clear();
+  void Add(const b2Vec2 &pos, float mass);
+  size_t size() const { return this->x.size(); }
+
+  /// Compute the forces on all the bodies. Must not be called from two
+  /// threads at once.
+  void Solve(float g, float softening, JobSystem &jobs);
+
+  b2Vec2 GetForce(size_t i) const { return b2Vec2(this->fx[i], this->fy[i]); }
+
+  /// Return the number of body pairs visited by Solve.
+  uint64_t GetInteractionCount() const;
+};
+
+#endif /* _GRAVITY_NBODY_SOLVER_HH_ */
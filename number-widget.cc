@@ -1,9 +1,10 @@
 #include "number-widget.hh"
 #include "resource-cache.hh"
+#include "frame-arena.hh"
 
+#include <cstring>
 #include <iostream>
-#include <sstream>
-#include <iomanip>
+#include <stdexcept>
 
 using namespace std;
 
@@ -33,20 +34,19 @@ void NumberWidget::SetNumber(uint32_t n) {
   if (this->vbo)
     glDeleteBuffers(1, &this->vbo);
 
-  stringstream ss;
-  ss << setw(this->ndigits) << setfill('0') << n;
-  string str = ss.str();
+  FrameArena &arena = FrameArena::Get();
+  const char *str = arena.Format("%0*u", (int) this->ndigits, n);
 
-  if (str.size() != this->ndigits)
+  if (strlen(str) != this->ndigits)
     throw runtime_error("Invalid number for number widget.");
 
-  GLfloat *vertexData = new GLfloat[4 * 6 * this->ndigits];
+  GLfloat *vertexData = static_cast<GLfloat*>(arena.Allocate(4 * 6 * this->ndigits * sizeof(GLfloat)));
   float step = 1.0f / this->ndigits;
   float dstep = 0.1;
   float D = 0.01; // Inter-digit space
 
   for (int i = 0; i < this->ndigits; ++i) {
-    int d = std::stoi(str.substr(i, 1));
+    int d = str[i] - '0';
 
     // triangle 1, vertex 1
     vertexData[i * 6 * 4 + 0] = i * step + D; // coord.x
@@ -94,8 +94,6 @@ void NumberWidget::SetNumber(uint32_t n) {
   ResourceCache::Texture texture = ResourceCache::GetTexture("digits");
   float ratio = (float) (texture.width / 10.0f * this->ndigits) / texture.height;
   this->width = height * ratio;
-
-  delete[] vertexData;
 }
 
 void NumberWidget::SetColor(float r, float g, float b, float a) {
@@ -0,0 +1,404 @@
+#include "physics-shards.hh"
+#include "job-system.hh"
+#include "config.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+static int FindRoot(vector<int> &parent, int i) {
+  while (parent[i] != i)
+    i = parent[i] = parent[parent[i]];
+  return i;
+}
+
+/// Collects the bodies of the fixtures found by a query.
+class BodyQueryCallback : public b2QueryCallback {
+public:
+  BodyQueryCallback(vector<b2Body*> &bodies) :
+    bodies(bodies)
+  {}
+
+  virtual bool ReportFixture(b2Fixture *fixture) {
+    this->bodies.push_back(fixture->GetBody());
+    return true;
+  }
+
+  vector<b2Body*> &bodies;
+};
+
+PhysicsShards::PhysicsShards(b2World &primary, EntityPool &entities, ContactQueue &contactQueue,
+                             ContactListener &contactListener, int count, float minX, float maxX) :
+  primary(primary),
+  entities(entities),
+  contactQueue(contactQueue),
+  minX(minX),
+  shardWidth((maxX - minX) / max(count, 1)),
+  syncCount(0),
+  handoffCount(0)
+{
+  // The primary world reports into the game's queue directly. The
+  // others get their own, since they're stepped at the same time.
+  this->shards.push_back({&primary, nullptr, &contactListener});
+  for (int i = 1; i < count; ++i) {
+    Shard shard;
+    shard.world = new b2World(primary.GetGravity());
+    shard.queue = new ContactQueue(contactQueue.GetCapacity());
+    shard.listener = new ContactListener(shard.queue, &entities);
+    shard.world->SetContactListener(shard.listener);
+    this->shards.push_back(shard);
+  }
+}
+
+PhysicsShards::~PhysicsShards() {
+  this->Clear();
+
+  for (size_t i = 1; i < this->shards.size(); ++i) {
+    delete this->shards[i].world;
+    delete this->shards[i].listener;
+    delete this->shards[i].queue;
+  }
+}
+
+int PhysicsShards::GetShardIndex(float x) const {
+  int i = floor((x - this->minX) / this->shardWidth);
+  return max(0, min(i, (int) this->shards.size() - 1));
+}
+
+int PhysicsShards::GetShardIndex(const b2World *world) const {
+  for (size_t i = 0; i < this->shards.size(); ++i)
+    if (this->shards[i].world == world)
+      return i;
+
+  return 0;
+}
+
+b2Body *PhysicsShards::CloneBody(b2Body *body, b2World *world, b2BodyType type) {
+  b2BodyDef bd;
+  bd.type = type;
+  bd.position = body->GetPosition();
+  bd.angle = body->GetAngle();
+  bd.linearVelocity = body->GetLinearVelocity();
+  bd.angularVelocity = body->GetAngularVelocity();
+  bd.linearDamping = body->GetLinearDamping();
+  bd.angularDamping = body->GetAngularDamping();
+  bd.allowSleep = body->IsSleepingAllowed();
+  bd.awake = body->IsAwake();
+  bd.fixedRotation = body->IsFixedRotation();
+  bd.bullet = body->IsBullet();
+  bd.enabled = body->IsEnabled();
+  bd.userData = body->GetUserData();
+  bd.gravityScale = body->GetGravityScale();
+  b2Body *clone = world->CreateBody(&bd);
+
+  // The shapes are copied by CreateFixture.
+  for (b2Fixture *f = body->GetFixtureList(); f; f = f->GetNext()) {
+    b2FixtureDef fd;
+    fd.shape = f->GetShape();
+    fd.userData = f->GetUserData();
+    fd.friction = f->GetFriction();
+    fd.restitution = f->GetRestitution();
+    fd.restitutionThreshold = f->GetRestitutionThreshold();
+    fd.density = f->GetDensity();
+    fd.isSensor = f->IsSensor();
+    fd.filter = f->GetFilterData();
+    clone->CreateFixture(&fd);
+  }
+
+  return clone;
+}
+
+/// Return the bounding box of the body's fixtures, plus the ghost
+/// margin.
+b2AABB PhysicsShards::GetBounds(const b2Body *body) {
+  b2AABB bounds;
+  bounds.lowerBound = bounds.upperBound = body->GetPosition();
+  for (const b2Fixture *f = body->GetFixtureList(); f; f = f->GetNext())
+    bounds.Combine(f->GetAABB(0));
+
+  b2Vec2 margin(Config::ShardGhostMargin, Config::ShardGhostMargin);
+  bounds.lowerBound -= margin;
+  bounds.upperBound += margin;
+  return bounds;
+}
+
+int PhysicsShards::AddGroupMember(Entity *e) {
+  int i = this->groupMembers.size();
+  this->groupIndex[e->handle.GetIndex()] = i;
+  this->groupMembers.push_back(e);
+  this->groupParent.push_back(i);
+  return i;
+}
+
+void PhysicsShards::GroupSeamBodies() {
+  this->groupIndex.assign(this->entities.GetCapacity(), -1);
+  this->groupMembers.clear();
+  this->groupParent.clear();
+
+  // Start with the moving bodies whose bounds cross a seam.
+  for (auto e : this->entities) {
+    b2Body *body = e->body;
+    if (!body || body->GetType() == b2_staticBody)
+      continue;
+
+    b2AABB bounds = GetBounds(body);
+    if (this->GetShardIndex(bounds.lowerBound.x) != this->GetShardIndex(bounds.upperBound.x))
+      this->AddGroupMember(e);
+  }
+
+  // Add everything moving they might touch, and what that might touch,
+  // and so on. The list grows while it is walked.
+  BodyQueryCallback callback(this->queryScratch);
+  for (size_t i = 0; i < this->groupMembers.size(); ++i) {
+    this->queryScratch.clear();
+    this->QueryAABB(&callback, GetBounds(this->groupMembers[i]->body));
+
+    for (b2Body *body : this->queryScratch) {
+      if (body->GetType() == b2_staticBody)
+        continue;
+
+      Entity *other = this->entities.Get(EntityHandle::FromBody(body));
+      if (!other || other->body != body)
+        continue;
+
+      int j = this->groupIndex[other->handle.GetIndex()];
+      if (j < 0)
+        j = this->AddGroupMember(other);
+      this->groupParent[FindRoot(this->groupParent, i)] = FindRoot(this->groupParent, j);
+    }
+  }
+
+  // Each group goes to the shard most of its members are in already,
+  // so groups straddling a seam don't go back and forth. A member with
+  // joints can't move, so it outvotes the rest.
+  int shardCount = this->shards.size();
+  int memberCount = this->groupMembers.size();
+  this->groupVotes.assign(memberCount * shardCount, 0);
+  for (int i = 0; i < memberCount; ++i) {
+    b2Body *body = this->groupMembers[i]->body;
+    int shard = this->GetShardIndex(body->GetWorld());
+    int votes = body->GetJointList() ? memberCount : 1;
+    this->groupVotes[FindRoot(this->groupParent, i) * shardCount + shard] += votes;
+  }
+
+  this->groupShard.assign(memberCount, 0);
+  for (int i = 0; i < memberCount; ++i) {
+    if (FindRoot(this->groupParent, i) != i)
+      continue;
+
+    const int *votes = &this->groupVotes[i * shardCount];
+    this->groupShard[i] = max_element(votes, votes + shardCount) - votes;
+  }
+}
+
+void PhysicsShards::HandOff() {
+  this->GroupSeamBodies();
+
+  for (auto e : this->entities) {
+    b2Body *body = e->body;
+    if (!body || body->GetJointList())
+      continue;
+
+    int group = this->groupIndex[e->handle.GetIndex()];
+    int shard = group >= 0 ?
+      this->groupShard[FindRoot(this->groupParent, group)] :
+      this->GetShardIndex(body->GetPosition().x);
+    b2World *world = this->shards[shard].world;
+    if (body->GetWorld() == world)
+      continue;
+
+    // The ghost would collide with the real thing.
+    this->DestroyGhost(e->handle, shard);
+
+    b2Body *clone = CloneBody(body, world, body->GetType());
+    e->body = clone;
+    Transform *t = this->entities.transforms.Get(e->handle);
+    if (t)
+      t->body = clone;
+
+    this->DestroyMovedBody(body, e->handle, shard);
+    this->handoffCount++;
+  }
+}
+
+void PhysicsShards::SyncGhosts() {
+  this->syncCount++;
+
+  // Moving bodies that might touch across a seam are in the same
+  // shard, so only static bodies need ghosts.
+  for (auto e : this->entities) {
+    b2Body *body = e->body;
+    if (!body || body->GetType() != b2_staticBody)
+      continue;
+
+    // The shards the body (plus a margin) overlaps, other than its own.
+    b2AABB bounds = GetBounds(body);
+    int owner = this->GetShardIndex(body->GetWorld());
+    int first = this->GetShardIndex(bounds.lowerBound.x);
+    int last = this->GetShardIndex(bounds.upperBound.x);
+    for (int shard = first; shard <= last; ++shard) {
+      if (shard == owner)
+        continue;
+
+      uint64_t key = (uint64_t) e->handle.value << 32 | shard;
+      auto it = this->ghosts.find(key);
+      if (it == this->ghosts.end()) {
+        Ghost ghost;
+        ghost.body = CloneBody(body, this->shards[shard].world, b2_staticBody);
+        it = this->ghosts.insert(make_pair(key, ghost)).first;
+      }
+      else if (it->second.body->GetPosition() != body->GetPosition() ||
+               it->second.body->GetAngle() != body->GetAngle())
+        it->second.body->SetTransform(body->GetPosition(), body->GetAngle());
+
+      it->second.syncCount = this->syncCount;
+    }
+  }
+
+  // Remove the ghosts no longer needed, including those of the
+  // entities that are gone.
+  for (auto it = this->ghosts.begin(); it != this->ghosts.end(); ) {
+    if (it->second.syncCount == this->syncCount) {
+      ++it;
+      continue;
+    }
+
+    it->second.body->GetWorld()->DestroyBody(it->second.body);
+    it = this->ghosts.erase(it);
+  }
+}
+
+void PhysicsShards::DestroyGhost(EntityHandle h, int shard) {
+  auto it = this->ghosts.find((uint64_t) h.value << 32 | shard);
+  if (it == this->ghosts.end())
+    return;
+
+  // Replaced by the real body in the same shard.
+  this->DestroyMovedBody(it->second.body, h, shard);
+  this->ghosts.erase(it);
+}
+
+void PhysicsShards::DestroyMovedBody(b2Body *body, EntityHandle h, int shard) {
+  // The body goes on touching the same things in its new shard, so
+  // its contacts neither end here nor begin again there (which would
+  // apply one-shot effects twice). A pair that really ends during the
+  // next step is reported by the listener then.
+  ContactListener *listener = this->shards[shard].listener;
+  for (b2ContactEdge *ce = body->GetContactList(); ce; ce = ce->next)
+    if (ce->contact->IsTouching())
+      listener->CarryContact(h, EntityHandle::FromBody(ce->other));
+
+  b2World *world = body->GetWorld();
+  world->SetContactListener(nullptr);
+  world->DestroyBody(body);
+  world->SetContactListener(this->shards[this->GetShardIndex(world)].listener);
+}
+
+void PhysicsShards::Step(float timeStep, int velocityIterations, int positionIterations) {
+  if (this->shards.size() == 1) {
+    this->primary.Step(timeStep, velocityIterations, positionIterations);
+    return;
+  }
+
+  this->HandOff();
+  this->SyncGhosts();
+
+  auto step = [&](size_t i) {
+    this->shards[i].world->Step(timeStep, velocityIterations, positionIterations);
+    this->shards[i].listener->FinishCarriedContacts();
+  };
+
+#ifdef GRAVITY_PARALLEL_SHARDS
+  // Each world only touches its own bodies (and its own contact queue
+  // and listener), so they can all be stepped at once, except for
+  // Box2D's global statistics (see the class comment).
+  JobSystem::Get().ParallelFor(this->shards.size(), 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        step(i);
+    });
+#else
+  for (size_t i = 0; i < this->shards.size(); ++i)
+    step(i);
+#endif
+
+  // The queue drops the events already reported by another shard (like
+  // a contact seen both with a body and with its ghost).
+  for (size_t i = 1; i < this->shards.size(); ++i) {
+    for (auto &ev : this->shards[i].queue->GetEvents())
+      this->contactQueue.Push(ev.type, ev.a, ev.b);
+    this->shards[i].queue->Clear();
+  }
+}
+
+void PhysicsShards::Clear() {
+  for (auto &ghost : this->ghosts)
+    ghost.second.body->GetWorld()->DestroyBody(ghost.second.body);
+  this->ghosts.clear();
+}
+
+void PhysicsShards::QueryAABB(b2QueryCallback *callback, const b2AABB &aabb) const {
+  for (auto &shard : this->shards)
+    shard.world->QueryAABB(callback, aabb);
+}
+
+b2Body *PhysicsShards::GetRealBody(b2Body *body) const {
+  Entity *e = this->entities.Get(EntityHandle::FromBody(body));
+  return e ? e->body : nullptr;
+}
+
+int PhysicsShards::GetBodyCount() const {
+  int count = 0;
+  for (auto &shard : this->shards)
+    count += shard.world->GetBodyCount();
+  return count;
+}
+
+int PhysicsShards::GetProxyCount() const {
+  int count = 0;
+  for (auto &shard : this->shards)
+    count += shard.world->GetProxyCount();
+  return count;
+}
+
+int PhysicsShards::GetContactCount() const {
+  int count = 0;
+  for (auto &shard : this->shards)
+    count += shard.world->GetContactCount();
+  return count;
+}
+
+int PhysicsShards::GetIslandCount() const {
+  // Union-find over the bodies the solver moves. Like Box2D, islands
+  // don't grow across static bodies or through sensors.
+  unordered_map<const b2Body*, int> index;
+  vector<int> parent;
+  for (auto &shard : this->shards)
+    for (b2Body *b = shard.world->GetBodyList(); b; b = b->GetNext())
+      if (b->GetType() != b2_staticBody && b->IsAwake() && b->IsEnabled()) {
+        index[b] = parent.size();
+        parent.push_back(parent.size());
+      }
+
+  auto link = [&](const b2Body *a, const b2Body *b) {
+    auto ia = index.find(a);
+    auto ib = index.find(b);
+    if (ia != index.end() && ib != index.end())
+      parent[FindRoot(parent, ia->second)] = FindRoot(parent, ib->second);
+  };
+
+  for (auto &shard : this->shards) {
+    for (b2Contact *c = shard.world->GetContactList(); c; c = c->GetNext())
+      if (c->IsEnabled() && c->IsTouching() &&
+          !c->GetFixtureA()->IsSensor() && !c->GetFixtureB()->IsSensor())
+        link(c->GetFixtureA()->GetBody(), c->GetFixtureB()->GetBody());
+
+    for (b2Joint *j = shard.world->GetJointList(); j; j = j->GetNext())
+      link(j->GetBodyA(), j->GetBodyB());
+  }
+
+  int count = 0;
+  for (size_t i = 0; i < parent.size(); ++i)
+    if (parent[i] == (int) i)
+      count++;
+  return count;
+}
@@ -0,0 +1,133 @@
+#ifndef _GRAVITY_PHYSICS_SHARDS_HH_
+#define _GRAVITY_PHYSICS_SHARDS_HH_
+
+#include "entity-pool.hh"
+#include "contact-queue.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/// Splits the playfield into vertical strips, each simulated by its
+/// own b2World, so that the worlds can be stepped in parallel.
+///
+/// The first shard is the game's own world; new bodies are always
+/// created there. Before every step, each body is handed off to the
+/// shard its center is in, by re-creating it in that shard's world.
+///
+/// Moving bodies near a seam (within Config::ShardGhostMargin) are
+/// grouped with everything moving that they might touch, and each
+/// group is handed off as a whole to a single shard, so that they
+/// collide with each other normally. Static bodies near a seam get a
+/// ghost in the neighbouring shard instead: a static copy, which is
+/// exact since static bodies don't move anyway. Ghosts carry the
+/// handle of their entity, so their contacts are reported like those
+/// of the real body. Bodies with joints stay in their shard (and keep
+/// their group there), since joints can't cross worlds.
+///
+/// A body handed off keeps its touching contacts: they are carried over
+/// to the listener of its new shard rather than ending and beginning
+/// again.
+///
+/// Box2D keeps process-wide statistics (b2_gjkCalls, b2_toiCalls and
+/// the like) that every b2World::Step updates without any locking, so
+/// stepping several worlds at once is a data race on those. The
+/// shards are therefore stepped one after the other, unless built with
+/// GRAVITY_PARALLEL_SHARDS (the --parallel-shards configure option),
+/// which should only be used with a Box2D built without them.
+///
+/// With a single shard, this is just the world.
+class PhysicsShards {
+protected:
+  struct Shard {
+    b2World *world;
+    ContactQueue *queue;
+    ContactListener *listener;
+  };
+
+  struct Ghost {
+    b2Body *body;
+    uint32_t syncCount;
+  };
+
+  b2World &primary;
+  EntityPool &entities;
+  ContactQueue &contactQueue;
+
+  vector<Shard> shards;
+  float minX;
+  float shardWidth;
+
+  // Keyed by entity handle and shard.
+  unordered_map<uint64_t, Ghost> ghosts;
+  uint32_t syncCount;
+
+  // The groups of bodies near the seams, rebuilt before every step:
+  // the group member of each entity (by handle index, -1 if none), the
+  // members with their union-find parents, and the shard each group
+  // goes to (by its root).
+  vector<int> groupIndex;
+  vector<Entity*> groupMembers;
+  vector<int> groupParent;
+  vector<int> groupShard;
+  vector<int> groupVotes;
+  vector<b2Body*> queryScratch;
+
+  int handoffCount;
+
+  int GetShardIndex(float x) const;
+  int GetShardIndex(const b2World *world) const;
+  static b2Body *CloneBody(b2Body *body, b2World *world, b2BodyType type);
+  static b2AABB GetBounds(const b2Body *body);
+
+  int AddGroupMember(Entity *e);
+  void GroupSeamBodies();
+  void HandOff();
+  void SyncGhosts();
+  void DestroyGhost(EntityHandle h, int shard);
+  void DestroyMovedBody(b2Body *body, EntityHandle h, int shard);
+
+public:
+  /// Create 'count' shards covering [minX, maxX]. Bodies beyond either
+  /// end belong to the shard at that end. The primary world must report
+  /// to 'contactListener'.
+  PhysicsShards(b2World &primary, EntityPool &entities, ContactQueue &contactQueue,
+                ContactListener &contactListener, int count, float minX, float maxX);
+  ~PhysicsShards();
+
+  int GetShardCount() const { return this->shards.size(); }
+  b2World *GetWorld(int shard) const { return this->shards[shard].world; }
+
+  /// Hand off bodies, update the ghosts and step all the worlds. The
+  /// contacts of all the shards end up in the game's contact queue.
+  void Step(float timeStep, int velocityIterations, int positionIterations);
+
+  /// Remove all the ghosts, e.g. before destroying all the bodies.
+  void Clear();
+
+  /// Query all the shards. Fixtures of ghosts are reported too.
+  void QueryAABB(b2QueryCallback *callback, const b2AABB &aabb) const;
+
+  /// Return the real body of an entity, given its body or a ghost.
+  /// Returns nullptr for the ghost of an entity that is gone (ghosts
+  /// are only removed on the next step).
+  b2Body *GetRealBody(b2Body *body) const;
+
+  // statistics
+  int GetBodyCount() const;
+  int GetProxyCount() const;
+  int GetContactCount() const;
+
+  /// Return the number of islands the solver would build: groups of
+  /// awake, non-static bodies linked by touching contacts or joints.
+  int GetIslandCount() const;
+  int GetGhostCount() const { return this->ghosts.size(); }
+  int GetHandoffCount() const { return this->handoffCount; }
+  void ResetStats() { this->handoffCount = 0; }
+};
+
+#endif /* _GRAVITY_PHYSICS_SHARDS_HH_ */
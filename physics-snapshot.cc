@@ -0,0 +1,202 @@
+#include "physics-snapshot.hh"
+#include "entity-pool.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+static bool CompareHandles(EntityHandle a, EntityHandle b) {
+  return a.value < b.value;
+}
+
+template <typename T>
+void PhysicsSnapshot::Components<T>::Capture(const ComponentStore<T> &store, EntityHandle h, uint32_t owner) {
+  const T *c = store.Get(h);
+  if (c) {
+    this->owners.push_back(owner);
+    this->values.push_back(*c);
+  }
+}
+
+template <typename T>
+void PhysicsSnapshot::Components<T>::Restore(ComponentStore<T> &store, const vector<EntityHandle> &handles) const {
+  // Adding replaces the component of entities that still have one.
+  for (size_t i = 0; i < this->owners.size(); ++i)
+    store.Add(handles[this->owners[i]], this->values[i]);
+}
+
+template <typename T>
+void PhysicsSnapshot::Components<T>::Clear() {
+  this->owners.clear();
+  this->values.clear();
+}
+
+template <typename T>
+size_t PhysicsSnapshot::Components<T>::GetMemoryUsage() const {
+  return this->owners.capacity() * sizeof(uint32_t) + this->values.capacity() * sizeof(T);
+}
+
+void PhysicsSnapshot::Capture(const EntityPool &pool, const GameCounters &counters) {
+  this->counters = counters;
+
+  this->entities.clear();
+  this->fixtures.clear();
+  this->gravitySources.Clear();
+  this->gravityReceivers.Clear();
+  this->collectibles.Clear();
+  this->lifetimes.Clear();
+  this->ballistics.Clear();
+  this->trailOwners.clear();
+  this->trailSizes.clear();
+  this->trailTimes.clear();
+  this->trailPointCounts.clear();
+  this->trailPoints.clear();
+
+  for (auto e : pool) {
+    uint32_t row = this->entities.size();
+    EntityHandle h = e->handle;
+
+    EntityState state;
+    state.handle = h;
+    state.type = e->type;
+    state.body.Capture(e->body, this->fixtures);
+
+    const Transform *t = pool.transforms.Get(h);
+    state.hasTransform = t != nullptr;
+    state.pos = t ? t->pos : b2Vec2(0.0, 0.0);
+    state.angle = t ? t->angle : 0.0;
+    this->entities.push_back(state);
+
+    this->gravitySources.Capture(pool.gravitySources, h, row);
+    this->gravityReceivers.Capture(pool.gravityReceivers, h, row);
+    this->collectibles.Capture(pool.collectibles, h, row);
+    this->lifetimes.Capture(pool.lifetimes, h, row);
+    this->ballistics.Capture(pool.ballistics, h, row);
+
+    const Trail *trail = pool.trails.Get(h);
+    if (trail) {
+      this->trailOwners.push_back(row);
+      this->trailSizes.push_back(trail->size);
+      this->trailTimes.push_back(trail->time);
+      this->trailPointCounts.push_back(trail->points.size());
+      this->trailPoints.insert(this->trailPoints.end(), trail->points.begin(), trail->points.end());
+    }
+  }
+}
+
+void PhysicsSnapshot::Restore(EntityPool &pool, b2World *world, vector<Entity*> &created) const {
+  // Find the entities of the snapshot that still exist. One that got
+  // or lost a body since is treated as gone, and re-created.
+  bool missing = false;
+  this->handles.resize(this->entities.size());
+  for (size_t i = 0; i < this->entities.size(); ++i) {
+    const EntityState &state = this->entities[i];
+    Entity *e = pool.Get(state.handle);
+    if (e && (e->body != nullptr) == state.body.exists)
+      this->handles[i] = state.handle;
+    else {
+      this->handles[i] = EntityHandle();
+      missing = true;
+    }
+  }
+
+  // If nothing is missing and the counts match, the entity set is
+  // unchanged. Otherwise, destroy the entities that aren't in the
+  // snapshot (or will be re-created).
+  if (missing || pool.size() != this->entities.size()) {
+    this->sortedHandles.clear();
+    for (auto h : this->handles)
+      if (!h.IsNull())
+        this->sortedHandles.push_back(h);
+    sort(this->sortedHandles.begin(), this->sortedHandles.end(), CompareHandles);
+
+    this->extra.clear();
+    for (auto e : pool)
+      if (!binary_search(this->sortedHandles.begin(), this->sortedHandles.end(), e->handle, CompareHandles))
+        this->extra.push_back(e);
+
+    for (auto e : this->extra) {
+      if (e->body)
+        e->body->GetWorld()->DestroyBody(e->body);
+      pool.Destroy(e);
+    }
+  }
+
+  size_t firstCreated = created.size();
+  if (missing)
+    for (size_t i = 0; i < this->entities.size(); ++i) {
+      if (!this->handles[i].IsNull())
+        continue;
+
+      Entity *e = pool.Create();
+      e->type = this->entities[i].type;
+      e->body = this->entities[i].body.Create(world, this->fixtures, e->handle);
+      this->handles[i] = e->handle;
+      created.push_back(e);
+    }
+
+  for (size_t i = 0; i < this->entities.size(); ++i) {
+    const EntityState &state = this->entities[i];
+    EntityHandle h = this->handles[i];
+    Entity *e = pool.Get(h);
+    if (e->body) {
+      e->body->SetTransform(state.body.pos, state.body.angle);
+      e->body->SetLinearVelocity(state.body.linearVelocity);
+      e->body->SetAngularVelocity(state.body.angularVelocity);
+      e->body->SetAwake(state.body.awake);
+    }
+
+    if (state.hasTransform) {
+      Transform *t = pool.transforms.Get(h);
+      if (!t)
+        t = pool.transforms.Add(h);
+      t->body = e->body;
+      t->pos = state.pos;
+      t->angle = state.angle;
+    }
+  }
+
+  this->gravitySources.Restore(pool.gravitySources, this->handles);
+  this->gravityReceivers.Restore(pool.gravityReceivers, this->handles);
+  this->collectibles.Restore(pool.collectibles, this->handles);
+  this->lifetimes.Restore(pool.lifetimes, this->handles);
+  this->ballistics.Restore(pool.ballistics, this->handles);
+
+  size_t next = 0;
+  for (size_t i = 0; i < this->trailOwners.size(); ++i) {
+    EntityHandle h = this->handles[this->trailOwners[i]];
+    Trail *trail = pool.trails.Get(h);
+    if (!trail)
+      trail = pool.trails.Add(h);
+
+    // Assigning reuses the capacity of the trail.
+    auto first = this->trailPoints.begin() + next;
+    next += this->trailPointCounts[i];
+    trail->size = this->trailSizes[i];
+    trail->time = this->trailTimes[i];
+    trail->points.assign(first, this->trailPoints.begin() + next);
+    trail->ComputeBounds();
+  }
+
+  for (size_t i = firstCreated; i < created.size(); ++i)
+    pool.NotifyCreated(created[i]);
+}
+
+size_t PhysicsSnapshot::GetMemoryUsage() const {
+  return sizeof(*this) +
+    this->entities.capacity() * sizeof(EntityState) +
+    this->fixtures.capacity() * sizeof(FixtureState) +
+    this->gravitySources.GetMemoryUsage() +
+    this->gravityReceivers.GetMemoryUsage() +
+    this->collectibles.GetMemoryUsage() +
+    this->lifetimes.GetMemoryUsage() +
+    this->ballistics.GetMemoryUsage() +
+    this->trailOwners.capacity() * sizeof(uint32_t) +
+    this->trailSizes.capacity() * sizeof(int32_t) +
+    this->trailTimes.capacity() * sizeof(float) +
+    this->trailPointCounts.capacity() * sizeof(uint32_t) +
+    this->trailPoints.capacity() * sizeof(TrailPoint) +
+    this->handles.capacity() * sizeof(EntityHandle) +
+    this->sortedHandles.capacity() * sizeof(EntityHandle) +
+    this->extra.capacity() * sizeof(Entity*);
+}
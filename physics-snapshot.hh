@@ -0,0 +1,102 @@
+#ifndef _GRAVITY_PHYSICS_SNAPSHOT_HH_
+#define _GRAVITY_PHYSICS_SNAPSHOT_HH_
+
+#include "entity.hh"
+#include "components.hh"
+#include "body-state.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class EntityPool;
+
+/// The game counters that change while the game is played, saved
+/// alongside the physics state.
+struct GameCounters {
+  float time;
+  int score;
+  int timeRemaining;
+  float scoreAccumulator;
+  int lives;
+  bool spawnPlanet;
+  bool planetSunContact;
+};
+
+/// An in-memory snapshot of the dynamic state of a game: the bodies,
+/// transforms and components of all entities, their trails and the
+/// game counters. Everything is kept in a few flat arrays which are
+/// reused when the snapshot is captured again, so capturing doesn't
+/// allocate once the arrays have grown large enough.
+///
+/// Restoring patches the existing entities in place. Entities that
+/// have been destroyed since (or got a body since, like a promoted
+/// ballistic enemy) are re-created from the snapshot, with new handles.
+class PhysicsSnapshot {
+protected:
+  struct EntityState {
+    EntityHandle handle;
+    EntityType type;
+    BodyState body;
+    bool hasTransform;
+    b2Vec2 pos;
+    float angle;
+  };
+
+  /// Components of one type, referring to their entities by index in
+  /// the entity array.
+  template <typename T>
+  struct Components {
+    vector<uint32_t> owners;
+    vector<T> values;
+
+    void Capture(const ComponentStore<T> &store, EntityHandle h, uint32_t owner);
+    void Restore(ComponentStore<T> &store, const vector<EntityHandle> &handles) const;
+    void Clear();
+    size_t GetMemoryUsage() const;
+  };
+
+  vector<EntityState> entities;
+  vector<FixtureState> fixtures;
+
+  Components<GravitySource> gravitySources;
+  Components<GravityReceiver> gravityReceivers;
+  Components<CollectiblePayload> collectibles;
+  Components<Lifetime> lifetimes;
+  Components<Ballistic> ballistics;
+
+  vector<uint32_t> trailOwners;
+  vector<int32_t> trailSizes;
+  vector<float> trailTimes;
+  vector<uint32_t> trailPointCounts;
+  vector<TrailPoint> trailPoints;
+
+  // Scratch arrays used when restoring: the current handle of each
+  // entity in the snapshot, and those used to find the entities that
+  // aren't in it.
+  mutable vector<EntityHandle> handles;
+  mutable vector<EntityHandle> sortedHandles;
+  mutable vector<Entity*> extra;
+
+public:
+  GameCounters counters;
+
+  void Capture(const EntityPool &pool, const GameCounters &counters);
+
+  /// Restore the snapshot into the given pool. Entities created after
+  /// the snapshot was captured are destroyed (along with their
+  /// bodies), and entities destroyed since are re-created, with their
+  /// bodies in 'world'. The re-created entities are appended to
+  /// 'created'; they still need their presentation.
+  void Restore(EntityPool &pool, b2World *world, vector<Entity*> &created) const;
+
+  size_t GetEntityCount() const { return this->entities.size(); }
+
+  /// Return the approximate memory used by the snapshot.
+  size_t GetMemoryUsage() const;
+};
+
+#endif /* _GRAVITY_PHYSICS_SNAPSHOT_HH_ */
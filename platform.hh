@@ -1,8 +1,20 @@
+#include <iostream>
 #include <string>
 
 using namespace std;
 
 #define SHOW_MSG(msg) { stringstream ss; ss << msg; ShowMessage(ss.str()); }
 
+/// Print a diagnostic on the console, in debug builds only.
+#ifndef RELEASE_BUILD
+#define DEBUG_MSG(msg) { cout << msg << endl; }
+#else
+#define DEBUG_MSG(msg)
+#endif
+
 extern string GetUserHomeDirectory();
 extern void ShowMessage(string msg);
+
+/// Rename a file, replacing the destination if it exists. The
+/// destination is never left half-written. Returns false on failure.
+extern bool RenameFileOver(const string &from, const string &to);
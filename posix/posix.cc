@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <string>
 #include <iostream>
 
@@ -20,3 +21,7 @@ string GetUserHomeDirectory() {
 void ShowMessage(string msg) {
   cout << msg << endl;
 }
+
+bool RenameFileOver(const string &from, const string &to) {
+  return rename(from.data(), to.data()) == 0;
+}
@@ -1,6 +1,7 @@
 #include "renderer.hh"
 #include "resource-cache.hh"
 #include "platform.hh"
+#include "view-state.hh"
 
 #include <iostream>
 #include <sstream>
@@ -23,8 +24,8 @@ Background::~Background() {
 }
 
 void Background::RebuildIfNecessary() {
-  int winw, winh;
-  SDL_GetWindowSize(this->window, &winw, &winh);
+  int winw = ViewState::GetWindowWidth();
+  int winh = ViewState::GetWindowHeight();
   if (winw == this->lastWindowWidth && winh == this->lastWindowHeight)
     return;
 
@@ -139,6 +140,10 @@ void Renderer::PresentScreen() const {
 
 void Renderer::SetCamera(Camera &camera) {
   this->camera = camera;
+
+  // Only uploads if the camera (or the window size) has changed.
+  ViewState::SetCamera(camera);
+  ViewState::Upload();
 }
 
 void Renderer::ClearScreen() {
@@ -1,6 +1,8 @@
 #include "resource-cache.hh"
 #include "helpers.hh"
 #include "platform.hh"
+#include "alloc-tracker.hh"
+#include "job-system.hh"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -15,6 +17,7 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <memory>
 
 using namespace std;
 
@@ -41,6 +44,42 @@ map<FontDescriptor, TTF_Font*> font_cache;
 map<string, Mix_Chunk*> sound_cache;
 map<string, Texture> texture_cache;
 
+/// An image being decoded, possibly on another thread.
+struct PendingImage {
+  TaskGroup group;
+
+  // False if there are no workers to decode the image, in which case
+  // it is decoded when uploaded.
+  bool queued;
+
+  string name;
+  string path;
+  uint8_t *pixels;
+  bool resampled;
+  int width;
+  int height;
+  string error;
+
+  PendingImage(const string &name, const string &path) :
+    queued(false),
+    name(name),
+    path(path),
+    pixels(nullptr),
+    resampled(false),
+    width(0),
+    height(0)
+  {}
+
+  ~PendingImage() {
+    if (this->resampled)
+      delete[] this->pixels;
+    else if (this->pixels)
+      stbi_image_free(this->pixels);
+  }
+};
+
+map<string, PendingImage*> pending_images;
+
 GLuint CreateShader(GLenum shaderType, const string &shaderSource) {
   string shaderTypeName = shaderTypeNames[shaderType];
 
@@ -115,6 +154,10 @@ GLuint CreateProgram(string vertexShaderFilename, string fragmentShaderFilename)
 void Init() {
   stringstream ss;
 
+  // stb_image fills its zlib tables the first time it needs them,
+  // which would race when images are decoded on several threads.
+  stbi__init_zdefaults();
+
   // Initialize fonts.
   cout << "Initializing font system..." << endl;
   if (TTF_Init() == -1) {
@@ -160,6 +203,13 @@ void Init() {
 }
 
 void Finalize() {
+  // Don't leave any decoding running.
+  for (auto p : pending_images) {
+    JobSystem::Get().Wait(p.second->group);
+    delete p.second;
+  }
+  pending_images.clear();
+
   for (auto p : font_cache)
     TTF_CloseFont(p.second);
 
@@ -171,6 +221,7 @@ void Finalize() {
 }
 
 TTF_Font *GetFont(int height_pixels) {
+  ALLOCATION_SCOPE("resource cache");
   FontDescriptor desc {"fonts/UbuntuMono-B.ttf", height_pixels};
 
   auto it = font_cache.find(desc);
@@ -190,6 +241,7 @@ TTF_Font *GetFont(int height_pixels) {
 }
 
 Mix_Chunk *GetSound(const string &name) {
+  ALLOCATION_SCOPE("resource cache");
   auto it = sound_cache.find(name);
   if (it != sound_cache.end())
     return it->second;
@@ -271,18 +323,16 @@ int downscale_image(const unsigned char* const orig,
   return 1;
 }
 
-Texture GetTexture(const string &name, const string &type) {
-  auto it = texture_cache.find(name);
-  if (it != texture_cache.end())
-    return it->second;
-
+/// Load and downscale an image. Doesn't touch OpenGL, so it can run on
+/// any thread. Errors are recorded in the image, to be reported when it
+/// is uploaded.
+static void DecodeImage(PendingImage *image) {
   int w, h, channels;
-  uint8_t *img = stbi_load((RESOURCES_PATH + "/images/" + name + "." + type).data(), &w, &h, &channels, 0);
+  uint8_t *img = stbi_load(image->path.data(), &w, &h, &channels, 0);
   if (img == nullptr) {
-    stringstream ss;
-    ss << "Unable to load image. stb_image error: "
-       << stbi_failure_reason();
-    throw runtime_error(ss.str());
+    image->error = string("Unable to load image. stb_image error: ") +
+      stbi_failure_reason();
+    return;
   }
 
   int nw = w;
@@ -292,23 +342,37 @@ Texture GetTexture(const string &name, const string &type) {
     nh /= 2;
   }
 
+  image->pixels = img;
   if (nw != w || nh != h) {
     uint8_t *resampled = new uint8_t[nw * nh * channels];
 
     downscale_image(img, w, h, channels, resampled, nw, nh);
     stbi_image_free(img);
-    img = resampled;
+    image->pixels = resampled;
+    image->resampled = true;
     w = nw;
     h = nh;
   }
 
+  image->width = w;
+  image->height = h;
+}
+
+/// Create a texture from a decoded image and add it to the cache.
+static Texture UploadImage(unique_ptr<PendingImage> image) {
+  if (!image->error.empty())
+    throw runtime_error(image->error);
+
+  int w = image->width;
+  int h = image->height;
+
   GLuint texture;
   glGenTextures(1, &texture);
   glBindTexture(GL_TEXTURE_2D, texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, img);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
   auto err = glGetError();
   if (err != GL_NO_ERROR)
-    cout << "OpenGL error " << err << " while loading image: " << name << endl;
+    cout << "OpenGL error " << err << " while loading image: " << image->name << endl;
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
   glBindTexture(GL_TEXTURE_2D, 0);
@@ -318,9 +382,78 @@ Texture GetTexture(const string &name, const string &type) {
   glGenerateMipmap(GL_TEXTURE_2D);
   glBindTexture(GL_TEXTURE_2D, 0);
 
-  texture_cache[name] = {texture, w, h};
+  texture_cache[image->name] = {texture, w, h};
 
   return {texture, w, h};
 }
 
+Texture GetTexture(const string &name, const string &type) {
+  ALLOCATION_SCOPE("resource cache");
+  auto it = texture_cache.find(name);
+  if (it != texture_cache.end())
+    return it->second;
+
+  // If the image is already being decoded, wait for it.
+  auto p = pending_images.find(name);
+  if (p != pending_images.end()) {
+    unique_ptr<PendingImage> image(p->second);
+    pending_images.erase(p);
+    if (image->queued)
+      JobSystem::Get().Wait(image->group);
+    else
+      DecodeImage(image.get());
+    return UploadImage(move(image));
+  }
+
+  unique_ptr<PendingImage> image(new PendingImage(name, RESOURCES_PATH + "/images/" + name + "." + type));
+  DecodeImage(image.get());
+  return UploadImage(move(image));
+}
+
+void PreloadTextures(const vector<string> &names, const string &type) {
+  ALLOCATION_SCOPE("resource cache");
+  for (auto &name : names) {
+    if (texture_cache.count(name) || pending_images.count(name))
+      continue;
+
+    PendingImage *image = new PendingImage(name, RESOURCES_PATH + "/images/" + name + "." + type);
+    pending_images[name] = image;
+
+    // Tasks run by the calling thread only when it waits for them, and
+    // nothing waits for these.
+    JobSystem &jobs = JobSystem::Get();
+    if (jobs.GetThreadCount() > 1) {
+      image->queued = true;
+      jobs.Run(image->group, [image] { DecodeImage(image); });
+    }
+  }
+}
+
+bool UploadPreloadedTextures() {
+  ALLOCATION_SCOPE("resource cache");
+
+  // Images that aren't decoded by a worker are decoded here, one per
+  // call, so the caller can still draw frames in between.
+  bool decoded = false;
+  for (auto it = pending_images.begin(); it != pending_images.end(); ) {
+    PendingImage *pending = it->second;
+    if (!pending->queued && !decoded) {
+      DecodeImage(pending);
+      pending->queued = true;
+      decoded = true;
+    }
+
+    if (!pending->queued || !pending->group.IsDone()) {
+      ++it;
+      continue;
+    }
+
+    unique_ptr<PendingImage> image(it->second);
+    it = pending_images.erase(it);
+    UploadImage(move(image));
+  }
+
+  return pending_images.empty();
+}
+
 } // namespace ResourceCache
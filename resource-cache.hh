@@ -7,6 +7,7 @@
 #include <SDL2/SDL_mixer.h>
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -32,6 +33,17 @@ extern TTF_Font *GetFont(int height_pixels);
 extern Mix_Chunk *GetSound(const string &name);
 extern Texture GetTexture(const string &name, const string &type="png");
 
+/// Start decoding the given images on the job system. They become
+/// textures when uploaded, or when asked for with GetTexture. Without
+/// workers, the images are decoded by UploadPreloadedTextures instead.
+extern void PreloadTextures(const vector<string> &names, const string &type="png");
+
+/// Upload the preloaded images that are done decoding (decoding one
+/// first if there are no workers). Returns true when there's nothing
+/// left to upload. Must be called from the thread owning the OpenGL
+/// context.
+extern bool UploadPreloadedTextures();
+
 } // namespace ResourceCache
 
 #endif /* _GRAVITY_RESOURCE_CACHE_HH_ */
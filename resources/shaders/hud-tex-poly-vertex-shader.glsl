@@ -1,6 +1,10 @@
 #version 330
 
-uniform vec2 resolution;
+layout(std140) uniform View {
+  vec2 resolution;
+  vec2 camera_pos;
+  float ppm;
+};
 
 const int LEFT = 1;
 const int CENTER = 2;
@@ -1,8 +1,10 @@
 #version 330
 
-uniform vec2 resolution;
-uniform vec2 camera_pos;
-uniform float ppm;
+layout(std140) uniform View {
+  vec2 resolution;
+  vec2 camera_pos;
+  float ppm;
+};
 
 in vec2 coord;
 in vec2 tex_coord;
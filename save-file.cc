@@ -0,0 +1,220 @@
+#include "save-file.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// Chunks of unknown size are read in pieces of this size at most.
+const size_t READ_PIECE_SIZE = 64 * 1024;
+
+static uint32_t MakeTag(const char *tag) {
+  if (strlen(tag) != 4)
+    throw runtime_error("Chunk tags must be four characters long.");
+
+  return ((uint32_t) (uint8_t) tag[0]) |
+    ((uint32_t) (uint8_t) tag[1] << 8) |
+    ((uint32_t) (uint8_t) tag[2] << 16) |
+    ((uint32_t) (uint8_t) tag[3] << 24);
+}
+
+uint32_t Crc32(const void *data, size_t size, uint32_t crc) {
+  static uint32_t table[256];
+  static bool tableReady = false;
+
+  if (!tableReady) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    tableReady = true;
+  }
+
+  const uint8_t *p = (const uint8_t*) data;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+SaveFileWriter::SaveFileWriter(ostream &s) :
+  s(s),
+  inChunk(false)
+{
+  uint32_t header[] = {SAVE_FILE_MAGIC, SAVE_FILE_BYTE_ORDER, SAVE_FILE_VERSION};
+  this->s.write((const char*) header, sizeof(header));
+}
+
+void SaveFileWriter::BeginChunk(const char *tag) {
+  if (this->inChunk)
+    throw runtime_error("Previous chunk not ended.");
+
+  // Reserve room for the tag and the size. They are filled in when
+  // the chunk is ended.
+  uint32_t chunkHeader[] = {MakeTag(tag), 0};
+  this->chunk.clear();
+  this->chunk.insert(this->chunk.end(),
+                     (const char*) chunkHeader,
+                     (const char*) chunkHeader + sizeof(chunkHeader));
+  this->inChunk = true;
+}
+
+void SaveFileWriter::EndChunk() {
+  if (!this->inChunk)
+    throw runtime_error("No chunk to end.");
+
+  const size_t headerSize = 2 * sizeof(uint32_t);
+  uint32_t size = this->chunk.size() - headerSize;
+  memcpy(&this->chunk[sizeof(uint32_t)], &size, sizeof(size));
+
+  uint32_t crc = Crc32(this->chunk.data() + headerSize, size);
+  this->WriteBlock(&crc, sizeof(crc));
+
+  this->s.write(this->chunk.data(), this->chunk.size());
+  this->inChunk = false;
+}
+
+void SaveFileWriter::WriteBlock(const void *data, size_t size) {
+  if (!this->inChunk)
+    throw runtime_error("Data written outside a chunk.");
+
+  this->chunk.insert(this->chunk.end(), (const char*) data, (const char*) data + size);
+}
+
+void SaveFileWriter::WriteString(const string &str) {
+  this->Write((uint32_t) str.size());
+  this->WriteBlock(str.data(), str.size());
+}
+
+void SaveFileWriter::WriteMap(const map<string, string> &m) {
+  this->Write((uint32_t) m.size());
+  for (auto &kv : m) {
+    this->WriteString(kv.first);
+    this->WriteString(kv.second);
+  }
+}
+
+/// Return the number of bytes left in the stream, or -1 if the stream
+/// can't tell.
+static streamoff GetStreamRemaining(istream &s) {
+  streampos pos = s.tellg();
+  if (pos == streampos(-1))
+    return -1;
+
+  s.seekg(0, ios::end);
+  streampos end = s.tellg();
+  s.clear();
+  s.seekg(pos);
+  if (end == streampos(-1) || !s)
+    return -1;
+
+  return end - pos;
+}
+
+SaveFileReader::SaveFileReader(istream &s) :
+  current(nullptr),
+  pos(0)
+{
+  uint32_t header[3];
+  if (!s.read((char*) header, sizeof(header)) || header[0] != SAVE_FILE_MAGIC)
+    throw runtime_error("Not a save file.");
+
+  if (header[1] != SAVE_FILE_BYTE_ORDER)
+    throw runtime_error("Save file was written on a machine with a different byte order.");
+
+  this->version = header[2];
+  if (this->version == 0 || this->version > SAVE_FILE_VERSION)
+    throw runtime_error("Unsupported save file version.");
+
+  // The chunk sizes aren't covered by the checksums, so don't trust
+  // them with an allocation before knowing the data is there. Streams
+  // that can't tell their size are read in pieces instead.
+  streamoff remaining = GetStreamRemaining(s);
+
+  uint32_t chunkHeader[2];
+  while (s.read((char*) chunkHeader, sizeof(chunkHeader))) {
+    if (remaining >= 0) {
+      remaining -= sizeof(chunkHeader);
+      if (chunkHeader[1] > remaining - (streamoff) sizeof(uint32_t))
+        throw runtime_error("Save file is truncated.");
+      remaining -= chunkHeader[1] + sizeof(uint32_t);
+    }
+
+    vector<char> &payload = this->chunks[chunkHeader[0]];
+    payload.clear();
+    while (payload.size() < chunkHeader[1]) {
+      size_t offset = payload.size();
+      payload.resize(offset + min<size_t>(chunkHeader[1] - offset, READ_PIECE_SIZE));
+      if (!s.read(payload.data() + offset, payload.size() - offset))
+        throw runtime_error("Save file is truncated.");
+    }
+
+    uint32_t crc;
+    if (!s.read((char*) &crc, sizeof(crc)))
+      throw runtime_error("Save file is truncated.");
+
+    if (Crc32(payload.data(), payload.size()) != crc)
+      throw runtime_error("Save file is corrupt (checksum mismatch).");
+  }
+
+  if (s.gcount() != 0)
+    throw runtime_error("Save file is truncated.");
+}
+
+bool SaveFileReader::HasChunk(const char *tag) const {
+  return this->chunks.find(MakeTag(tag)) != this->chunks.end();
+}
+
+void SaveFileReader::OpenChunk(const char *tag) {
+  auto it = this->chunks.find(MakeTag(tag));
+  if (it == this->chunks.end())
+    throw runtime_error(string("Save file has no '") + tag + "' chunk.");
+
+  this->current = &it->second;
+  this->pos = 0;
+}
+
+size_t SaveFileReader::GetRemainingSize() const {
+  if (!this->current)
+    throw runtime_error("No chunk opened.");
+
+  return this->current->size() - this->pos;
+}
+
+void SaveFileReader::ReadBlock(void *data, size_t size) {
+  if (!this->current)
+    throw runtime_error("No chunk opened.");
+
+  if (size > this->current->size() - this->pos)
+    throw runtime_error("Read past the end of a save file chunk.");
+
+  memcpy(data, this->current->data() + this->pos, size);
+  this->pos += size;
+}
+
+void SaveFileReader::ReadString(string &str) {
+  uint32_t size;
+  this->Read(size);
+  if (size > this->current->size() - this->pos)
+    throw runtime_error("Read past the end of a save file chunk.");
+
+  str.assign(this->current->data() + this->pos, size);
+  this->pos += size;
+}
+
+void SaveFileReader::ReadMap(map<string, string> &m) {
+  uint32_t size;
+  this->Read(size);
+
+  m.clear();
+  for (uint32_t i = 0; i < size; ++i) {
+    string key, value;
+    this->ReadString(key);
+    this->ReadString(value);
+    m[key] = value;
+  }
+}
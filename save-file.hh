@@ -0,0 +1,116 @@
+#ifndef _GRAVITY_SAVE_FILE_HH_
+#define _GRAVITY_SAVE_FILE_HH_
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/// A save file starts with a header holding a magic number, a byte
+/// order marker and the format version. It is followed by a number of
+/// chunks, each with a four character tag, the size of its payload,
+/// the payload itself and a CRC-32 of the payload.
+///
+/// Data is stored in the byte order of the machine that wrote it; a
+/// file written with a different byte order is rejected. All sizes and
+/// counts are stored as 32-bit integers so that files don't depend on
+/// the size of size_t. Readers ignore chunks they don't know about, so
+/// new chunks can be added without breaking older readers.
+///
+/// Version 2 writes structs a field at a time, where version 1 wrote
+/// some of them as they were laid out in memory.
+const uint32_t SAVE_FILE_MAGIC = 0x56415247; // "GRAV" in little endian
+const uint32_t SAVE_FILE_BYTE_ORDER = 0x01020304;
+const uint32_t SAVE_FILE_VERSION = 2;
+
+uint32_t Crc32(const void *data, size_t size, uint32_t crc=0);
+
+/// Writes a save file. Chunk payloads are built in memory and each
+/// chunk is written to the stream with a single call.
+class SaveFileWriter {
+protected:
+  ostream &s;
+  vector<char> chunk;
+  bool inChunk;
+
+public:
+  /// Create a writer and write the file header.
+  SaveFileWriter(ostream &s);
+
+  void BeginChunk(const char *tag);
+  void EndChunk();
+
+  void WriteBlock(const void *data, size_t size);
+  void WriteString(const string &str);
+  void WriteMap(const map<string, string> &m);
+
+  template <typename T>
+  void Write(const T &v) {
+    this->WriteBlock(&v, sizeof(T));
+  }
+
+  /// Write the number of elements followed by all of them in one
+  /// block. Only for plain-data types.
+  template <typename T>
+  void WriteArray(const vector<T> &v) {
+    this->Write((uint32_t) v.size());
+    if (!v.empty())
+      this->WriteBlock(v.data(), v.size() * sizeof(T));
+  }
+};
+
+/// Reads a save file. All chunks are read and their checksums
+/// verified when the reader is created. Errors throw runtime_error.
+class SaveFileReader {
+protected:
+  uint32_t version;
+  map<uint32_t, vector<char>> chunks;
+  const vector<char> *current;
+  size_t pos;
+
+public:
+  /// Read the header and all chunks from the given stream.
+  SaveFileReader(istream &s);
+
+  uint32_t GetVersion() const { return this->version; }
+
+  bool HasChunk(const char *tag) const;
+
+  /// Make the chunk with the given tag the current one. Subsequent
+  /// reads return data from its payload.
+  void OpenChunk(const char *tag);
+
+  /// Return the number of bytes left in the current chunk.
+  size_t GetRemainingSize() const;
+
+  void ReadBlock(void *data, size_t size);
+  void ReadString(string &str);
+  void ReadMap(map<string, string> &m);
+
+  template <typename T>
+  void Read(T &v) {
+    this->ReadBlock(&v, sizeof(T));
+  }
+
+  /// Read an array written by SaveFileWriter::WriteArray. The count
+  /// is checked against what's left in the chunk before anything is
+  /// allocated.
+  template <typename T>
+  void ReadArray(vector<T> &v) {
+    uint32_t size;
+    this->Read(size);
+    if (size > this->GetRemainingSize() / sizeof(T))
+      throw runtime_error("Read past the end of a save file chunk.");
+
+    v.resize(size);
+    if (size > 0)
+      this->ReadBlock(v.data(), size * sizeof(T));
+  }
+};
+
+#endif /* _GRAVITY_SAVE_FILE_HH_ */
@@ -0,0 +1,274 @@
+#include "save-test.hh"
+#include "saved-world.hh"
+#include "entity-pool.hh"
+#include "save-file.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace SaveTest {
+
+static int failures = 0;
+
+static void Fail(ostream &s, const string &what) {
+  s << "FAIL: " << what << endl;
+  failures++;
+}
+
+static Entity *AddEntity(EntityPool &pool,
+                         b2World &world,
+                         EntityType type,
+                         b2BodyType bodyType,
+                         const b2Shape &shape,
+                         b2Vec2 pos,
+                         b2Vec2 velocity)
+{
+  Entity *e = pool.Create();
+  e->type = type;
+
+  b2BodyDef bd;
+  bd.type = bodyType;
+  bd.position = pos;
+  bd.linearVelocity = velocity;
+  bd.userData.pointer = e->handle.value;
+  e->body = world.CreateBody(&bd);
+
+  b2FixtureDef fd;
+  fd.shape = &shape;
+  fd.density = 1.0;
+  fd.isSensor = type == EntityType::COLLECTIBLE;
+  e->body->CreateFixture(&fd);
+
+  Transform t;
+  t.body = e->body;
+  t.pos = pos;
+  pool.transforms.Add(e->handle, t);
+
+  return e;
+}
+
+/// Fill the pool with a bit of everything a game has, without going
+/// through the entity factories (which need the resources).
+static void BuildWorld(EntityPool &pool, b2World &world) {
+  b2CircleShape circle;
+  circle.m_radius = 6.0;
+  Entity *sun = AddEntity(pool, world, EntityType::SUN, b2_dynamicBody, circle, b2Vec2(0.0, 0.0), b2Vec2(0.0, 0.0));
+  GravitySource source;
+  source.coeff = 5000.0;
+  pool.gravitySources.Add(sun->handle, source);
+
+  for (int i = 0; i < 3; ++i) {
+    circle.m_radius = 1.0 + i;
+    Entity *planet = AddEntity(pool, world, EntityType::PLANET, b2_dynamicBody, circle,
+                               b2Vec2(20.0 * (i + 1), 0.0), b2Vec2(0.0, 10.0 - i));
+    pool.gravityReceivers.Add(planet->handle);
+
+    Lifetime lifetime;
+    lifetime.policy = ExpiryPolicy::LOSE_LIFE;
+    lifetime.age = 1.5 * i;
+    pool.lifetimes.Add(planet->handle, lifetime);
+
+    Trail *trail = pool.trails.Add(planet->handle);
+    trail->size = 30;
+    trail->time = 1.0;
+    for (int j = 0; j < 10 * i; ++j)
+      trail->points.push_back(TrailPoint(b2Vec2(j, i), 0.1 * j));
+    trail->ComputeBounds();
+  }
+
+  b2PolygonShape box;
+  box.SetAsBox(1.5, 1.5);
+  for (int i = 0; i < 2; ++i) {
+    Entity *collectible = AddEntity(pool, world, EntityType::COLLECTIBLE, b2_staticBody, box,
+                                    b2Vec2(-10.0, 10.0 * i), b2Vec2(0.0, 0.0));
+    CollectiblePayload payload;
+    payload.type = i ? CollectibleType::SPAWN_PLANET : CollectibleType::MINUS_TIME;
+    payload.time = i ? 0 : -10;
+    payload.spawnPlanet = i == 1;
+    pool.collectibles.Add(collectible->handle, payload);
+
+    Lifetime lifetime;
+    lifetime.policy = ExpiryPolicy::FADE_OUT;
+    lifetime.age = 3.0;
+    lifetime.maxAge = 20.0;
+    pool.lifetimes.Add(collectible->handle, lifetime);
+  }
+
+  b2Vec2 vertices[] = {
+    b2Vec2(-1.84375, -2.0),
+    b2Vec2(-2.453125, 0.1171875),
+    b2Vec2(-0.96875, 1.9921875),
+    b2Vec2(0.9453125, 1.9921875),
+    b2Vec2(2.4453125, 0.1171875),
+  };
+  b2PolygonShape ship;
+  ship.Set(vertices, 5);
+  Entity *enemy = AddEntity(pool, world, EntityType::ENEMY, b2_dynamicBody, ship,
+                            b2Vec2(30.0, -30.0), b2Vec2(-10.0, 10.0));
+  pool.lifetimes.Add(enemy->handle);
+
+  // A ballistic enemy has no body.
+  Entity *ballistic = pool.Create();
+  ballistic->type = EntityType::ENEMY;
+  Transform t;
+  t.pos.Set(-40.0, 40.0);
+  t.angle = 0.5;
+  pool.transforms.Add(ballistic->handle, t);
+  Ballistic b;
+  b.velocity.Set(14.0, -14.0);
+  b.radius = 2.7;
+  pool.ballistics.Add(ballistic->handle, b);
+  pool.lifetimes.Add(ballistic->handle);
+}
+
+static string Save(const EntityPool &pool) {
+  ostringstream s;
+  SaveFileWriter w(s);
+  SavedWorld::Write(w, pool);
+  return s.str();
+}
+
+static void Load(const string &data, EntityPool &pool, b2World &world) {
+  istringstream s(data);
+  SaveFileReader r(s);
+  SavedWorld saved;
+  saved.Read(r);
+  saved.Create(pool, &world);
+}
+
+/// Load 'data' into a fresh pool, and save that again if it loaded.
+/// Returns whether it loaded; errors other than runtime_error are
+/// failures.
+static bool TryLoad(ostream &s, const string &what, const string &data) {
+  EntityPool pool;
+  b2World world(b2Vec2(0.0, 0.0));
+  try {
+    Load(data, pool, world);
+    Save(pool);
+    return true;
+  }
+  catch (runtime_error &e) {
+    return false;
+  }
+  catch (exception &e) {
+    Fail(s, what + ": " + e.what());
+    return false;
+  }
+}
+
+static void RoundTrip(ostream &s, const string &data) {
+  EntityPool pool;
+  b2World world(b2Vec2(0.0, 0.0));
+  Load(data, pool, world);
+  if (Save(pool) != data)
+    Fail(s, "saving a loaded world gives a different file");
+}
+
+static void Truncated(ostream &s, const string &data) {
+  for (size_t size = 0; size < data.size(); ++size)
+    if (TryLoad(s, "truncated to " + to_string(size) + " bytes", data.substr(0, size)))
+      Fail(s, "loaded a file truncated to " + to_string(size) + " bytes");
+}
+
+static void Corrupted(ostream &s, const string &data) {
+  // Whatever gets through the checksums (like a damaged tag, which
+  // makes a chunk unknown) must either load or be rejected cleanly.
+  for (size_t i = 0; i < data.size(); ++i) {
+    string corrupted = data;
+    corrupted[i] ^= 0x5a;
+    TryLoad(s, "byte " + to_string(i) + " corrupted", corrupted);
+  }
+
+  // Huge sizes, which aren't covered by the checksums, must not be
+  // allocated.
+  const size_t HEADER_SIZE = 3 * sizeof(uint32_t);
+  uint32_t huge = 0xfffffff0;
+  string corrupted = data;
+  memcpy(&corrupted[HEADER_SIZE + sizeof(uint32_t)], &huge, sizeof(huge));
+  if (TryLoad(s, "huge chunk size", corrupted))
+    Fail(s, "loaded a file with a huge chunk size");
+
+  ostringstream hugeArray;
+  {
+    SaveFileWriter w(hugeArray);
+    w.BeginChunk("ENTS");
+    w.Write(huge);
+    w.EndChunk();
+  }
+  if (TryLoad(s, "huge array", hugeArray.str()))
+    Fail(s, "loaded a file with a huge array");
+}
+
+/// Files that are well formed but describe an impossible world.
+static void Invalid(ostream &s) {
+  EntityPool pool;
+  b2World world(b2Vec2(0.0, 0.0));
+  BuildWorld(pool, world);
+
+  Entity *e = *pool.begin();
+  EntityType type = e->type;
+  e->type = (EntityType) 42;
+  if (TryLoad(s, "invalid entity type", Save(pool)))
+    Fail(s, "loaded an entity of an invalid type");
+
+  e->type = EntityType::PLANET;
+  if (TryLoad(s, "no sun", Save(pool)))
+    Fail(s, "loaded a world without a sun");
+  e->type = type;
+
+  pool.collectibles[0].type = (CollectibleType) 42;
+  if (TryLoad(s, "invalid collectible", Save(pool)))
+    Fail(s, "loaded a collectible of an invalid type");
+  pool.collectibles[0].type = CollectibleType::MINUS_TIME;
+
+  // Polygons Box2D wouldn't make as they are: with a vertex on top of
+  // another, and with one in the middle of an edge.
+  for (auto e : pool) {
+    if (e->type != EntityType::ENEMY || !e->body)
+      continue;
+
+    b2PolygonShape *polygon = (b2PolygonShape*) e->body->GetFixtureList()->GetShape();
+    b2Vec2 vertex = polygon->m_vertices[1];
+    polygon->m_vertices[1] = polygon->m_vertices[0];
+    if (TryLoad(s, "duplicate polygon vertex", Save(pool)))
+      Fail(s, "loaded a polygon with a duplicate vertex");
+
+    polygon->m_vertices[1] = 0.5 * (polygon->m_vertices[0] + polygon->m_vertices[2]);
+    if (TryLoad(s, "collinear polygon vertices", Save(pool)))
+      Fail(s, "loaded a polygon with collinear vertices");
+    polygon->m_vertices[1] = vertex;
+  }
+}
+
+int Run(ostream &s) {
+  failures = 0;
+
+  EntityPool pool;
+  b2World world(b2Vec2(0.0, 0.0));
+  BuildWorld(pool, world);
+  string data = Save(pool);
+
+  try {
+    RoundTrip(s, data);
+    Truncated(s, data);
+    Corrupted(s, data);
+    Invalid(s);
+  }
+  catch (exception &e) {
+    Fail(s, e.what());
+  }
+
+  s << (failures ? "Save file checks failed." : "Save file checks passed.")
+    << " (" << data.size() << " byte file, " << pool.size() << " entities)" << endl;
+
+  return failures ? 1 : 0;
+}
+
+} // namespace SaveTest
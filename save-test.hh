@@ -0,0 +1,19 @@
+#ifndef _GRAVITY_SAVE_TEST_HH_
+#define _GRAVITY_SAVE_TEST_HH_
+
+#include <ostream>
+
+using namespace std;
+
+/// Checks of the save file code, run instead of the game with the
+/// --test-save command line option. Like the benchmarks, they don't
+/// need a window or any resources.
+namespace SaveTest {
+
+/// Run all the checks, writing what fails to 's'. Returns the exit
+/// code for the program: zero if everything passed.
+extern int Run(ostream &s);
+
+} // namespace SaveTest
+
+#endif /* _GRAVITY_SAVE_TEST_HH_ */
@@ -0,0 +1,450 @@
+#include "saved-world.hh"
+#include "entity-pool.hh"
+#include "save-file.hh"
+
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+/// Return the rows (in the entity table) of the owners of the
+/// components in the given store.
+template <typename T>
+static vector<uint32_t> GetOwnerRows(const ComponentStore<T> &store, const map<uint32_t, uint32_t> &rows) {
+  vector<uint32_t> owners(store.size());
+  for (size_t i = 0; i < store.size(); ++i)
+    owners[i] = rows.at(store.GetOwner(i).value);
+
+  return owners;
+}
+
+template <typename T>
+static void AddComponents(ComponentStore<T> &store,
+                          const vector<uint32_t> &owners,
+                          const vector<T> &values,
+                          const vector<EntityHandle> &handles)
+{
+  for (size_t i = 0; i < owners.size(); ++i)
+    store.Add(handles[owners[i]], values[i]);
+}
+
+static bool IsValid(const b2Vec2 &v) {
+  return b2IsValid(v.x) && b2IsValid(v.y);
+}
+
+SavedWorld::SavedWorld() :
+  hasLifetimes(false)
+{
+}
+
+void SavedWorld::Write(SaveFileWriter &w, const EntityPool &pool) {
+  // Components refer to entities by their row in the table, since
+  // handles change when loading.
+  map<uint32_t, uint32_t> rows;
+  vector<uint8_t> types;
+  for (auto e : pool) {
+    rows[e->handle.value] = types.size();
+    types.push_back((uint8_t) e->type);
+  }
+
+  w.BeginChunk("ENTS");
+  w.WriteArray(types);
+  w.EndChunk();
+
+  vector<FixtureState> fixtures;
+  w.BeginChunk("BODY");
+  for (auto e : pool) {
+    BodyState body;
+    fixtures.clear();
+    body.Capture(e->body, fixtures);
+    body.Write(w, fixtures);
+  }
+  w.EndChunk();
+
+  auto &transforms = pool.transforms;
+  vector<uint32_t> owners(transforms.size());
+  vector<b2Vec2> positions(transforms.size());
+  vector<float> angles(transforms.size());
+  for (size_t i = 0; i < transforms.size(); ++i) {
+    owners[i] = rows.at(transforms.GetOwner(i).value);
+    positions[i] = transforms[i].pos;
+    angles[i] = transforms[i].angle;
+  }
+
+  w.BeginChunk("XFRM");
+  w.WriteArray(owners);
+  w.WriteArray(positions);
+  w.WriteArray(angles);
+  w.EndChunk();
+
+  // Components are written a field at a time, each field as an array
+  // of a fixed-size type, so that the file doesn't depend on how the
+  // compiler lays out the structs (or on their padding).
+  auto &sources = pool.gravitySources;
+  vector<float> coeffs(sources.size());
+  for (size_t i = 0; i < sources.size(); ++i)
+    coeffs[i] = sources[i].coeff;
+
+  w.BeginChunk("GSRC");
+  w.WriteArray(GetOwnerRows(sources, rows));
+  w.WriteArray(coeffs);
+  w.EndChunk();
+
+  auto &receivers = pool.gravityReceivers;
+  vector<b2Vec2> forces(receivers.size());
+  for (size_t i = 0; i < receivers.size(); ++i)
+    forces[i] = receivers[i].force;
+
+  w.BeginChunk("GRCV");
+  w.WriteArray(GetOwnerRows(receivers, rows));
+  w.WriteArray(forces);
+  w.EndChunk();
+
+  auto &collectibles = pool.collectibles;
+  vector<int32_t> collectibleTypes(collectibles.size());
+  vector<int32_t> scores(collectibles.size());
+  vector<int32_t> collectibleTimes(collectibles.size());
+  vector<uint8_t> spawnPlanets(collectibles.size());
+  for (size_t i = 0; i < collectibles.size(); ++i) {
+    collectibleTypes[i] = (int32_t) collectibles[i].type;
+    scores[i] = collectibles[i].score;
+    collectibleTimes[i] = collectibles[i].time;
+    spawnPlanets[i] = collectibles[i].spawnPlanet;
+  }
+
+  w.BeginChunk("COLL");
+  w.WriteArray(GetOwnerRows(collectibles, rows));
+  w.WriteArray(collectibleTypes);
+  w.WriteArray(scores);
+  w.WriteArray(collectibleTimes);
+  w.WriteArray(spawnPlanets);
+  w.EndChunk();
+
+  auto &lifetimes = pool.lifetimes;
+  vector<uint8_t> policies(lifetimes.size());
+  vector<float> ages(lifetimes.size());
+  vector<float> maxAges(lifetimes.size());
+  for (size_t i = 0; i < lifetimes.size(); ++i) {
+    policies[i] = (uint8_t) lifetimes[i].policy;
+    ages[i] = lifetimes[i].age;
+    maxAges[i] = lifetimes[i].maxAge;
+  }
+
+  w.BeginChunk("LIFE");
+  w.WriteArray(GetOwnerRows(lifetimes, rows));
+  w.WriteArray(policies);
+  w.WriteArray(ages);
+  w.WriteArray(maxAges);
+  w.EndChunk();
+
+  auto &ballistics = pool.ballistics;
+  vector<b2Vec2> velocities(ballistics.size());
+  vector<float> radii(ballistics.size());
+  for (size_t i = 0; i < ballistics.size(); ++i) {
+    velocities[i] = ballistics[i].velocity;
+    radii[i] = ballistics[i].radius;
+  }
+
+  w.BeginChunk("BALL");
+  w.WriteArray(GetOwnerRows(ballistics, rows));
+  w.WriteArray(velocities);
+  w.WriteArray(radii);
+  w.EndChunk();
+
+  // Trail points of all the trails go in a single block.
+  auto &trails = pool.trails;
+  vector<int32_t> sizes(trails.size());
+  vector<float> times(trails.size());
+  vector<uint32_t> pointCounts(trails.size());
+  vector<TrailPoint> points;
+  for (size_t i = 0; i < trails.size(); ++i) {
+    sizes[i] = trails[i].size;
+    times[i] = trails[i].time;
+    pointCounts[i] = trails[i].points.size();
+    points.insert(points.end(), trails[i].points.begin(), trails[i].points.end());
+  }
+
+  w.BeginChunk("TRAI");
+  w.WriteArray(GetOwnerRows(trails, rows));
+  w.WriteArray(sizes);
+  w.WriteArray(times);
+  w.WriteArray(pointCounts);
+  w.WriteArray(points);
+  w.EndChunk();
+}
+
+/// Read an array written by SaveFileWriter::WriteArray, which must
+/// have one element per component.
+template <typename T>
+static void ReadColumn(SaveFileReader &r, vector<T> &column, size_t size) {
+  r.ReadArray(column);
+  if (column.size() != size)
+    throw runtime_error("Invalid components in save file.");
+}
+
+template <typename T>
+void SavedWorld::ReadOwners(SaveFileReader &r, const char *tag, Components<T> &components) {
+  r.OpenChunk(tag);
+  r.ReadArray(components.owners);
+  for (auto owner : components.owners)
+    if (owner >= this->types.size())
+      throw runtime_error("Invalid entity in saved components.");
+
+  components.values.assign(components.owners.size(), T());
+}
+
+void SavedWorld::ReadComponents(SaveFileReader &r) {
+  size_t n;
+
+  this->ReadOwners(r, "GSRC", this->gravitySources);
+  n = this->gravitySources.owners.size();
+  vector<float> coeffs;
+  ReadColumn(r, coeffs, n);
+  for (size_t i = 0; i < n; ++i)
+    this->gravitySources.values[i].coeff = coeffs[i];
+
+  this->ReadOwners(r, "GRCV", this->gravityReceivers);
+  n = this->gravityReceivers.owners.size();
+  vector<b2Vec2> forces;
+  ReadColumn(r, forces, n);
+  for (size_t i = 0; i < n; ++i)
+    this->gravityReceivers.values[i].force = forces[i];
+
+  this->ReadOwners(r, "COLL", this->collectibles);
+  n = this->collectibles.owners.size();
+  vector<int32_t> collectibleTypes, scores, collectibleTimes;
+  vector<uint8_t> spawnPlanets;
+  ReadColumn(r, collectibleTypes, n);
+  ReadColumn(r, scores, n);
+  ReadColumn(r, collectibleTimes, n);
+  ReadColumn(r, spawnPlanets, n);
+  for (size_t i = 0; i < n; ++i) {
+    CollectiblePayload &c = this->collectibles.values[i];
+    c.type = (CollectibleType) collectibleTypes[i];
+    c.score = scores[i];
+    c.time = collectibleTimes[i];
+    c.spawnPlanet = spawnPlanets[i];
+  }
+
+  // Older saves have no lifetimes; they are started from scratch.
+  this->hasLifetimes = r.HasChunk("LIFE");
+  this->lifetimes = Components<Lifetime>();
+  if (this->hasLifetimes) {
+    this->ReadOwners(r, "LIFE", this->lifetimes);
+    n = this->lifetimes.owners.size();
+    vector<uint8_t> policies;
+    vector<float> ages, maxAges;
+    ReadColumn(r, policies, n);
+    ReadColumn(r, ages, n);
+    ReadColumn(r, maxAges, n);
+    for (size_t i = 0; i < n; ++i) {
+      Lifetime &l = this->lifetimes.values[i];
+      l.policy = (ExpiryPolicy) policies[i];
+      l.age = ages[i];
+      l.maxAge = maxAges[i];
+    }
+  }
+
+  this->ballistics = Components<Ballistic>();
+  if (r.HasChunk("BALL")) {
+    this->ReadOwners(r, "BALL", this->ballistics);
+    n = this->ballistics.owners.size();
+    vector<b2Vec2> velocities;
+    vector<float> radii;
+    ReadColumn(r, velocities, n);
+    ReadColumn(r, radii, n);
+    for (size_t i = 0; i < n; ++i) {
+      this->ballistics.values[i].velocity = velocities[i];
+      this->ballistics.values[i].radius = radii[i];
+    }
+  }
+}
+
+void SavedWorld::ReadVersion1Components(SaveFileReader &r) {
+  // Version 1 wrote the components as they were laid out in memory by
+  // the compilers the game was built with: all 32-bit fields, except
+  // for the byte-sized ones, which are padded to 4 bytes.
+  uint8_t padding[3];
+
+  this->ReadOwners(r, "GSRC", this->gravitySources);
+  for (auto &c : this->gravitySources.values)
+    r.Read(c.coeff);
+
+  this->ReadOwners(r, "GRCV", this->gravityReceivers);
+  for (auto &c : this->gravityReceivers.values)
+    r.Read(c.force);
+
+  this->ReadOwners(r, "COLL", this->collectibles);
+  for (auto &c : this->collectibles.values) {
+    int32_t type, score, time;
+    uint8_t spawnPlanet;
+    r.Read(type);
+    r.Read(score);
+    r.Read(time);
+    r.Read(spawnPlanet);
+    r.ReadBlock(padding, 3);
+    c.type = (CollectibleType) type;
+    c.score = score;
+    c.time = time;
+    c.spawnPlanet = spawnPlanet;
+  }
+
+  this->hasLifetimes = r.HasChunk("LIFE");
+  this->lifetimes = Components<Lifetime>();
+  if (this->hasLifetimes) {
+    this->ReadOwners(r, "LIFE", this->lifetimes);
+    for (auto &c : this->lifetimes.values) {
+      uint8_t policy;
+      r.Read(policy);
+      r.ReadBlock(padding, 3);
+      r.Read(c.age);
+      r.Read(c.maxAge);
+      c.policy = (ExpiryPolicy) policy;
+    }
+  }
+
+  this->ballistics = Components<Ballistic>();
+  if (r.HasChunk("BALL")) {
+    this->ReadOwners(r, "BALL", this->ballistics);
+    for (auto &c : this->ballistics.values) {
+      r.Read(c.velocity);
+      r.Read(c.radius);
+    }
+  }
+}
+
+void SavedWorld::Read(SaveFileReader &r) {
+  r.OpenChunk("ENTS");
+  r.ReadArray(this->types);
+
+  // Suns and planets are always used through the radius of their
+  // first fixture, and there has to be a sun.
+  bool hasSun = false;
+  this->bodies.resize(this->types.size());
+  this->fixtures.clear();
+  r.OpenChunk("BODY");
+  for (size_t i = 0; i < this->types.size(); ++i) {
+    EntityType type = (EntityType) this->types[i];
+    if (type != EntityType::SUN && type != EntityType::PLANET &&
+        type != EntityType::COLLECTIBLE && type != EntityType::ENEMY)
+      throw runtime_error("Invalid entity type in save file.");
+
+    BodyState &body = this->bodies[i];
+    body.Read(r, this->fixtures);
+    if (body.exists && body.fixtureCount == 0)
+      throw runtime_error("Body without fixtures in save file.");
+    if ((type == EntityType::SUN || type == EntityType::PLANET) && !body.exists)
+      throw runtime_error("Sun or planet without a body in save file.");
+
+    if (type == EntityType::SUN)
+      hasSun = true;
+  }
+
+  if (!hasSun)
+    throw runtime_error("Save file has no sun.");
+
+  r.OpenChunk("XFRM");
+  r.ReadArray(this->transformOwners);
+  r.ReadArray(this->positions);
+  r.ReadArray(this->angles);
+  if (this->positions.size() != this->transformOwners.size() ||
+      this->angles.size() != this->transformOwners.size())
+    throw runtime_error("Invalid transforms in save file.");
+
+  for (size_t i = 0; i < this->transformOwners.size(); ++i)
+    if (this->transformOwners[i] >= this->types.size() ||
+        !IsValid(this->positions[i]) || !b2IsValid(this->angles[i]))
+      throw runtime_error("Invalid transform in save file.");
+
+  if (r.GetVersion() == 1)
+    this->ReadVersion1Components(r);
+  else
+    this->ReadComponents(r);
+
+  for (auto &c : this->gravitySources.values)
+    if (!b2IsValid(c.coeff))
+      throw runtime_error("Invalid gravity source in save file.");
+
+  for (auto &c : this->gravityReceivers.values)
+    if (!IsValid(c.force))
+      throw runtime_error("Invalid gravity receiver in save file.");
+
+  for (auto &c : this->collectibles.values)
+    if (c.type != CollectibleType::PLUS_SCORE && c.type != CollectibleType::MINUS_SCORE &&
+        c.type != CollectibleType::PLUS_TIME && c.type != CollectibleType::MINUS_TIME &&
+        c.type != CollectibleType::SPAWN_PLANET)
+      throw runtime_error("Invalid collectible in save file.");
+
+  for (auto &l : this->lifetimes.values)
+    if ((l.policy != ExpiryPolicy::DESPAWN && l.policy != ExpiryPolicy::LOSE_LIFE &&
+         l.policy != ExpiryPolicy::FADE_OUT) || !b2IsValid(l.age) || !b2IsValid(l.maxAge))
+      throw runtime_error("Invalid lifetime in save file.");
+
+  for (auto &b : this->ballistics.values)
+    if (!IsValid(b.velocity) || !b2IsValid(b.radius))
+      throw runtime_error("Invalid ballistic entity in save file.");
+
+  r.OpenChunk("TRAI");
+  r.ReadArray(this->trailOwners);
+  r.ReadArray(this->trailSizes);
+  r.ReadArray(this->trailTimes);
+  r.ReadArray(this->trailPointCounts);
+  r.ReadArray(this->trailPoints);
+  if (this->trailSizes.size() != this->trailOwners.size() ||
+      this->trailTimes.size() != this->trailOwners.size() ||
+      this->trailPointCounts.size() != this->trailOwners.size())
+    throw runtime_error("Invalid trails in save file.");
+
+  size_t next = 0;
+  for (size_t i = 0; i < this->trailOwners.size(); ++i) {
+    if (this->trailOwners[i] >= this->types.size() ||
+        this->trailPointCounts[i] > this->trailPoints.size() - next)
+      throw runtime_error("Invalid trail in save file.");
+    next += this->trailPointCounts[i];
+  }
+}
+
+void SavedWorld::Create(EntityPool &pool, b2World *world) const {
+  vector<EntityHandle> handles;
+  for (size_t i = 0; i < this->types.size(); ++i) {
+    Entity *e = pool.Create();
+    e->type = (EntityType) this->types[i];
+    e->body = this->bodies[i].Create(world, this->fixtures, e->handle);
+    handles.push_back(e->handle);
+  }
+
+  for (size_t i = 0; i < this->transformOwners.size(); ++i) {
+    EntityHandle h = handles[this->transformOwners[i]];
+    Transform t;
+    t.body = pool.Get(h)->body;
+    t.pos = this->positions[i];
+    t.angle = this->angles[i];
+    pool.transforms.Add(h, t);
+  }
+
+  AddComponents(pool.gravitySources, this->gravitySources.owners, this->gravitySources.values, handles);
+  AddComponents(pool.gravityReceivers, this->gravityReceivers.owners, this->gravityReceivers.values, handles);
+  AddComponents(pool.collectibles, this->collectibles.owners, this->collectibles.values, handles);
+  AddComponents(pool.ballistics, this->ballistics.owners, this->ballistics.values, handles);
+
+  if (this->hasLifetimes)
+    AddComponents(pool.lifetimes, this->lifetimes.owners, this->lifetimes.values, handles);
+  else
+    for (auto e : pool)
+      Entity::AddLifetime(&pool, e);
+
+  size_t next = 0;
+  for (size_t i = 0; i < this->trailOwners.size(); ++i) {
+    Trail t;
+    t.size = this->trailSizes[i];
+    t.time = this->trailTimes[i];
+    t.points.assign(this->trailPoints.begin() + next,
+                    this->trailPoints.begin() + next + this->trailPointCounts[i]);
+    t.ComputeBounds();
+    next += this->trailPointCounts[i];
+    pool.trails.Add(handles[this->trailOwners[i]], t);
+  }
+
+  for (auto h : handles)
+    pool.NotifyCreated(pool.Get(h));
+}
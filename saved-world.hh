@@ -0,0 +1,74 @@
+#ifndef _GRAVITY_SAVED_WORLD_HH_
+#define _GRAVITY_SAVED_WORLD_HH_
+
+#include "body-state.hh"
+#include "components.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class EntityPool;
+class SaveFileWriter;
+class SaveFileReader;
+
+/// The entities of a game as stored in a save file: a table with one
+/// row per entity, its body, and its components, which refer to the
+/// entities by row.
+///
+/// Loading reads the whole table into one of these and checks it
+/// before the current game is touched, so a bad file is rejected
+/// without losing anything, and creating the entities can't fail.
+class SavedWorld {
+protected:
+  template <typename T>
+  struct Components {
+    vector<uint32_t> owners;
+    vector<T> values;
+  };
+
+  vector<uint8_t> types;
+  vector<BodyState> bodies;
+  vector<FixtureState> fixtures;
+
+  vector<uint32_t> transformOwners;
+  vector<b2Vec2> positions;
+  vector<float> angles;
+
+  Components<GravitySource> gravitySources;
+  Components<GravityReceiver> gravityReceivers;
+  Components<CollectiblePayload> collectibles;
+  Components<Lifetime> lifetimes;
+  Components<Ballistic> ballistics;
+  bool hasLifetimes;
+
+  vector<uint32_t> trailOwners;
+  vector<int32_t> trailSizes;
+  vector<float> trailTimes;
+  vector<uint32_t> trailPointCounts;
+  vector<TrailPoint> trailPoints;
+
+  template <typename T>
+  void ReadOwners(SaveFileReader &r, const char *tag, Components<T> &components);
+  void ReadComponents(SaveFileReader &r);
+  void ReadVersion1Components(SaveFileReader &r);
+
+public:
+  SavedWorld();
+
+  /// Write all the entities in the pool.
+  static void Write(SaveFileWriter &w, const EntityPool &pool);
+
+  /// Read and check the entities written by Write. Errors throw
+  /// runtime_error.
+  void Read(SaveFileReader &r);
+
+  /// Create the entities read into the given (empty) pool, with their
+  /// bodies in the given world. Sprites and sounds are not created.
+  void Create(EntityPool &pool, b2World *world) const;
+};
+
+#endif /* _GRAVITY_SAVED_WORLD_HH_ */
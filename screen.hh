@@ -15,9 +15,11 @@ using namespace std;
 class Screen {
 protected:
   vector<Widget*> widgets;
+  bool dirty;
 
 public:
   Screen(SDL_Window *window) :
+    dirty(true),
     window(window)
   {}
 
@@ -39,6 +41,17 @@ public:
 
   virtual void Advance(float dt) = 0;
   virtual void Render(Renderer *renderer) = 0;
+
+  /// Mark the screen as needing to be advanced and rendered. The main
+  /// loop does this for every event the screen receives.
+  void Invalidate() { this->dirty = true; }
+  void ClearDirty() { this->dirty = false; }
+
+  /// Return true if the screen has to be advanced and rendered in the
+  /// next frame. When it doesn't, the main loop sleeps until the next
+  /// event. Screens that change on their own (animations, timers,
+  /// physics) override this.
+  virtual bool IsDirty() const { return this->dirty; }
 };
 
 #endif /* _GRAVITY_SCREEN_HH_ */
@@ -0,0 +1,177 @@
+#include "spawn-placer.hh"
+#include "helpers.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Random cells tried before looking at all of them. Most of the area
+// is usually free.
+const int SAMPLE_TRIES = 8;
+
+SpawnPlacer::SpawnPlacer(float cellSize, int maxCells) :
+  cellSize(cellSize),
+  maxCells(maxCells),
+  cellWidth(cellSize),
+  cellHeight(cellSize),
+  columns(0),
+  rows(0)
+{
+  this->area.lowerBound.SetZero();
+  this->area.upperBound.SetZero();
+}
+
+void SpawnPlacer::SetArea(const b2AABB &area) {
+  b2Vec2 size = area.upperBound - area.lowerBound;
+
+  float cell = this->cellSize;
+  if ((size.x / cell) * (size.y / cell) > this->maxCells)
+    cell = sqrt(size.x * size.y / this->maxCells);
+
+  this->area = area;
+  this->columns = max(1, (int) ceil(size.x / cell));
+  this->rows = max(1, (int) ceil(size.y / cell));
+  this->cellWidth = size.x / this->columns;
+  this->cellHeight = size.y / this->rows;
+
+  this->counts.assign(this->columns * this->rows * LAYER_COUNT, 0);
+  for (auto &o : this->obstacles)
+    this->Draw(o, 1);
+}
+
+int SpawnPlacer::IndexOf(EntityHandle h) const {
+  uint32_t index = h.GetIndex();
+  if (index >= this->obstacleIndex.size())
+    return -1;
+
+  int i = this->obstacleIndex[index];
+  if (i < 0 || this->obstacles[i].handle != h)
+    return -1;
+
+  return i;
+}
+
+void SpawnPlacer::Draw(const Obstacle &o, int delta) {
+  b2Vec2 p = o.center - this->area.lowerBound;
+  float radius = o.radius;
+
+  int x1 = max(0, (int) floor((p.x - radius) / this->cellWidth));
+  int x2 = min(this->columns - 1, (int) floor((p.x + radius) / this->cellWidth));
+  int y1 = max(0, (int) floor((p.y - radius) / this->cellHeight));
+  int y2 = min(this->rows - 1, (int) floor((p.y + radius) / this->cellHeight));
+
+  for (int y = y1; y <= y2; ++y)
+    for (int x = x1; x <= x2; ++x) {
+      // Distance from the center to the closest point of the cell.
+      float dx = max(0.0f, max(x * this->cellWidth - p.x, p.x - (x + 1) * this->cellWidth));
+      float dy = max(0.0f, max(y * this->cellHeight - p.y, p.y - (y + 1) * this->cellHeight));
+      if (dx * dx + dy * dy < radius * radius)
+        this->counts[(y * this->columns + x) * LAYER_COUNT + o.layer] += delta;
+    }
+}
+
+bool SpawnPlacer::IsFree(int cell, unsigned layers) const {
+  for (int layer = 0; layer < LAYER_COUNT; ++layer)
+    if ((layers & (1 << layer)) && this->counts[cell * LAYER_COUNT + layer] > 0)
+      return false;
+
+  return true;
+}
+
+void SpawnPlacer::Add(EntityHandle h, const b2Vec2 &center, float radius, int layer) {
+  this->Remove(h);
+
+  uint32_t index = h.GetIndex();
+  if (index >= this->obstacleIndex.size())
+    this->obstacleIndex.resize(index + 1, -1);
+
+  // Drawn this much larger, so that small moves don't change the cells.
+  Obstacle o;
+  o.handle = h;
+  o.center = center;
+  o.radius = radius + 0.5 * this->cellSize;
+  o.layer = layer;
+  this->obstacleIndex[index] = this->obstacles.size();
+  this->obstacles.push_back(o);
+  this->Draw(o, 1);
+}
+
+void SpawnPlacer::Move(EntityHandle h, const b2Vec2 &center) {
+  int i = this->IndexOf(h);
+  if (i < 0)
+    return;
+
+  Obstacle &o = this->obstacles[i];
+  float slack = 0.5 * this->cellSize;
+  if ((center - o.center).LengthSquared() <= slack * slack)
+    return;
+
+  this->Draw(o, -1);
+  o.center = center;
+  this->Draw(o, 1);
+}
+
+void SpawnPlacer::Remove(EntityHandle h) {
+  int i = this->IndexOf(h);
+  if (i < 0)
+    return;
+
+  this->Draw(this->obstacles[i], -1);
+
+  // Swap with the last obstacle and pop.
+  int last = this->obstacles.size() - 1;
+  if (i != last) {
+    this->obstacles[i] = this->obstacles[last];
+    this->obstacleIndex[this->obstacles[i].handle.GetIndex()] = i;
+  }
+  this->obstacles.pop_back();
+  this->obstacleIndex[h.GetIndex()] = -1;
+}
+
+bool SpawnPlacer::Sample(const b2AABB &view, unsigned layers, b2Vec2 &pos) {
+  // The cells overlapping the view.
+  b2Vec2 lower = b2Max(view.lowerBound, this->area.lowerBound) - this->area.lowerBound;
+  b2Vec2 upper = b2Min(view.upperBound, this->area.upperBound) - this->area.lowerBound;
+  int x1 = max(0, (int) floor(lower.x / this->cellWidth));
+  int x2 = min(this->columns - 1, (int) floor(upper.x / this->cellWidth));
+  int y1 = max(0, (int) floor(lower.y / this->cellHeight));
+  int y2 = min(this->rows - 1, (int) floor(upper.y / this->cellHeight));
+
+  auto place = [&](int cell) {
+    // Only the part of the cell inside the view.
+    b2Vec2 cellLower = this->area.lowerBound +
+      b2Vec2(cell % this->columns * this->cellWidth, cell / this->columns * this->cellHeight);
+    b2Vec2 a = b2Max(cellLower, view.lowerBound);
+    b2Vec2 b = b2Min(cellLower + b2Vec2(this->cellWidth, this->cellHeight), view.upperBound);
+    pos.x = a.x + frand() * (b.x - a.x);
+    pos.y = a.y + frand() * (b.y - a.y);
+  };
+
+  if (lower.x <= upper.x && lower.y <= upper.y) {
+    int w = x2 - x1 + 1;
+    int h = y2 - y1 + 1;
+    for (int i = 0; i < SAMPLE_TRIES; ++i) {
+      int cell = (y1 + rand() % h) * this->columns + x1 + rand() % w;
+      if (this->IsFree(cell, layers)) {
+        place(cell);
+        return true;
+      }
+    }
+
+    this->freeCells.clear();
+    for (int y = y1; y <= y2; ++y)
+      for (int x = x1; x <= x2; ++x)
+        if (this->IsFree(y * this->columns + x, layers))
+          this->freeCells.push_back(y * this->columns + x);
+
+    if (!this->freeCells.empty()) {
+      place(this->freeCells[rand() % this->freeCells.size()]);
+      return true;
+    }
+  }
+
+  pos.x = view.lowerBound.x + frand() * (view.upperBound.x - view.lowerBound.x);
+  pos.y = view.lowerBound.y + frand() * (view.upperBound.y - view.lowerBound.y);
+  return false;
+}
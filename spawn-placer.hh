@@ -0,0 +1,82 @@
+#ifndef _GRAVITY_SPAWN_PLACER_HH_
+#define _GRAVITY_SPAWN_PLACER_HH_
+
+#include "entity.hh"
+
+#include <box2d/box2d.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/// Chooses random spawn positions away from a set of obstacles,
+/// without trial and error. The spawn area is covered by a coarse grid
+/// counting, for every cell and layer, the obstacles (disks) touching
+/// it, and positions are sampled from the free cells only. Any point of
+/// a free cell is far enough from all the obstacles.
+///
+/// Obstacles are entities, and the grid is kept up to date as they
+/// come, go and move, so a spawn only looks at the grid. A moving
+/// obstacle is drawn a little larger than it is, and only drawn again
+/// once it has moved further than that.
+class SpawnPlacer {
+public:
+  static const int LAYER_COUNT = 2;
+
+protected:
+  struct Obstacle {
+    EntityHandle handle;
+    b2Vec2 center;
+    float radius;
+    int layer;
+  };
+
+  float cellSize;
+  int maxCells;
+
+  b2AABB area;
+  float cellWidth;
+  float cellHeight;
+  int columns;
+  int rows;
+
+  // Obstacle counts, LAYER_COUNT per cell.
+  vector<uint16_t> counts;
+
+  vector<Obstacle> obstacles;
+  vector<int> obstacleIndex;
+  vector<int> freeCells;
+
+  int IndexOf(EntityHandle h) const;
+  void Draw(const Obstacle &o, int delta);
+  bool IsFree(int cell, unsigned layers) const;
+
+public:
+  SpawnPlacer(float cellSize, int maxCells);
+
+  /// Cover the given area, and draw the obstacles again. The cells are
+  /// made larger than the desired size if the area is too large.
+  void SetArea(const b2AABB &area);
+  const b2AABB &GetArea() const { return this->area; }
+
+  /// Keep spawn positions avoiding 'layer' at least 'radius' away from
+  /// 'center', the position of the given entity. Replaces the
+  /// entity's obstacle if it already has one.
+  void Add(EntityHandle h, const b2Vec2 &center, float radius, int layer);
+
+  /// Move the obstacle of the given entity, if it has one. Cheap if it
+  /// hasn't moved much.
+  void Move(EntityHandle h, const b2Vec2 &center);
+
+  void Remove(EntityHandle h);
+
+  /// Choose a random position inside 'view', in a cell free of the
+  /// layers in the 'layers' mask. Returns false, and a random position
+  /// anywhere in the view, if every cell is occupied.
+  bool Sample(const b2AABB &view, unsigned layers, b2Vec2 &pos);
+
+  size_t GetObstacleCount() const { return this->obstacles.size(); }
+};
+
+#endif /* _GRAVITY_SPAWN_PLACER_HH_ */
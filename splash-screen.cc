@@ -5,6 +5,15 @@ SplashScreen::SplashScreen(SDL_Window *window) :
   Screen(window),
   background(window, ResourceCache::GetTexture("splash"))
 {
+  // Decode the rest of the images in the background while the splash
+  // screen is up.
+  ResourceCache::PreloadTextures({
+      "background", "sun", "planet", "trail-point", "plus-score",
+      "minus-score", "plus-time", "minus-time", "plus-planet", "enemy",
+      "pause", "new-game", "high-scores", "exit", "main-menu", "credits",
+      "continue", "end-game", "mute", "unmute", "game-over", "lives0",
+      "lives1", "lives2", "lives3"
+    });
 }
 
 SplashScreen::~SplashScreen() {
@@ -32,57 +41,10 @@ void SplashScreen::Load(istream &s) {
 }
 
 void SplashScreen::Advance(float dt) {
-  static int n = 0;
-
-  switch (n) {
-  case 0:
-    ResourceCache::GetTexture("background");
-    break;
-  case 1:
-    ResourceCache::GetTexture("sun");
-    break;
-  case 2:
-    ResourceCache::GetTexture("planet");
-    break;
-  case 3:
-    ResourceCache::GetTexture("trail-point");
-    break;
-  case 4:
-    ResourceCache::GetTexture("plus-score");
-    break;
-  case 5:
-    ResourceCache::GetTexture("minus-score");
-    break;
-  case 6:
-    ResourceCache::GetTexture("plus-time");
-    break;
-  case 7:
-    ResourceCache::GetTexture("minus-time");
-    break;
-  case 8:
-    ResourceCache::GetTexture("plus-planet");
-    break;
-  case 9:
-    ResourceCache::GetTexture("enemy");
-    break;
-  case 10:
-    ResourceCache::GetTexture("pause");
-    break;
-  case 11:
-    ResourceCache::GetTexture("new-game");
-    break;
-  case 12:
-    ResourceCache::GetTexture("high-scores");
-    break;
-  case 13:
-    ResourceCache::GetTexture("exit");
-    break;
-  default:
+  // Upload the images decoded so far. The splash screen is done once
+  // all of them are.
+  if (ResourceCache::UploadPreloadedTextures())
     this->state["name"] = "splash-over";
-    break;
-  }
-
-  ++n;
 }
 
 void SplashScreen::Render(Renderer *renderer) {
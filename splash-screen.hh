@@ -19,6 +19,7 @@ public:
 
   virtual void Advance(float dt);
   virtual void Render(Renderer *renderer);
+  virtual bool IsDirty() const { return true; }
 };
 
 #endif /* _GRAVITY_SPLASH_HH_ */
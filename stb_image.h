@@ -511,8 +511,10 @@ static stbi_uc *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__gif_info(stbi__context *s, int *x, int *y, int *comp);
 
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// thread_local so that images can be decoded on several threads (a
+// local change; the rest of the decoder keeps no global state once
+// stbi__init_zdefaults has run)
+static thread_local const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -2841,8 +2843,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if ((c.type & (1 << 29)) == 0) {
                #ifndef STBI_NO_FAILURE_STRINGS
-               // not threadsafe
-               static char invalid_chunk[] = "XXXX PNG chunk not known";
+               static thread_local char invalid_chunk[] = "XXXX PNG chunk not known";
                invalid_chunk[0] = STBI__BYTECAST(c.type >> 24);
                invalid_chunk[1] = STBI__BYTECAST(c.type >> 16);
                invalid_chunk[2] = STBI__BYTECAST(c.type >>  8);
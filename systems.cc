@@ -0,0 +1,195 @@
+#include "systems.hh"
+#include "entity-pool.hh"
+#include "job-system.hh"
+#include "alloc-tracker.hh"
+#include "config.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+namespace Systems {
+
+void GatherGravitySources(const EntityPool &pool, vector<GravitySourceState> &sources) {
+  sources.clear();
+  for (size_t i = 0; i < pool.gravitySources.size(); ++i) {
+    const Transform *t = pool.transforms.Get(pool.gravitySources.GetOwner(i));
+    if (!t)
+      continue;
+
+    b2Vec2 pos = t->body ? t->body->GetPosition() : t->pos;
+    sources.push_back(make_pair(pos, pool.gravitySources[i].coeff));
+  }
+}
+
+b2Vec2 GetGravity(const vector<GravitySourceState> &sources, b2Vec2 pos) {
+  b2Vec2 gravity(0.0, 0.0);
+  for (auto &s : sources) {
+    b2Vec2 n = s.first - pos;
+    float r2 = n.LengthSquared();
+    n.Normalize();
+    gravity += s.second / r2 * n;
+  }
+
+  return gravity;
+}
+
+b2Vec2 IntegrateOrbit(const vector<GravitySourceState> &sources,
+                      float invMass,
+                      float dt,
+                      b2Vec2 &pos,
+                      b2Vec2 &velocity)
+{
+  // Choose the number of sub-steps so that each is a small fraction
+  // of the orbital time scale, sqrt(r^3 / GM), at the current
+  // distance from the closest source.
+  float minTimeScale = FLT_MAX;
+  for (auto &s : sources) {
+    float r = (s.first - pos).Length();
+    minTimeScale = min(minTimeScale, sqrtf(r * r * r / (s.second * invMass)));
+  }
+
+  int n = ceil(dt / (Config::OrbitalAccuracy * minTimeScale));
+  n = max(1, min(n, Config::OrbitalMaxSubsteps));
+  float h = dt / n;
+
+  // Leapfrog (kick-drift-kick).
+  b2Vec2 a = invMass * GetGravity(sources, pos);
+  for (int k = 0; k < n; ++k) {
+    velocity += 0.5f * h * a;
+    pos += h * velocity;
+    a = invMass * GetGravity(sources, pos);
+    velocity += 0.5f * h * a;
+  }
+
+  return a;
+}
+
+void ApplyGravity(EntityPool &pool, vector<GravitySourceState> &sources) {
+  ALLOCATION_SCOPE("gravity");
+  GatherGravitySources(pool, sources);
+
+  // Each receiver only touches its own body, so they can be done in
+  // parallel.
+  auto &receivers = pool.gravityReceivers;
+  JobSystem::Get().ParallelFor(receivers.size(), 64, [&pool, &sources, &receivers](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const Transform *t = pool.transforms.Get(receivers.GetOwner(i));
+        if (!t || !t->body)
+          continue;
+
+        b2Vec2 gravity = GetGravity(sources, t->pos);
+        receivers[i].force = gravity;
+        t->body->ApplyForce(gravity, t->body->GetWorldCenter(), true);
+      }
+    });
+}
+
+void SyncTransforms(EntityPool &pool) {
+  for (auto &t : pool.transforms)
+    if (t.body) {
+      t.pos = t.body->GetPosition();
+      t.angle = t.body->GetAngle();
+    }
+}
+
+void UpdateTrails(EntityPool &pool, float time) {
+  ALLOCATION_SCOPE("trails");
+  auto &trails = pool.trails;
+  JobSystem::Get().ParallelFor(trails.size(), 16, [&pool, &trails, time](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        Trail &trail = trails[i];
+        const Transform *t = pool.transforms.Get(trails.GetOwner(i));
+        if (!t)
+          continue;
+
+        // Remove all the points not in the desired time window, and
+        // recompute the bounding box of the rest in the same pass.
+        float minTime = time - trail.time;
+        b2AABB bounds;
+        bounds.lowerBound = bounds.upperBound = t->pos;
+        size_t n = 0;
+        for (auto &p : trail.points) {
+          if (p.time < minTime)
+            continue;
+
+          bounds.lowerBound = b2Min(bounds.lowerBound, p.pos);
+          bounds.upperBound = b2Max(bounds.upperBound, p.pos);
+          trail.points[n++] = p;
+        }
+        trail.points.resize(n);
+
+        // Add current position to the trail.
+        trail.points.push_back(TrailPoint(t->pos, time));
+        trail.bounds = bounds;
+      }
+    });
+}
+
+int AdvanceBallistic(EntityPool &pool,
+                     b2World *world,
+                     float dt,
+                     vector<b2AABB> &targets,
+                     vector<EntityHandle> &promoted)
+{
+  auto &ballistics = pool.ballistics;
+  if (ballistics.size() == 0)
+    return 0;
+
+  // Ballistic entities are enemy ships, which only collide with the
+  // sun and the planets.
+  targets.clear();
+  for (auto e : pool) {
+    if (!e->body || (e->type != EntityType::SUN && e->type != EntityType::PLANET))
+      continue;
+
+    for (b2Fixture *f = e->body->GetFixtureList(); f; f = f->GetNext())
+      targets.push_back(f->GetAABB(0));
+  }
+
+  // Promote the entities whose path over the step, plus a margin,
+  // overlaps a target. The margin leaves the body a few steps to get
+  // into the broad-phase before it touches anything, even if the target
+  // is moving (like the sun being dragged).
+  b2Vec2 margin(Config::BallisticMargin, Config::BallisticMargin);
+  promoted.clear();
+  for (size_t i = 0; i < ballistics.size(); ++i) {
+    Ballistic &b = ballistics[i];
+    EntityHandle h = ballistics.GetOwner(i);
+    Transform *t = pool.transforms.Get(h);
+    if (!t)
+      continue;
+
+    b2Vec2 next = t->pos + dt * b.velocity;
+    b2Vec2 extent = margin + b2Vec2(b.radius, b.radius);
+    b2AABB swept;
+    swept.lowerBound = b2Min(t->pos, next) - extent;
+    swept.upperBound = b2Max(t->pos, next) + extent;
+
+    bool near = false;
+    for (auto &target : targets)
+      if (b2TestOverlap(swept, target)) {
+        near = true;
+        break;
+      }
+
+    if (near)
+      promoted.push_back(h);
+    else
+      t->pos = next;
+  }
+
+  // The promoted bodies are moved by this step, from where they are.
+  for (auto h : promoted) {
+    Entity *e = pool.Get(h);
+    if (e)
+      Entity::Promote(&pool, e, world);
+  }
+
+  return promoted.size();
+}
+
+
+} // namespace Systems
@@ -0,0 +1,70 @@
+#ifndef _GRAVITY_SYSTEMS_HH_
+#define _GRAVITY_SYSTEMS_HH_
+
+#include "entity.hh"
+
+#include <box2d/box2d.h>
+
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class EntityPool;
+
+/// A gravity source as used by the gravity systems: its position and
+/// its coefficient.
+typedef pair<b2Vec2, float> GravitySourceState;
+
+/// The per-step systems that work on the components of an entity pool
+/// alone, so that they can be run by the game and by the benchmarks
+/// alike. The loops over receivers and trails use the global job
+/// system.
+namespace Systems {
+
+/// Gather the positions and coefficients of all the gravity sources
+/// into 'sources', so the inner loops only touch a small dense array.
+/// The sun might have been dragged since the last step, so the
+/// position of the body is used if there's one.
+extern void GatherGravitySources(const EntityPool &pool, vector<GravitySourceState> &sources);
+
+/// Return the gravitational force of the given sources at 'pos', for a
+/// unit coefficient receiver.
+extern b2Vec2 GetGravity(const vector<GravitySourceState> &sources, b2Vec2 pos);
+
+/// Move a body with the given inverse mass along its orbit around the
+/// sources for 'dt', with a leapfrog integrator and as many sub-steps
+/// (up to Config::OrbitalMaxSubsteps) as its distance to the closest
+/// source needs. Returns the acceleration at the new position.
+extern b2Vec2 IntegrateOrbit(const vector<GravitySourceState> &sources,
+                             float invMass,
+                             float dt,
+                             b2Vec2 &pos,
+                             b2Vec2 &velocity);
+
+/// Apply the force of the gravity sources to all the receivers with a
+/// body, recording it in their GravityReceiver component. 'sources' is
+/// scratch space.
+extern void ApplyGravity(EntityPool &pool, vector<GravitySourceState> &sources);
+
+/// Copy the positions and angles of the bodies into their transforms.
+extern void SyncTransforms(EntityPool &pool);
+
+/// Drop the trail points older than each trail's time window, and add
+/// the current position at the given time.
+extern void UpdateTrails(EntityPool &pool, float time);
+
+/// Move the ballistic entities along their velocity for 'dt', and
+/// promote the ones whose path over the step, plus a margin, comes
+/// near a sun or a planet, giving them a body in 'world'. 'targets' and
+/// 'promoted' are scratch space. Returns the number of entities
+/// promoted.
+extern int AdvanceBallistic(EntityPool &pool,
+                            b2World *world,
+                            float dt,
+                            vector<b2AABB> &targets,
+                            vector<EntityHandle> &promoted);
+
+} // namespace Systems
+
+#endif /* _GRAVITY_SYSTEMS_HH_ */
@@ -1,89 +1,153 @@
 #include "timer.hh"
 
-#include <iostream>
 #include <algorithm>
 
-vector<Timer*> Timer::timers;
+using namespace std;
 
-Timer::Timer(timer_callback callback) :
-  callback(callback),
-  expired(true)
+Clock::Clock(float resolution) :
+  resolution(resolution),
+  time(0.0),
+  now(0),
+  paused(false),
+  timerCount(0)
 {
-  timers.push_back(this);
+  for (int level = 0; level < LEVELS; ++level)
+    for (int i = 0; i < SLOTS; ++i)
+      this->slots[level][i] = nullptr;
 }
 
-Timer::~Timer() {
-  timers.erase(find(timers.begin(), timers.end(), this));
+Clock::~Clock() {
+  // Leave the timers unscheduled, in case they outlive the clock.
+  for (int level = 0; level < LEVELS; ++level)
+    for (int i = 0; i < SLOTS; ++i)
+      while (this->slots[level][i])
+        this->Unlink(this->slots[level][i]);
 }
 
-void Timer::Set(float timeout, bool periodic) {
-  this->startTime = SDL_GetTicks();
-  this->timeout = timeout;
-  this->periodic = periodic;
-  this->expired = false;
+void Clock::Insert(Timer *timer) {
+  uint64_t delta = timer->expiry - this->now;
+
+  // Find the lowest level whose range covers the timer. Timers beyond
+  // the range of the wheel go in the furthest slot, and are put back
+  // in when the last level cascades.
+  int level = 0;
+  while (level < LEVELS - 1 && delta >= (uint64_t) 1 << (SLOT_BITS * (level + 1)))
+    level++;
+
+  uint64_t expiry = timer->expiry;
+  if (delta >= (uint64_t) 1 << (SLOT_BITS * LEVELS))
+    expiry = this->now + ((uint64_t) 1 << (SLOT_BITS * LEVELS)) - 1;
+
+  Timer **slot = &this->slots[level][(expiry >> (SLOT_BITS * level)) & SLOT_MASK];
+  timer->slot = slot;
+  timer->prev = nullptr;
+  timer->next = *slot;
+  if (*slot)
+    (*slot)->prev = timer;
+  *slot = timer;
+
+  this->timerCount++;
 }
 
-void Timer::Check() {
-  if (this->expired || this->paused)
-    return;
+void Clock::Unlink(Timer *timer) {
+  if (timer->prev)
+    timer->prev->next = timer->next;
+  else
+    *timer->slot = timer->next;
+
+  if (timer->next)
+    timer->next->prev = timer->prev;
+
+  timer->slot = nullptr;
+  timer->prev = timer->next = nullptr;
 
-  float elapsed = (SDL_GetTicks() - this->startTime) / 1000.0;
-  if (elapsed >= this->timeout) {
-    if (this->periodic)
-      this->startTime = SDL_GetTicks();
+  this->timerCount--;
+}
 
-    this->callback(elapsed);
-    this->expired = !this->periodic;
+void Clock::Cascade(int level) {
+  Timer **slot = &this->slots[level][(this->now >> (SLOT_BITS * level)) & SLOT_MASK];
+  while (*slot) {
+    Timer *timer = *slot;
+    this->Unlink(timer);
+    this->Insert(timer);
   }
 }
 
-void Timer::Pause() {
-  if (expired)
-    return;
+void Clock::Fire(Timer *timer) {
+  this->Unlink(timer);
 
-  this->pauseTime = SDL_GetTicks();
-  this->paused = true;
+  float elapsed = (this->now - timer->startTick) * this->resolution;
+
+  // Reschedule before calling back, so that the callback can cancel or
+  // reset the timer.
+  if (timer->period > 0) {
+    timer->startTick = this->now;
+    timer->expiry = this->now + timer->period;
+    this->Insert(timer);
+  }
+
+  timer->callback(elapsed);
 }
 
-void Timer::Unpause() {
-  if (this->expired)
+void Clock::Advance(float dt) {
+  if (this->paused)
     return;
 
-  if (this->paused)
-    this->startTime += SDL_GetTicks() - this->pauseTime;
+  this->time += dt;
+  uint64_t target = this->time / this->resolution;
 
-  this->paused = false;
-}
+  // Nothing to fire; just move the hand.
+  if (this->timerCount == 0) {
+    this->now = max(this->now, target);
+    return;
+  }
 
-bool Timer::TogglePause() {
-  if (this->paused)
-    this->Unpause();
-  else
-    this->Pause();
+  while (this->now < target) {
+    this->now++;
 
-  return this->paused;
-}
+    // Every time a level wraps around, move the timers in the next
+    // slot of the level above down.
+    for (int level = 1; level < LEVELS; ++level) {
+      if ((this->now & (((uint64_t) 1 << (SLOT_BITS * level)) - 1)) != 0)
+        break;
+      this->Cascade(level);
+    }
 
-bool Timer::IsPaused() {
-  return this->paused;
+    Timer **slot = &this->slots[0][this->now & SLOT_MASK];
+    while (*slot)
+      this->Fire(*slot);
+  }
 }
 
-void Timer::CheckAll() {
-  for (auto t : timers)
-    t->Check();
+Timer::Timer(Clock &clock, timer_callback callback) :
+  clock(&clock),
+  callback(callback),
+  startTick(0),
+  expiry(0),
+  period(0),
+  prev(nullptr),
+  next(nullptr),
+  slot(nullptr)
+{
 }
 
-void Timer::PauseAll() {
-  for (auto t : timers)
-    t->Pause();
+Timer::~Timer() {
+  this->Cancel();
 }
 
-void Timer::UnpauseAll() {
-  for (auto t : timers)
-    t->Unpause();
+void Timer::Set(float timeout, bool periodic) {
+  this->Cancel();
+
+  // Never expire on the current tick, which has already been handled.
+  uint64_t ticks = max((uint64_t) 1, (uint64_t) (timeout / this->clock->resolution + 0.5));
+
+  this->startTick = this->clock->now;
+  this->expiry = this->clock->now + ticks;
+  this->period = periodic ? ticks : 0;
+  this->clock->Insert(this);
 }
 
-void Timer::TogglePauseAll() {
-  for (auto t : timers)
-    t->TogglePause();
+void Timer::Cancel() {
+  if (this->slot)
+    this->clock->Unlink(this);
 }
@@ -1,45 +1,98 @@
 #ifndef _GRAVITY_TIMER_HH_
 #define _GRAVITY_TIMER_HH_
 
-#include <SDL2/SDL.h>
-
+#include <cstdint>
 #include <functional>
-#include <vector>
 
 using namespace std;
 
-class Timer {
-protected:
-  typedef function<void (float elapsed)> timer_callback;
+class Timer;
 
-  Uint32 startTime;
-  float timeout;
-  bool periodic;
+/// A source of time for timers. A clock only moves when it's advanced,
+/// and not at all while paused, so pausing every timer bound to it is a
+/// single flag. Use separate clocks for things that pause separately
+/// (e.g. one advanced with the real frame time, one with game time, one
+/// with simulated physics time).
+///
+/// Timers are kept in a hierarchical timing wheel: four levels of 64
+/// slots, each slot a list of the timers expiring in it. Scheduling and
+/// cancelling a timer take constant time, and advancing the clock only
+/// touches the slots for the ticks that passed (timers in the higher
+/// levels are moved down once per 64, 64^2 or 64^3 ticks). The timers
+/// are linked through themselves, so nothing is allocated.
+class Clock {
+protected:
+  static const int LEVELS = 4;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+  static const uint64_t SLOT_MASK = SLOTS - 1;
 
-  Uint32 pauseTime;
+  float resolution;
+  double time;
+  uint64_t now;
   bool paused;
+  size_t timerCount;
+
+  Timer *slots[LEVELS][SLOTS];
+
+  void Insert(Timer *timer);
+  void Unlink(Timer *timer);
+  void Cascade(int level);
+  void Fire(Timer *timer);
+
+  friend class Timer;
+
+public:
+  /// The resolution is the length of a tick, in seconds. Timers fire
+  /// on the first tick at or after their timeout.
+  Clock(float resolution=0.01);
+  ~Clock();
 
-  bool expired;
+  /// Move the clock forward by 'dt' seconds (unless paused), firing
+  /// the timers that expire on the way.
+  void Advance(float dt);
 
+  void Pause() { this->paused = true; }
+  void Resume() { this->paused = false; }
+  void SetPaused(bool paused) { this->paused = paused; }
+  bool IsPaused() const { return this->paused; }
+
+  /// Return the time elapsed on this clock, in seconds.
+  double GetTime() const { return this->time; }
+
+  /// Return the number of scheduled timers.
+  size_t GetTimerCount() const { return this->timerCount; }
+};
+
+class Timer {
+protected:
+  typedef function<void (float elapsed)> timer_callback;
+
+  Clock *clock;
   timer_callback callback;
 
-  static vector<Timer*> timers;
+  uint64_t startTick;
+  uint64_t expiry;
+  uint64_t period;
+
+  // Links in the list of the wheel slot the timer is in. 'slot' is
+  // null when the timer is not scheduled.
+  Timer *prev;
+  Timer *next;
+  Timer **slot;
+
+  friend class Clock;
 
 public:
-  Timer(timer_callback callback);
+  Timer(Clock &clock, timer_callback callback);
   virtual ~Timer();
 
+  /// Schedule the timer to fire after 'timeout' seconds of clock time,
+  /// and then every 'timeout' seconds if periodic. Replaces the current
+  /// schedule, if any.
   void Set(float timeout, bool periodic=false);
-  void Check();
-  void Pause();
-  void Unpause();
-  bool TogglePause();
-  bool IsPaused();
-
-  static void CheckAll();
-  static void PauseAll();
-  static void UnpauseAll();
-  static void TogglePauseAll();
+  void Cancel();
+  bool IsActive() const { return this->slot != nullptr; }
 };
 
 #endif /* _GRAVITY_TIMER_HH_ */
@@ -0,0 +1,201 @@
+#include "trajectory-predictor.hh"
+#include "config.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+TrajectoryPredictor::TrajectoryPredictor(float duration, float timeStep, int trailSize) :
+  duration(duration),
+  timeStep(timeStep),
+  trailSize(trailSize),
+  quit(false),
+  gravity(PredictionGravity::FIXED),
+  hasRequest(false),
+  generation(0),
+  resultsComplete(false),
+  resultsChanged(false)
+{
+  this->worker = thread(&TrajectoryPredictor::Run, this);
+}
+
+TrajectoryPredictor::~TrajectoryPredictor() {
+  {
+    lock_guard<mutex> guard(this->lock);
+    this->quit = true;
+    this->generation++;
+  }
+  this->wakeup.notify_one();
+  this->worker.join();
+}
+
+void TrajectoryPredictor::Request(PredictionGravity gravity,
+                                  const vector<GravitySourceState> &sources,
+                                  const vector<PredictionBody> &bodies)
+{
+  {
+    lock_guard<mutex> guard(this->lock);
+    this->gravity = gravity;
+    this->sources = sources;
+    this->bodies = bodies;
+    this->hasRequest = true;
+  }
+  this->wakeup.notify_one();
+}
+
+void TrajectoryPredictor::Cancel() {
+  lock_guard<mutex> guard(this->lock);
+  this->hasRequest = false;
+  this->generation++;
+  this->results.clear();
+  this->resultsComplete = false;
+  this->resultsChanged = true;
+}
+
+bool TrajectoryPredictor::GetResults(vector<PredictedPath> &paths) {
+  lock_guard<mutex> guard(this->lock);
+  if (!this->resultsChanged)
+    return false;
+
+  paths = this->results;
+  this->resultsChanged = false;
+  return true;
+}
+
+void TrajectoryPredictor::Publish(const vector<PredictedPath> &paths, bool complete, uint32_t generation) {
+  lock_guard<mutex> guard(this->lock);
+
+  // Don't resurrect cancelled results, or replace whole paths with
+  // partial ones.
+  if (this->generation != generation || (this->resultsComplete && !complete))
+    return;
+
+  this->results = paths;
+  this->resultsComplete = complete;
+  this->resultsChanged = true;
+}
+
+void TrajectoryPredictor::Step(PredictionGravity gravity,
+                               const vector<GravitySourceState> &sources,
+                               vector<PredictionBody> &bodies,
+                               vector<b2Vec2> &forces)
+{
+  float dt = this->timeStep;
+
+  switch (gravity) {
+  case PredictionGravity::FIXED:
+    // Same integration as Box2D: update the velocity with the force,
+    // then the position with the new velocity.
+    for (auto &b : bodies) {
+      if (b.held || b.mass <= 0.0)
+        continue;
+
+      b.velocity += dt / b.mass * Systems::GetGravity(sources, b.pos);
+      b.pos += dt * b.velocity;
+    }
+    break;
+
+  case PredictionGravity::ORBITAL:
+    for (auto &b : bodies)
+      if (!b.held && b.mass > 0.0)
+        Systems::IntegrateOrbit(sources, 1.0 / b.mass, dt, b.pos, b.velocity);
+    break;
+
+  case PredictionGravity::MUTUAL: {
+    // The same softened forces as the NBodySolver. There are only a
+    // few bodies, so every pair is done directly.
+    float g = Config::GravityConstant;
+    float softening2 = Config::GravitySoftening * Config::GravitySoftening;
+    forces.assign(bodies.size(), b2Vec2(0.0, 0.0));
+    for (size_t i = 0; i < bodies.size(); ++i)
+      for (size_t j = i + 1; j < bodies.size(); ++j) {
+        b2Vec2 d = bodies[j].pos - bodies[i].pos;
+        float invR = 1.0f / sqrtf(d.LengthSquared() + softening2);
+        b2Vec2 f = g * bodies[i].mass * bodies[j].mass * invR * invR * invR * d;
+        forces[i] += f;
+        forces[j] -= f;
+      }
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      PredictionBody &b = bodies[i];
+      if (b.held || b.mass <= 0.0)
+        continue;
+
+      b.velocity += dt / b.mass * forces[i];
+      b.pos += dt * b.velocity;
+    }
+    break;
+  }
+  }
+}
+
+void TrajectoryPredictor::Run() {
+  PredictionGravity gravity;
+  vector<GravitySourceState> sources;
+  vector<PredictionBody> bodies;
+  vector<PredictedPath> paths;
+  vector<b2Vec2> forces;
+
+  // Check for a cancel, and publish partial results, after this many
+  // steps.
+  const int CHUNK_STEPS = 50;
+
+  while (true) {
+    uint32_t generation;
+    bool partial;
+    {
+      unique_lock<mutex> guard(this->lock);
+      this->wakeup.wait(guard, [this] { return this->hasRequest || this->quit; });
+      if (this->quit)
+        return;
+
+      gravity = this->gravity;
+      sources.swap(this->sources);
+      bodies.swap(this->bodies);
+      this->hasRequest = false;
+      generation = this->generation;
+      partial = !this->resultsComplete;
+    }
+
+    int steps = this->duration / this->timeStep;
+    int recordEvery = max(1, steps / (this->trailSize * 2));
+
+    // A path for each body that moves, in the same order.
+    paths.clear();
+    for (auto &b : bodies) {
+      if (b.held)
+        continue;
+
+      PredictedPath path;
+      path.handle = b.handle;
+      path.radius = b.radius;
+      path.trail.size = this->trailSize;
+      path.trail.time = this->duration;
+      path.trail.points.push_back(TrailPoint(b.pos, 0.0));
+      paths.push_back(path);
+    }
+
+    for (int step = 1; step <= steps; ++step) {
+      this->Step(gravity, sources, bodies, forces);
+
+      if (step % recordEvery == 0) {
+        size_t k = 0;
+        for (auto &b : bodies)
+          if (!b.held)
+            paths[k++].trail.points.push_back(TrailPoint(b.pos, step * this->timeStep));
+      }
+
+      if (step % CHUNK_STEPS == 0 || step == steps) {
+        if (this->generation != generation)
+          break;
+
+        if (partial || step == steps) {
+          for (auto &path : paths)
+            path.trail.ComputeBounds();
+          this->Publish(paths, step == steps, generation);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef _GRAVITY_TRAJECTORY_PREDICTOR_HH_
+#define _GRAVITY_TRAJECTORY_PREDICTOR_HH_
+
+#include "entity.hh"
+#include "components.hh"
+#include "systems.hh"
+
+#include <box2d/box2d.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/// The gravity model of a prediction, one for each of the game's.
+enum class PredictionGravity : uint8_t {
+  FIXED,    ///< Forces of the sources, integrated like Box2D does.
+  ORBITAL,  ///< Same forces, with the orbital integrator.
+  MUTUAL,   ///< Every body attracts every other; no sources.
+};
+
+/// The state of a body at the start of a prediction.
+struct PredictionBody {
+  EntityHandle handle;
+  b2Vec2 pos;
+  b2Vec2 velocity;
+  float mass;
+  float radius;
+
+  // Held in place (i.e. being dragged). It still attracts the others
+  // with mutual gravity, but it doesn't move and gets no path.
+  bool held;
+};
+
+/// The predicted path of a body. The trail point times are relative to
+/// the start of the prediction.
+struct PredictedPath {
+  EntityHandle handle;
+  float radius;
+  Trail trail;
+};
+
+/// Predicts the paths of bodies under gravity on a worker thread. The
+/// worker integrates a copy of the positions and velocities with the
+/// gravity model the game is using (but no collisions), so it never
+/// touches the world.
+///
+/// A prediction in progress is always finished. Requests made in the
+/// meantime are not queued: only the latest is run next. The first
+/// prediction after a cancel is published every few steps, so that
+/// something shows up quickly; after that, only whole predictions
+/// replace the ones shown.
+class TrajectoryPredictor {
+protected:
+  float duration;
+  float timeStep;
+  int trailSize;
+
+  thread worker;
+  mutex lock;
+  condition_variable wakeup;
+  bool quit;
+
+  // The latest request, waiting to be picked up by the worker.
+  PredictionGravity gravity;
+  vector<GravitySourceState> sources;
+  vector<PredictionBody> bodies;
+  bool hasRequest;
+
+  // Bumped on every cancel. The worker checks it to find out if its
+  // current prediction is still wanted.
+  atomic<uint32_t> generation;
+
+  vector<PredictedPath> results;
+  bool resultsComplete;
+  bool resultsChanged;
+
+  void Run();
+  void Step(PredictionGravity gravity,
+            const vector<GravitySourceState> &sources,
+            vector<PredictionBody> &bodies,
+            vector<b2Vec2> &forces);
+  void Publish(const vector<PredictedPath> &paths, bool complete, uint32_t generation);
+
+public:
+  TrajectoryPredictor(float duration, float timeStep, int trailSize);
+  ~TrajectoryPredictor();
+
+  /// Predict the paths of the bodies that aren't held, from the given
+  /// state. The sources are only used with FIXED and ORBITAL gravity.
+  /// Runs once the current prediction is over, unless another request
+  /// comes first.
+  void Request(PredictionGravity gravity,
+               const vector<GravitySourceState> &sources,
+               const vector<PredictionBody> &bodies);
+
+  /// Cancel the current prediction and any waiting request, and drop
+  /// the results.
+  void Cancel();
+
+  /// Get the latest (possibly partial) results. Returns false, and
+  /// leaves 'paths' alone, if nothing has changed since the last call.
+  bool GetResults(vector<PredictedPath> &paths);
+};
+
+#endif /* _GRAVITY_TRAJECTORY_PREDICTOR_HH_ */
@@ -0,0 +1,104 @@
+#include "view-state.hh"
+#include "resource-cache.hh"
+
+using namespace std;
+
+namespace ViewState {
+
+/// Mirrors the "View" block (std140 layout) in the shaders.
+struct ViewUniforms {
+  GLfloat resolution[2];
+  GLfloat cameraPos[2];
+  GLfloat ppm;
+  GLfloat padding[3];
+};
+
+static GLuint ubo = 0;
+static ViewUniforms uniforms;
+static bool dirty = true;
+static int windowWidth = 0;
+static int windowHeight = 0;
+static int uploadCount = 0;
+
+static void BindBlock(GLuint program) {
+  GLuint index = glGetUniformBlockIndex(program, "View");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, index, BINDING_POINT);
+}
+
+void Init(SDL_Window *window) {
+  BindBlock(ResourceCache::texturedPolygonProgram);
+  BindBlock(ResourceCache::hudTexturedPolygonProgram);
+  BindBlock(ResourceCache::textProgram);
+  BindBlock(ResourceCache::backgroundProgram);
+
+  glGenBuffers(1, &ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, ubo);
+
+  uniforms = ViewUniforms();
+  uniforms.ppm = 1.0;
+
+  int winw, winh;
+  SDL_GetWindowSize(window, &winw, &winh);
+  SetWindowSize(winw, winh);
+  Upload();
+}
+
+void Finalize() {
+  glDeleteBuffers(1, &ubo);
+  ubo = 0;
+}
+
+void SetWindowSize(int width, int height) {
+  if (width == windowWidth && height == windowHeight)
+    return;
+
+  windowWidth = width;
+  windowHeight = height;
+  glViewport(0, 0, width, height);
+
+  uniforms.resolution[0] = width;
+  uniforms.resolution[1] = height;
+  dirty = true;
+}
+
+int GetWindowWidth() {
+  return windowWidth;
+}
+
+int GetWindowHeight() {
+  return windowHeight;
+}
+
+void SetCamera(const Camera &camera) {
+  if (uniforms.cameraPos[0] == camera.pos.x &&
+      uniforms.cameraPos[1] == camera.pos.y &&
+      uniforms.ppm == camera.ppm)
+    return;
+
+  uniforms.cameraPos[0] = camera.pos.x;
+  uniforms.cameraPos[1] = camera.pos.y;
+  uniforms.ppm = camera.ppm;
+  dirty = true;
+}
+
+void Upload() {
+  if (!dirty)
+    return;
+
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ViewUniforms), &uniforms);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  dirty = false;
+  uploadCount++;
+}
+
+int GetUploadCount() {
+  return uploadCount;
+}
+
+} // namespace ViewState
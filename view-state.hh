@@ -0,0 +1,43 @@
+#ifndef _GRAVITY_VIEW_STATE_HH_
+#define _GRAVITY_VIEW_STATE_HH_
+
+#include "camera.hh"
+#include "glew.h"
+
+#include <SDL2/SDL.h>
+
+/// The window size and the camera, as seen by the shaders. Both are
+/// kept in a single uniform buffer bound to the "View" uniform block
+/// of every program that declares it, and the buffer is only uploaded
+/// when something has changed.
+///
+/// The window size is cached here (updated from window events), so
+/// there's no need to query SDL for it in hot loops.
+namespace ViewState {
+
+/// Uniform block binding point used for the view uniform buffer.
+const GLuint BINDING_POINT = 0;
+
+/// Create the uniform buffer and bind the "View" block of the
+/// programs in the resource cache to it. Must be called after the
+/// resource cache is initialized.
+extern void Init(SDL_Window *window);
+extern void Finalize();
+
+/// Update the window size (and the OpenGL viewport).
+extern void SetWindowSize(int width, int height);
+extern int GetWindowWidth();
+extern int GetWindowHeight();
+
+extern void SetCamera(const Camera &camera);
+
+/// Upload the uniform buffer if anything has changed since the last
+/// upload.
+extern void Upload();
+
+/// Return the number of uploads so far. Used for debugging.
+extern int GetUploadCount();
+
+} // namespace ViewState
+
+#endif /* _GRAVITY_VIEW_STATE_HH_ */
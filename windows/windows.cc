@@ -19,3 +19,7 @@ string GetUserHomeDirectory() {
 void ShowMessage(string msg) {
   MessageBox(0, msg.data(), "Gravity", MB_OK);
 }
+
+bool RenameFileOver(const string &from, const string &to) {
+  return MoveFileEx(from.data(), to.data(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}